@@ -0,0 +1,72 @@
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "srt.h"
+
+#include "benchmark/benchmark.h"
+
+// Cursor driven workload: every insert goes next to the previous one, with a
+// jump to a random position every kRunLength inserts.
+
+namespace {
+
+constexpr int kRunLength = 64;
+constexpr int kInserts = 1000;
+
+std::vector<int> odd_numbers(size_t size) {
+  std::vector<int> res(size);
+  for (size_t i = 0; i != size; ++i) res[i] = static_cast<int>(2 * i + 1);
+  return res;
+}
+
+std::vector<int> clustered_input(size_t size) {
+  std::mt19937 g;
+  std::uniform_int_distribution<size_t> dis(0, size);
+
+  std::vector<int> res;
+  int cursor = 0;
+  for (int i = 0; i != kInserts; ++i) {
+    if (i % kRunLength == 0) cursor = 2 * static_cast<int>(dis(g));
+    res.push_back(cursor);
+    cursor += 2;
+  }
+  return res;
+}
+
+void set_input_sizes(benchmark::internal::Benchmark* bench) {
+  for (int size : {1000, 10000, 100000, 1000000}) bench->Arg(size);
+}
+
+template <typename Container>
+void clustered_inserts_bench(benchmark::State& state) {
+  const size_t size = static_cast<size_t>(state.range(0));
+  std::vector<int> already_in = odd_numbers(size);
+  std::vector<int> new_elements = clustered_input(size);
+  const Container cached(already_in.begin(), already_in.end());
+
+  for (auto _ : state) {
+    state.PauseTiming();
+    Container c(cached);
+    state.ResumeTiming();
+
+    auto hint = c.begin();
+    for (int x : new_elements) hint = c.insert(hint, x);
+    benchmark::DoNotOptimize(c);
+  }
+}
+
+void FlatSet(benchmark::State& state) {
+  clustered_inserts_bench<srt::flat_set<int>>(state);
+}
+
+void GapFlatSet(benchmark::State& state) {
+  clustered_inserts_bench<srt::gap_flat_set<int>>(state);
+}
+
+}  // namespace
+
+BENCHMARK(FlatSet)->Apply(set_input_sizes);
+BENCHMARK(GapFlatSet)->Apply(set_input_sizes);
+
+BENCHMARK_MAIN();
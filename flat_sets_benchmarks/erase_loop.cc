@@ -0,0 +1,78 @@
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "srt.h"
+
+#include "benchmark/benchmark.h"
+
+// Churn workload: erase a random half of the elements one by one, or all at
+// once with erase_keys.
+
+namespace {
+
+std::vector<int> iota_numbers(size_t size) {
+  std::vector<int> res(size);
+  for (size_t i = 0; i != size; ++i) res[i] = static_cast<int>(i);
+  return res;
+}
+
+std::vector<int> to_erase(size_t size) {
+  std::vector<int> res = iota_numbers(size);
+  std::shuffle(res.begin(), res.end(), std::mt19937{});
+  res.resize(size / 2);
+  return res;
+}
+
+void set_input_sizes(benchmark::internal::Benchmark* bench) {
+  for (int size : {1000, 10000, 100000}) bench->Arg(size);
+}
+
+template <typename Container>
+void erase_loop_bench(benchmark::State& state) {
+  const size_t size = static_cast<size_t>(state.range(0));
+  std::vector<int> already_in = iota_numbers(size);
+  std::vector<int> erased = to_erase(size);
+  const Container cached(already_in.begin(), already_in.end());
+
+  for (auto _ : state) {
+    state.PauseTiming();
+    Container c(cached);
+    state.ResumeTiming();
+
+    for (int x : erased) c.erase(x);
+    benchmark::DoNotOptimize(c);
+  }
+}
+
+void FlatSetEraseKeys(benchmark::State& state) {
+  const size_t size = static_cast<size_t>(state.range(0));
+  std::vector<int> already_in = iota_numbers(size);
+  std::vector<int> erased = to_erase(size);
+  const srt::flat_set<int> cached(already_in.begin(), already_in.end());
+
+  for (auto _ : state) {
+    state.PauseTiming();
+    srt::flat_set<int> c(cached);
+    state.ResumeTiming();
+
+    c.erase_keys(erased.begin(), erased.end());
+    benchmark::DoNotOptimize(c);
+  }
+}
+
+void FlatSet(benchmark::State& state) {
+  erase_loop_bench<srt::flat_set<int>>(state);
+}
+
+void LazyEraseFlatSet(benchmark::State& state) {
+  erase_loop_bench<srt::lazy_erase_flat_set<int>>(state);
+}
+
+}  // namespace
+
+BENCHMARK(FlatSet)->Apply(set_input_sizes);
+BENCHMARK(LazyEraseFlatSet)->Apply(set_input_sizes);
+BENCHMARK(FlatSetEraseKeys)->Apply(set_input_sizes);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,166 @@
+#include <algorithm>
+#include <map>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "srt.h"
+
+#include "benchmark/benchmark.h"
+
+// Used to tune the cost model in flat_set::insert(f, l):
+// every strategy is measured separately, Srt should follow the lower envelope.
+
+namespace {
+
+constexpr int kMaxValue = 1000000;
+
+template <typename T>
+T make_value(int x);
+
+template <>
+int make_value<int>(int x) {
+  return x;
+}
+
+template <>
+std::string make_value<std::string>(int x) {
+  return std::string(20, 'a') + std::to_string(x);
+}
+
+template <typename T>
+using vec = std::vector<T>;
+
+template <typename T>
+std::pair<vec<T>, vec<T>> input_data(size_t lhs_size, size_t rhs_size) {
+  static std::map<std::pair<size_t, size_t>, std::pair<vec<T>, vec<T>>> cache;
+
+  auto in_cache = cache.find({lhs_size, rhs_size});
+  if (in_cache != cache.end())
+    return in_cache->second;
+
+  auto random_number = [] {
+    static std::mt19937 g;
+    static std::uniform_int_distribution<> dis(1, kMaxValue);
+    return dis(g);
+  };
+
+  auto generate_unique_sorted_vec = [&](size_t size) {
+    std::set<T> res;
+    while (res.size() < size)
+      res.insert(make_value<T>(random_number()));
+    return vec<T>(res.begin(), res.end());
+  };
+
+  auto generate_vec = [&](size_t size) {
+    vec<T> res;
+    while (res.size() < size)
+      res.push_back(make_value<T>(random_number()));
+    return res;
+  };
+
+  std::pair<vec<T>, vec<T>> value{generate_unique_sorted_vec(lhs_size),
+                                  generate_vec(rhs_size)};
+  auto& res = cache[{lhs_size, rhs_size}];
+  res = std::move(value);
+  return res;
+}
+
+void set_input_sizes(benchmark::internal::Benchmark* bench) {
+  for (int lhs_size : {0, 1, 10, 100, 1000, 10000}) {
+    for (int rhs_size : {1, 2, 4, 8, 16, 32, 64, 128, 1000}) {
+      bench->Args({lhs_size, rhs_size});
+    }
+  }
+}
+
+template <typename Container>
+void insert_first_last_bench(benchmark::State& state) {
+  using value_type = typename Container::value_type;
+  const size_t lhs_size = static_cast<size_t>(state.range(0));
+  const size_t rhs_size = static_cast<size_t>(state.range(1));
+
+  auto input = input_data<value_type>(lhs_size, rhs_size);
+  const Container cached(input.first.begin(), input.first.end());
+
+  for (auto _ : state) {
+    Container c(cached);
+    c.insert(input.second.begin(), input.second.end());
+    benchmark::DoNotOptimize(c);
+  }
+}
+
+template <typename T>
+struct by_one : srt::flat_set<T> {
+  using srt::flat_set<T>::flat_set;
+
+  template <typename I>
+  void insert(I f, I l) {
+    auto hint = this->cbegin();
+    for (; f != l; ++f) hint = std::next(srt::flat_set<T>::insert(hint, *f));
+  }
+};
+
+template <typename T>
+struct merge : srt::flat_set<T> {
+  using srt::flat_set<T>::flat_set;
+
+  template <typename I>
+  void insert(I f, I l) {
+    vec<T> buf(f, l);
+    buf.erase(srt::sort_and_unique(buf.begin(), buf.end()), buf.end());
+    this->insert_sorted_unique(std::make_move_iterator(buf.begin()),
+                               std::make_move_iterator(buf.end()));
+  }
+};
+
+template <typename T>
+struct rebuild : srt::flat_set<T> {
+  using srt::flat_set<T>::flat_set;
+
+  template <typename I>
+  void insert(I f, I l) {
+    auto& body = this->body();
+    auto orig_len = body.size();
+    body.insert(body.end(), f, l);
+    auto m = body.begin() + orig_len;
+    auto new_l = srt::sort_and_unique(m, body.end());
+    srt::inplace_merge_rotating_middles(body.begin(), m, new_l);
+    body.erase(std::unique(body.begin(), new_l), body.end());
+  }
+};
+
+template <typename T>
+void ByOne(benchmark::State& state) {
+  insert_first_last_bench<by_one<T>>(state);
+}
+
+template <typename T>
+void Merge(benchmark::State& state) {
+  insert_first_last_bench<merge<T>>(state);
+}
+
+template <typename T>
+void Rebuild(benchmark::State& state) {
+  insert_first_last_bench<rebuild<T>>(state);
+}
+
+template <typename T>
+void Srt(benchmark::State& state) {
+  insert_first_last_bench<srt::flat_set<T>>(state);
+}
+
+}  // namespace
+
+BENCHMARK_TEMPLATE(ByOne, int)->Apply(set_input_sizes);
+BENCHMARK_TEMPLATE(Merge, int)->Apply(set_input_sizes);
+BENCHMARK_TEMPLATE(Rebuild, int)->Apply(set_input_sizes);
+BENCHMARK_TEMPLATE(Srt, int)->Apply(set_input_sizes);
+
+BENCHMARK_TEMPLATE(ByOne, std::string)->Apply(set_input_sizes);
+BENCHMARK_TEMPLATE(Merge, std::string)->Apply(set_input_sizes);
+BENCHMARK_TEMPLATE(Rebuild, std::string)->Apply(set_input_sizes);
+BENCHMARK_TEMPLATE(Srt, std::string)->Apply(set_input_sizes);
+
+BENCHMARK_MAIN();
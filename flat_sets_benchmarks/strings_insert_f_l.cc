@@ -131,6 +131,23 @@ void Srt(benchmark::State& state) {
 }
 BENCHMARK(Srt)->Apply(full_problem_size);
 
+void SrtRawVector(benchmark::State& state) {
+  string_insert_first_last_bench<
+      srt::flat_set<std::string, srt::less, srt::raw_vector<std::string>>>(
+      state);
+}
+BENCHMARK(SrtRawVector)->Apply(full_problem_size);
+
+void SrtStringFlatSet(benchmark::State& state) {
+  string_insert_first_last_bench<srt::string_flat_set>(state);
+}
+BENCHMARK(SrtStringFlatSet)->Apply(full_problem_size);
+
+void SrtPrefixedStringSet(benchmark::State& state) {
+  string_insert_first_last_bench<srt::prefixed_string_set>(state);
+}
+BENCHMARK(SrtPrefixedStringSet)->Apply(full_problem_size);
+
 void Folly(benchmark::State& state) {
   string_insert_first_last_bench<folly::sorted_vector_set<std::string>>(state);
 }
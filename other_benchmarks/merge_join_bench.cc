@@ -0,0 +1,91 @@
+#include <algorithm>
+#include <random>
+#include <set>
+#include <utility>
+#include <vector>
+
+#include "srt.h"
+
+#include "benchmark/benchmark.h"
+
+// Inner join of two flat_maps on key: a two pointer loop against galloping
+// the smaller map through the larger one.
+
+namespace {
+
+constexpr size_t kLargeSize = 100000u;
+
+using int_map = srt::flat_map<int, int>;
+
+int_map random_map(size_t size) {
+  static std::mt19937 g;
+  std::uniform_int_distribution<> dis(1, static_cast<int>(kLargeSize) * 4);
+
+  std::set<int> keys;
+  while (keys.size() < size) keys.insert(dis(g));
+
+  int_map res;
+  for (int key : keys) res.body().emplace_back(key, key);
+  return res;
+}
+
+void set_ratios(benchmark::internal::Benchmark* bench) {
+  for (int ratio : {1, 10, 100, 1000}) bench->Arg(ratio);
+}
+
+struct two_pointers {
+  template <typename Callback>
+  void operator()(const int_map& x, const int_map& y, Callback callback) {
+    auto f1 = x.begin();
+    auto f2 = y.begin();
+    while (f1 != x.end() && f2 != y.end()) {
+      if (f1->first < f2->first) {
+        ++f1;
+      } else if (f2->first < f1->first) {
+        ++f2;
+      } else {
+        callback(*f1, *f2);
+        ++f1;
+        ++f2;
+      }
+    }
+  }
+};
+
+struct srt_merge_join {
+  template <typename Callback>
+  void operator()(const int_map& x, const int_map& y, Callback callback) {
+    srt::merge_join(x, y, callback);
+  }
+};
+
+template <typename Alg>
+void merge_join_bench(benchmark::State& state) {
+  const size_t ratio = static_cast<size_t>(state.range(0));
+  const int_map large = random_map(kLargeSize);
+  const int_map small = random_map(kLargeSize / ratio);
+
+  for (auto _ : state) {
+    int sum = 0;
+    Alg{}(small, large,
+          [&](const std::pair<int, int>& x, const std::pair<int, int>& y) {
+            sum += x.second + y.second;
+          });
+    benchmark::DoNotOptimize(sum);
+  }
+}
+
+void TwoPointers(benchmark::State& state) {
+  merge_join_bench<two_pointers>(state);
+}
+
+void SrtMergeJoin(benchmark::State& state) {
+  merge_join_bench<srt_merge_join>(state);
+}
+
+}  // namespace
+
+BENCHMARK(TwoPointers)->Apply(set_ratios);
+BENCHMARK(SrtMergeJoin)->Apply(set_ratios);
+
+BENCHMARK_MAIN();
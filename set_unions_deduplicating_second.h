@@ -1,6 +1,7 @@
 #pragma once
 
 #include <algorithm>
+#include <iterator>
 
 #include "srt.h"
 
@@ -14,7 +15,7 @@ O set_union_deduplicating_second(I1 f1,
                                  O o,
                                  Compare comp) {
   l2 = std::unique(f2, l2, srt::not_fn(comp));
-  return srt::set_union_biased(f1, l1, f2, l2, o, comp);
+  return srt::set_union_unique_biased(f1, l1, f2, l2, o, comp);
 }
 
 }  // namespace v1
@@ -22,4 +23,21 @@ O set_union_deduplicating_second(I1 f1,
 
 namespace v2 {
 
+// Last writer wins: the last of equal elements in the second range is kept
+// and it replaces the equal element from the first range.
+template <typename I1, typename I2, typename O, typename Compare>
+O set_union_deduplicating_second(I1 f1,
+                                 I1 l1,
+                                 I2 f2,
+                                 I2 l2,
+                                 O o,
+                                 Compare comp) {
+  using reverse_it = std::reverse_iterator<I2>;
+  f2 = std::unique(reverse_it(l2), reverse_it(f2),
+                   srt::inverse_fn(srt::not_fn(comp)))
+           .base();
+  return srt::set_union_unique_biased(f1, l1, f2, l2, o, comp,
+                                      srt::take_second{});
+}
+
 }  // namespace v2
@@ -10,3 +10,27 @@ TEST_CASE("v1_set_union_deduplicating_second",
     return v1::set_union_deduplicating_second(f1, l1, f2, l2, o, std::less<>{});
   });
 }
+
+TEST_CASE("v2_set_union_deduplicating_second",
+          "[set_unions_deduplicating_second]") {
+  set_union_deduplicating_second_test([](auto f1, auto l1, auto f2, auto l2,
+                                         auto o) {
+    return v2::set_union_deduplicating_second(f1, l1, f2, l2, o, std::less<>{});
+  });
+}
+
+TEST_CASE("v2_set_union_deduplicating_second_last_wins",
+          "[set_unions_deduplicating_second]") {
+  using kv = std::pair<int, int>;
+  auto by_key = [](const kv& x, const kv& y) { return x.first < y.first; };
+
+  std::vector<kv> lhs = {{1, 0}, {3, 0}, {5, 0}};
+  std::vector<kv> rhs = {{2, 1}, {3, 1}, {3, 2}, {6, 1}, {6, 2}};
+  std::vector<kv> actual;
+  v2::set_union_deduplicating_second(lhs.begin(), lhs.end(), rhs.begin(),
+                                     rhs.end(), std::back_inserter(actual),
+                                     by_key);
+
+  std::vector<kv> expected = {{1, 0}, {2, 1}, {3, 2}, {5, 0}, {6, 2}};
+  REQUIRE(expected == actual);
+}
@@ -6,11 +6,23 @@
 #define SRT_LIBRARY_H_
 
 #include <algorithm>
+#include <array>
 #include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <functional>
 #include <initializer_list>
 #include <iterator>
+#include <limits>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <string>
 #include <tuple>
 #include <type_traits>
+#include <utility>
 #include <vector>
 
 namespace srt {
@@ -27,6 +39,24 @@ template <typename T>
 struct has_is_transparent_member<T, void_t<typename T::is_transparent>>
     : std::true_type {};
 
+template <typename, typename = void>
+struct has_commit_uninitialized_member : std::false_type {};
+
+template <typename C>
+struct has_commit_uninitialized_member<
+    C, void_t<decltype(std::declval<C&>().commit_uninitialized(0))>>
+    : std::true_type {};
+
+template <typename C>
+constexpr std::size_t inline_capacity(...) {
+  return 0;
+}
+
+template <typename C>
+constexpr std::size_t inline_capacity(decltype(C::inline_capacity())*) {
+  return C::inline_capacity();
+}
+
 }  // namespace detail
 
 // meta functions -------------------------------------------------------------
@@ -75,6 +105,25 @@ constexpr bool ResizeableContainer() {
   return std::is_trivially_default_constructible<ContainerValueType<C>>::value;
 }
 
+// Container exposes the memory between size() and capacity():
+// elements can be constructed at data() + size() and then accounted for with
+// commit_uninitialized(n).
+template <typename C>
+constexpr bool UninitializedTailContainer() {
+  return detail::has_commit_uninitialized_member<C>::value;
+}
+
+// How many elements the container keeps without allocating.
+template <typename C>
+constexpr std::size_t InlineCapacity() {
+  return detail::inline_capacity<C>(nullptr);
+}
+
+// Moving an object to a new address and destroying the source is the same as
+// copying its bytes. Specialize for types like std::unique_ptr.
+template <typename T>
+struct is_trivially_relocatable : std::is_trivially_copyable<T> {};
+
 // predeclarations ------------------------------------------------------------
 
 struct less;
@@ -127,6 +176,20 @@ template <typename I1, typename I2, typename O, typename Compare>
 // requires RandomAccessIterator<I>
 O set_union_unique_biased(I1 f1, I1 l1, I2 f2, I2 l2, O o);
 
+template <typename I1, typename I2, typename O, typename Compare,
+          typename OnEqual>
+// requires RandomAccessIterator<I> && StrictWeakOrdering<Compare<ValueType<I>>
+//          && UnionPolicy<OnEqual>
+O set_union_unique_biased(I1 f1, I1 l1, I2 f2, I2 l2, O o, Compare comp,
+                          OnEqual);
+
+template <typename I1, typename I2, typename O, typename Compare,
+          typename Combine>
+// requires RandomAccessIterator<I> && StrictWeakOrdering<Compare<ValueType<I>>
+//          && BinaryFunction<Combine(Reference<I1>, Reference<I2>)>
+O set_union_combine(I1 f1, I1 l1, I2 f2, I2 l2, O o, Compare comp,
+                    Combine combine);
+
 template <typename I, typename N, typename P>
 // requires ForwardIterator<I> && UnaryPredicate<P, ValueType<I>>
 I partition_point_n(I f, DifferenceType<I> n, P p);
@@ -154,19 +217,48 @@ I partition_point_hinted(I f, I hint, I l, P p);
 
 template <typename I, typename V, typename Compare>
 // requires RandomAccessIterator<I> && StrictWeakOrdering<Compare<ValueType<I>>
-I lower_bound_biased(I f, I l, V v, Compare comp);
+I lower_bound_biased(I f, I l, const V& v, Compare comp);
 
 template <typename I, typename V>
-// requires RandomAccessIterator<I>  // TODO: pass by const ref.
-I lower_bound_biased(I f, I l, V v);
+// requires RandomAccessIterator<I>
+I lower_bound_biased(I f, I l, const V& v);
 
 template <typename I, typename V, typename Compare>
 // requires RandomAccessIterator<I> && StrictWeakOrdering<Compare<ValueType<I>>
-I lower_bound_hinted(I f, I hint, I l, V v, Compare comp);
+I lower_bound_hinted(I f, I hint, I l, const V& v, Compare comp);
 
 template <typename I, typename V>
 // requires RandomAccessIterator<I>
-I lower_bound_hinted(I f, I hint, I l, V v);
+I lower_bound_hinted(I f, I hint, I l, const V& v);
+
+template <typename I, typename V, typename Compare>
+// requires ForwardIterator<I> && StrictWeakOrdering<Compare<ValueType<I>>
+I lower_bound_linear(I f, I l, const V& v, Compare comp);
+
+template <typename I, typename V>
+// requires ForwardIterator<I>
+I lower_bound_linear(I f, I l, const V& v);
+
+template <typename I1, typename I2, typename Compare, typename Callback>
+// requires RandomAccessIterator<I1> && RandomAccessIterator<I2> &&
+//          StrictWeakOrdering<Compare(ValueType<I1>, ValueType<I2>)> &&
+//          BinaryFunction<Callback(Reference<I1>, Reference<I2>)>
+Callback merge_join(I1 f1, I1 l1, I2 f2, I2 l2, Compare comp,
+                    Callback callback);
+
+template <typename I1, typename I2, typename Compare, typename Callback>
+// requires RandomAccessIterator<I1> && RandomAccessIterator<I2> &&
+//          StrictWeakOrdering<Compare(ValueType<I1>, ValueType<I2>)> &&
+//          BinaryFunction<Callback(Reference<I1>, Pointer to ValueType<I2>)>
+Callback merge_join_left(I1 f1, I1 l1, I2 f2, I2 l2, Compare comp,
+                         Callback callback);
+
+template <typename I1, typename I2, typename Compare, typename Callback>
+// requires RandomAccessIterator<I1> && RandomAccessIterator<I2> &&
+//          StrictWeakOrdering<Compare(ValueType<I1>, ValueType<I2>)> &&
+//          UnaryFunction<Callback(Reference<I1>)>
+Callback merge_join_anti(I1 f1, I1 l1, I2 f2, I2 l2, Compare comp,
+                         Callback callback);
 
 template <typename I>
 // requires RandomAccessIterator<I>
@@ -209,9 +301,35 @@ void resize_with_junk(C& c, T&& sample, ContainerSizeType<C> new_len);
 // functors -------------------------------------------------------------------
 
 struct less;
+struct identity;
+
+// Policies for unions: which of two equal elements goes to the output.
+// A binary functor is a policy too: it combines the two elements into one.
+struct keep_first {};
+struct take_second {};
 
 namespace detail {
 
+template <typename OnEqual>
+constexpr bool keeps_first() {
+  return std::is_same<OnEqual, keep_first>::value;
+}
+
+template <typename I1, typename I2>
+Reference<I1> equal_result(keep_first, I1 f1, I2) {
+  return *f1;
+}
+
+template <typename I1, typename I2>
+Reference<I2> equal_result(take_second, I1, I2 f2) {
+  return *f2;
+}
+
+template <typename F, typename I1, typename I2>
+auto equal_result(F& combine, I1 f1, I2 f2) -> decltype(combine(*f1, *f2)) {
+  return combine(*f1, *f2);
+}
+
 template <typename F>
 struct not_fn_t;
 
@@ -255,6 +373,16 @@ class junk_iterator {
     return tmp;
   }
 
+  junk_iterator& operator--() {
+    --count_;
+    return *this;
+  }
+  junk_iterator operator--(int) {
+    junk_iterator tmp = *this;
+    operator--();
+    return tmp;
+  }
+
   junk_iterator& operator+=(difference_type distance) {
     count_ += distance;
     return *this;
@@ -419,6 +547,15 @@ typename std::enable_if
 >::type;
 // clang-format on
 
+// clang-format off
+template <typename ContainerValueType, typename Scratch>
+using scratch_should_be_enabled =
+typename std::enable_if
+<
+  std::is_same<ContainerValueType, srt::ContainerValueType<Scratch>>::value
+>::type;
+// clang-format on
+
 // clang-format off
 template <typename I, typename P>
 I partition_point_biased_no_checks(I f, P p) {
@@ -443,13 +580,14 @@ I find_boundary(I f, I l, P p) {
 }
 
 // clang-format off
-template <class I1, class I2, class O, class Comp>
+template <class I1, class I2, class O, class Comp, class OnEqual>
 std::tuple<I1, I2, O> set_union_intersecting_parts(I1 f1,
                                                    I1 l1,
                                                    I2 f2,
                                                    I2 l2,
                                                    O o,
-                                                   Comp comp) {
+                                                   Comp comp,
+                                                   OnEqual on_equal) {
   if (f1 == l1) goto copySecond;
   if (f2 == l2) goto copyFirst;
 
@@ -460,7 +598,14 @@ std::tuple<I1, I2, O> set_union_intersecting_parts(I1 f1,
 
    checkSecond:
     if (comp(*f2, *f1)) *o++ = *f2;
+    else if (!keeps_first<OnEqual>()) goto replaceFirst;
     ++f2; if (f2 == l2) goto copyFirst;
+    goto biased;
+
+   replaceFirst:
+    *o++ = detail::equal_result(on_equal, f1, f2); ++f1; ++f2;
+    if (f1 == l1) goto copySecond;
+    if (f2 == l2) goto copyFirst;
 
    biased:
     if (!comp(*f1, *f2)) goto checkSecond;
@@ -484,16 +629,18 @@ std::tuple<I1, I2, O> set_union_intersecting_parts(I1 f1,
 }
 // clang-format on
 
-template <typename I1, typename I2, typename P>
-// requires ForwardIterator<I1> && ForwardIterator<I2> &&
-//          StrictWeakOrdering<P, ValueType<I>>
-std::pair<I1, I1> set_union_into_tail(I1 buf, I1 f1, I1 l1, I2 f2, I2 l2, P p) {
+template <typename O, typename I1, typename I2, typename P,
+          typename OnEqual>
+// requires ForwardIterator<I1> && ForwardIterator<I2> && OutputIterator<O> &&
+//          StrictWeakOrdering<P, ValueType<I>> && UnionPolicy<OnEqual>
+std::pair<O, I1> set_union_into_tail(O buf, I1 f1, I1 l1, I2 f2, I2 l2, P p,
+                                     OnEqual on_equal) {
   std::move_iterator<I1> move_f1;
   std::tie(move_f1, f2, buf) =
       set_union_intersecting_parts(std::make_move_iterator(f1),  //
                                    std::make_move_iterator(l1),  //
                                    f2, l2,                       //
-                                   buf, p);                      //
+                                   buf, p, on_equal);            //
 
   return {srt::copy(f2, l2, buf), move_f1.base()};
 }
@@ -503,14 +650,179 @@ std::reverse_iterator<I> make_reverse_iterator(I it) {
   return std::reverse_iterator<I>{it};
 }
 
-template <typename C, typename I, typename P>
+template <typename C>
+// requires Container<C>
+ContainerSizeType<C> grown_capacity(const C& c, ContainerSizeType<C> min_cap) {
+  return std::max(min_cap, c.capacity() + c.capacity());
+}
+
+// If the elements do not fit, resize_with_junk would move everything into the
+// new memory and then the backward merge would move it again. Instead we merge
+// forward straight into the new buffer, so every element moves exactly once.
+template <typename C, typename I, typename P, typename OnEqual>
 // requires Container<C> && ForwardIterator<I> &&
-// StrictWeakOrdering<P(ValueType<C>)>
-void insert_sorted_unique_impl(C& c, I f, I l, P p) {
-  auto new_len = std::distance(f, l);
+// StrictWeakOrdering<P(ValueType<C>)> && UnionPolicy<OnEqual>
+void insert_sorted_unique_reallocating(C& c, I f, I l, P p,
+                                       ContainerSizeType<C> min_cap,
+                                       OnEqual on_equal) {
+  C buf(c.get_allocator());
+  buf.reserve(grown_capacity(c, min_cap));
+  srt::set_union_unique_biased(std::make_move_iterator(c.begin()),
+                               std::make_move_iterator(c.end()), f, l,
+                               std::back_inserter(buf), p, on_equal);
+  c = std::move(buf);
+}
+
+// |built_f| is the lowest constructed position in the raw memory.
+template <typename T>
+void construct_or_assign(T* p, T* raw_from, T** built_f, T&& x) {
+  if (p < raw_from) {
+    *p = std::move(x);
+    return;
+  }
+  ::new (static_cast<void*>(p)) T(std::move(x));
+  *built_f = p;
+}
+
+template <typename T>
+void construct_or_assign(T* p, T* raw_from, T** built_f, const T& x) {
+  if (p < raw_from) {
+    *p = x;
+    return;
+  }
+  ::new (static_cast<void*>(p)) T(x);
+  *built_f = p;
+}
+
+// Output iterator over memory, where everything starting from |raw_from| is
+// not constructed yet. Every position can be written to only once, going
+// backwards: the constructed part of the raw memory is [*built_f, end).
+template <typename T>
+class construct_or_assign_iterator {
+ public:
+  class reference {
+   public:
+    reference(T* p, T* raw_from, T** built_f)
+        : p_{p}, raw_from_{raw_from}, built_f_{built_f} {}
+
+    reference& operator=(T&& x) {
+      construct_or_assign(p_, raw_from_, built_f_, std::move(x));
+      return *this;
+    }
+
+    reference& operator=(const T& x) {
+      construct_or_assign(p_, raw_from_, built_f_, x);
+      return *this;
+    }
+
+   private:
+    T* p_;
+    T* raw_from_;
+    T** built_f_;
+  };
+
+  using difference_type = std::ptrdiff_t;
+  using value_type = T;
+  using pointer = T*;
+  using iterator_category = std::bidirectional_iterator_tag;
+
+  construct_or_assign_iterator() = default;
+  construct_or_assign_iterator(T* p, T* raw_from, T** built_f)
+      : p_{p}, raw_from_{raw_from}, built_f_{built_f} {}
+
+  T* base() const { return p_; }
+
+  reference operator*() const { return {p_, raw_from_, built_f_}; }
+
+  construct_or_assign_iterator& operator++() {
+    ++p_;
+    return *this;
+  }
+  construct_or_assign_iterator operator++(int) {
+    construct_or_assign_iterator tmp = *this;
+    operator++();
+    return tmp;
+  }
+
+  construct_or_assign_iterator& operator--() {
+    --p_;
+    return *this;
+  }
+  construct_or_assign_iterator operator--(int) {
+    construct_or_assign_iterator tmp = *this;
+    operator--();
+    return tmp;
+  }
+
+  friend bool operator==(const construct_or_assign_iterator& x,
+                         const construct_or_assign_iterator& y) {
+    return x.p_ == y.p_;
+  }
+
+  friend bool operator!=(const construct_or_assign_iterator& x,
+                         const construct_or_assign_iterator& y) {
+    return !(x == y);
+  }
+
+ private:
+  T* p_ = nullptr;
+  T* raw_from_ = nullptr;
+  T** built_f_ = nullptr;
+};
+
+template <typename T>
+void destroy(T* f, T* l) {
+  for (; f != l; ++f) f->~T();
+}
+
+// [f, l) becomes raw memory, [o, o + (l - f)) gets the objects.
+// Ranges may overlap.
+template <typename T>
+T* relocate(T* f, T* l, T* o) {
+  static_assert(is_trivially_relocatable<T>::value, "");
+  if (f == l) return o;
+  std::memmove(static_cast<void*>(o), static_cast<const void*>(f),
+               sizeof(T) * static_cast<std::size_t>(l - f));
+  return o + (l - f);
+}
+
+template <typename T>
+void close_merge_gap(T* gap_f, T* gap_l, T* orig_l, T* buf_l, std::true_type) {
+  destroy(gap_f, std::min(gap_l, orig_l));
+  relocate(gap_l, buf_l, gap_f);
+}
+
+template <typename T>
+void close_merge_gap(T* gap_f, T* gap_l, T* orig_l, T* buf_l,
+                     std::false_type) {
+  // Only [orig_l, gap_l) is not constructed.
+  T* new_l = gap_f;
+  for (T* from = gap_l; from != buf_l; ++from, ++new_l) {
+    if (new_l < orig_l || gap_l <= new_l)
+      *new_l = std::move(*from);
+    else
+      ::new (static_cast<void*>(new_l)) T(std::move(*from));
+  }
+  destroy(std::max(gap_l, new_l), buf_l);
+}
+
+template <typename C>
+constexpr bool merge_into_uninitialized_tail() {
+  return UninitializedTailContainer<C>() &&
+         std::is_nothrow_move_constructible<ContainerValueType<C>>::value &&
+         std::is_nothrow_move_assignable<ContainerValueType<C>>::value;
+}
+
+template <typename C, typename I, typename P, typename OnEqual>
+// requires Container<C> && ForwardIterator<I> &&
+// StrictWeakOrdering<P(ValueType<C>)> && UnionPolicy<OnEqual>
+typename std::enable_if<!merge_into_uninitialized_tail<C>(), void>::type
+insert_sorted_unique_into_capacity(C& c, I f, I l, P p,
+                                   ContainerSizeType<C> new_len,
+                                   OnEqual on_equal) {
   auto orig_len = c.size();
 
-  resize_with_junk(c, *f, orig_len + new_len);
+  resize_with_junk(c, c.front(), orig_len + new_len);
 
   Iterator<C> orig_f = c.begin();
   Iterator<C> orig_l = c.begin() + orig_len;
@@ -519,12 +831,86 @@ void insert_sorted_unique_impl(C& c, I f, I l, P p) {
       detail::make_reverse_iterator(c.end()),
       detail::make_reverse_iterator(orig_l),
       detail::make_reverse_iterator(orig_f), detail::make_reverse_iterator(l),
-      detail::make_reverse_iterator(f), inverse_fn(p));
+      detail::make_reverse_iterator(f), inverse_fn(p), on_equal);
 
   c.erase(reverse_remainig_buf_range.second.base(),
           reverse_remainig_buf_range.first.base());
 }
 
+// Same backward merge, but new elements are move constructed straight into
+// the capacity - no junk elements to create, overwrite and destroy.
+template <typename C, typename I, typename P, typename OnEqual>
+// requires UninitializedTailContainer<C> && ForwardIterator<I> &&
+// StrictWeakOrdering<P(ValueType<C>)> && UnionPolicy<OnEqual>
+typename std::enable_if<merge_into_uninitialized_tail<C>(), void>::type
+insert_sorted_unique_into_capacity(C& c, I f, I l, P p,
+                                   ContainerSizeType<C> new_len,
+                                   OnEqual on_equal) {
+  using T = ContainerValueType<C>;
+  T* orig_f = c.data();
+  T* orig_l = orig_f + c.size();
+  T* buf_l = orig_l + new_len;
+
+  // Copying a new element or combining equal ones can throw: the elements
+  // already built past the end are not owned by |c| yet.
+  T* built_f = buf_l;
+  auto merge = [&] {
+    return detail::set_union_into_tail(
+        detail::make_reverse_iterator(
+            construct_or_assign_iterator<T>(buf_l, orig_l, &built_f)),
+        detail::make_reverse_iterator(orig_l),
+        detail::make_reverse_iterator(orig_f),
+        detail::make_reverse_iterator(l), detail::make_reverse_iterator(f),
+        inverse_fn(p), on_equal);
+  };
+  decltype(merge()) res;
+  try {
+    res = merge();
+  } catch (...) {
+    destroy(built_f, buf_l);
+    throw;
+  }
+
+  // Duplicates leave a gap between the untouched prefix and the merged part.
+  // Merged elements are always at least as many as the original ones, so
+  // the result ends after orig_l.
+  T* gap_f = res.second.base();
+  T* gap_l = res.first.base().base();
+  T* new_l = buf_l;
+  if (gap_f != gap_l) {
+    using relocatable =
+        std::integral_constant<bool, is_trivially_relocatable<T>::value>;
+    close_merge_gap(gap_f, gap_l, orig_l, buf_l, relocatable{});
+    new_l = gap_f + (buf_l - gap_l);
+  }
+
+  c.commit_uninitialized(static_cast<ContainerSizeType<C>>(new_l - orig_l));
+}
+
+// OnEqual decides whether an existing element or an equal new one is kept.
+template <typename C, typename I, typename P, typename OnEqual = keep_first>
+// requires Container<C> && ForwardIterator<I> &&
+// StrictWeakOrdering<P(ValueType<C>)> && UnionPolicy<OnEqual>
+void insert_sorted_unique_impl(C& c, I f, I l, P p,
+                               OnEqual on_equal = OnEqual{}) {
+  if (f == l) return;
+  if (c.empty()) {
+    c.insert(c.end(), f, l);
+    return;
+  }
+
+  auto new_len = static_cast<ContainerSizeType<C>>(std::distance(f, l));
+  auto orig_len = c.size();
+
+  if (c.capacity() < orig_len + new_len) {
+    insert_sorted_unique_reallocating(c, f, l, p, orig_len + new_len,
+                                      on_equal);
+    return;
+  }
+
+  insert_sorted_unique_into_capacity(c, f, l, p, new_len, on_equal);
+}
+
 template <typename I, typename O>
 constexpr bool enable_trivial_copy() {
   return std::is_trivially_copy_constructible<ValueType<O>>::value &&
@@ -610,6 +996,47 @@ I rotate_buffered_rhs(I f, I m, I l, srt::ibuffer<I>& buf) {
   return res;
 }
 
+// The smaller side is parked in the buffer's raw memory: objects are never
+// constructed there, so the buffer has nothing to destroy.
+template <typename T>
+T* rotate_relocating_lhs(T* f, T* m, T* l, srt::temporary_buffer<T>& buf) {
+  T* parked = buf.raw_begin();
+  relocate(f, m, parked);
+  T* res = relocate(m, l, f);
+  relocate(parked, parked + (m - f), res);
+  return res;
+}
+
+template <typename T>
+T* rotate_relocating_rhs(T* f, T* m, T* l, srt::temporary_buffer<T>& buf) {
+  T* parked = buf.raw_begin();
+  relocate(m, l, parked);
+  T* res = l - (m - f);
+  relocate(f, m, res);
+  relocate(parked, parked + (l - m), f);
+  return res;
+}
+
+template <typename I>
+constexpr bool enable_rotate_relocating() {
+  return std::is_pointer<I>::value &&
+         is_trivially_relocatable<ValueType<I>>::value;
+}
+
+template <typename I>
+typename std::enable_if<!enable_rotate_relocating<I>(), I>::type
+do_rotate_buffered(I f, I m, I l, srt::ibuffer<I>& buf, bool lhs) {
+  return lhs ? rotate_buffered_lhs(f, m, l, buf)
+             : rotate_buffered_rhs(f, m, l, buf);
+}
+
+template <typename I>
+typename std::enable_if<enable_rotate_relocating<I>(), I>::type
+do_rotate_buffered(I f, I m, I l, srt::ibuffer<I>& buf, bool lhs) {
+  return lhs ? rotate_relocating_lhs(f, m, l, buf)
+             : rotate_relocating_rhs(f, m, l, buf);
+}
+
 template <typename N>
 typename std::enable_if<std::is_integral<N>::value, N>::type  //
 half_positive(N n) {
@@ -623,66 +1050,237 @@ half_positive(N n) {
   return n / 2;
 }
 
+inline std::size_t log2_ceil(std::size_t n) {
+  std::size_t res = 0;
+  while ((std::size_t(1) << res) < n) ++res;
+  return res;
+}
+
+// Cost model for flat_set::insert(f, l).
+// Everything is measured in "merge steps": one comparison + one move in
+// set_union. Constants were tuned with
+// flat_sets_benchmarks/insert_f_l_strategies_bench.cc.
+
+enum class insert_f_l_strategy { by_one, merge, rebuild };
+
+constexpr std::size_t kAllocationCost = 32;
+
+// Shifting the tail on insert is a memmove for trivially copyable types -
+// much cheaper than a merge step.
+template <typename T>
+constexpr std::size_t shifts_per_merge_step() {
+  return std::is_trivially_copyable<T>::value ? 16 : 1;
+}
+
+template <typename T>
+insert_f_l_strategy choose_insert_f_l_strategy(std::size_t size,
+                                               std::size_t n, bool is_sorted) {
+  const std::size_t sort_cost = is_sorted ? 0 : n * log2_ceil(n);
+  const std::size_t buf_cost = is_sorted ? 0 : kAllocationCost + n;
+
+  // On average the set has size + n / 2 elements while we insert and we shift
+  // half of them.
+  const std::size_t avg_size = size + n / 2;
+  const std::size_t by_one =
+      n * (log2_ceil(avg_size) + avg_size / 2 / shifts_per_merge_step<T>());
+  const std::size_t merge = buf_cost + sort_cost + size + n;
+  // Sort the appended tail and merge it in place by rotations + unique.
+  const std::size_t rebuild =
+      sort_cost + (size + n) * (log2_ceil(size + 1) + 1);
+
+  if (by_one <= merge && by_one <= rebuild) return insert_f_l_strategy::by_one;
+  if (rebuild < merge) return insert_f_l_strategy::rebuild;
+  return insert_f_l_strategy::merge;
+}
+
 }  // namespace detail
 
+// scratch_arena --------------------------------------------------------------
+
+// Per thread, growable memory for temporary buffers.
+// Allocations are expected to be released in LIFO order (temporary buffers are
+// scoped). The arena remembers the biggest amount of memory that was requested
+// at once (high water mark) and grows to it the next time it is idle, so in
+// the steady state nothing is allocated.
+// Requests that do not fit (nested allocations while the arena has to grow,
+// or allocations above the cap) are served by operator new.
+
+class scratch_arena {
+ public:
+  static constexpr std::size_t kAlignment = alignof(std::max_align_t);
+
+  scratch_arena() = default;
+  scratch_arena(const scratch_arena&) = delete;
+  scratch_arena& operator=(const scratch_arena&) = delete;
+
+  ~scratch_arena() { ::operator delete(block_); }
+
+  static scratch_arena& this_thread() {
+    static thread_local scratch_arena arena;
+    return arena;
+  }
+
+  // Returns nullptr if there is no memory.
+  void* allocate(std::size_t bytes) {
+    if (!bytes) return nullptr;
+    bytes = round_up(bytes);
+    ++live_;
+    high_water_mark_ = std::max(high_water_mark_, used_ + bytes);
+
+    if (!used_ && capacity_ < std::min(high_water_mark_, cap_)) grow();
+
+    if (used_ + bytes <= capacity_) {
+      void* res = block_ + used_;
+      used_ += bytes;
+      return res;
+    }
+
+    void* res = ::operator new(bytes, std::nothrow);
+    if (!res) --live_;
+    return res;
+  }
+
+  void deallocate(void* p, std::size_t bytes) {
+    if (!p) return;
+    --live_;
+
+    char* ptr = static_cast<char*>(p);
+    if (!owns(ptr)) {
+      ::operator delete(p);
+      return;
+    }
+
+    if (ptr + round_up(bytes) == block_ + used_) used_ = ptr - block_;
+    if (!live_) used_ = 0;
+  }
+
+  std::size_t capacity() const { return capacity_; }
+  std::size_t used() const { return used_; }
+  std::size_t high_water_mark() const { return high_water_mark_; }
+
+  std::size_t cap() const { return cap_; }
+  void set_cap(std::size_t cap) {
+    cap_ = cap;
+    high_water_mark_ = std::min(high_water_mark_, cap_);
+    if (capacity_ > cap_) shrink_to_fit();
+  }
+
+  // Releases the memory, if it's not in use.
+  void shrink_to_fit() {
+    if (used_) return;
+    ::operator delete(block_);
+    block_ = nullptr;
+    capacity_ = 0;
+    high_water_mark_ = 0;
+  }
+
+ private:
+  static std::size_t round_up(std::size_t bytes) {
+    return (bytes + kAlignment - 1) / kAlignment * kAlignment;
+  }
+
+  // |ptr| can come from operator new: raw < between unrelated pointers is
+  // unspecified, std::less gives a total order.
+  bool owns(const char* ptr) const {
+    std::less<const char*> less;
+    return !less(ptr, block_) && less(ptr, block_ + capacity_);
+  }
+
+  void grow() {
+    std::size_t new_capacity =
+        std::min(cap_, std::max(high_water_mark_, capacity_ + capacity_));
+    void* new_block = ::operator new(new_capacity, std::nothrow);
+    if (!new_block) return;
+    ::operator delete(block_);
+    block_ = static_cast<char*>(new_block);
+    capacity_ = new_capacity;
+  }
+
+  char* block_ = nullptr;
+  std::size_t capacity_ = 0;
+  std::size_t used_ = 0;
+  std::size_t live_ = 0;
+  std::size_t high_water_mark_ = 0;
+  std::size_t cap_ = std::numeric_limits<std::size_t>::max();
+};
+
 // temporary_buffer -----------------------------------------------------------
 
 template <typename T>
 class temporary_buffer {
+  static_assert(alignof(T) <= scratch_arena::kAlignment,
+                "over aligned types are not supported");
+
  public:
   temporary_buffer(std::ptrdiff_t count) {
-    std::tie(buffer_, count_) = std::get_temporary_buffer<T>(count);
+    count = std::max(count, std::ptrdiff_t(0));
+    buffer_ = static_cast<T*>(
+        scratch_arena::this_thread().allocate(sizeof(T) * count));
     end_ = buffer_;
+    buffer_end_ = buffer_ ? buffer_ + count : buffer_;
   }
 
   temporary_buffer(temporary_buffer&& x) = delete;
   temporary_buffer& operator=(temporary_buffer&& x) = delete;
 
-  std::ptrdiff_t capacity() const { return count_; }
+  std::ptrdiff_t capacity() const { return buffer_end_ - end_; }
+
+  // Memory for capacity() objects that the buffer does not own: whatever is
+  // relocated there has to be relocated out before the buffer is destroyed.
+  T* raw_begin() { return end_; }
 
   template <typename I>
   std::tuple<I, T*, T*> copy(I f, I l) {
-    static_assert(RandomAccessIterator<I>(), "");
+    static_assert(ForwardIterator<I>(), "");
     T* res_begin = end_;
-    if (std::distance(f, l) > count_) {
-      l = std::next(f, count_);
+    if (std::distance(f, l) > capacity()) {
+      l = std::next(f, capacity());
     }
     T* res_end = srt::uninitialized_copy(f, l, res_begin);
-    count_ -= res_begin - res_end;
     end_ = res_end;
     return std::make_tuple(l, res_begin, res_end);
   }
 
   void clear() {
-    count_ += end_ - buffer_;
     while (buffer_ != end_) {
-      end_->~T();
       --end_;
+      end_->~T();
     }
   }
 
   ~temporary_buffer() {
     clear();
-    std::return_temporary_buffer(buffer_);
+    scratch_arena::this_thread().deallocate(
+        buffer_, sizeof(T) * static_cast<std::size_t>(buffer_end_ - buffer_));
   }
 
  private:
   T* buffer_;
   T* end_;
-  std::ptrdiff_t count_;
+  T* buffer_end_;
 };
 
 // functors -------------------------------------------------------------------
 
 struct less {
   template <typename X, typename Y>
-  bool operator()(const X& x, const Y& y) noexcept(noexcept(x < y)) {
+  constexpr bool operator()(const X& x, const Y& y) const
+      noexcept(noexcept(x < y)) {
     return x < y;
   }
 
   using is_transparent = int;
 };
 
+struct identity {
+  template <typename T>
+  constexpr T&& operator()(T&& x) const noexcept {
+    return std::forward<T>(x);
+  }
+
+  using is_transparent = int;
+};
+
 template <typename F>
 // requires Predicate<F>
 detail::not_fn_t<F> not_fn(F f) noexcept {
@@ -767,8 +1365,10 @@ O set_union_unique_linear(I1 f1, I1 l1, I2 f2, I2 l2, O o) {
 }
 
 // clang-format off
-template <typename I1, typename I2, typename O, typename Compare>
-O set_union_unique_biased(I1 f1, I1 l1, I2 f2, I2 l2, O o, Compare comp) {
+template <typename I1, typename I2, typename O, typename Compare,
+          typename OnEqual>
+O set_union_unique_biased(I1 f1, I1 l1, I2 f2, I2 l2, O o, Compare comp,
+                          OnEqual on_equal) {
   if (f1 == l1) goto copySecond;
   if (f2 == l2) goto copyFirst;
 
@@ -779,7 +1379,14 @@ O set_union_unique_biased(I1 f1, I1 l1, I2 f2, I2 l2, O o, Compare comp) {
 
    checkSecond:
     if (comp(*f2, *f1)) *o++ = *f2;
+    else if (!detail::keeps_first<OnEqual>()) goto replaceFirst;
     ++f2; if (f2 == l2) goto copyFirst;
+    goto biased;
+
+   replaceFirst:
+    *o++ = detail::equal_result(on_equal, f1, f2); ++f1; ++f2;
+    if (f1 == l1) goto copySecond;
+    if (f2 == l2) goto copyFirst;
 
    biased:
     if (!comp(*f1, *f2)) goto checkSecond;
@@ -804,11 +1411,24 @@ O set_union_unique_biased(I1 f1, I1 l1, I2 f2, I2 l2, O o, Compare comp) {
 }
 // clang-format on
 
+template <typename I1, typename I2, typename O, typename Compare>
+O set_union_unique_biased(I1 f1, I1 l1, I2 f2, I2 l2, O o, Compare comp) {
+  return set_union_unique_biased(f1, l1, f2, l2, o, comp, keep_first{});
+}
+
 template <typename I1, typename I2, typename O>
 O set_union_unique_biased(I1 f1, I1 l1, I2 f2, I2 l2, O o) {
   return set_union_unique_biased(f1, l1, f2, l2, o, less{});
 }
 
+// Equal elements are written once, as combine(*f1, *f2).
+template <typename I1, typename I2, typename O, typename Compare,
+          typename Combine>
+O set_union_combine(I1 f1, I1 l1, I2 f2, I2 l2, O o, Compare comp,
+                    Combine combine) {
+  return set_union_unique_biased(f1, l1, f2, l2, o, comp, combine);
+}
+
 template <typename I, typename O, typename P>
 O copy_until_adjacent_check(I f, I l, O o, P p) {
   return detail::do_copy_until_adjacent_check(f, l, o, p,
@@ -871,64 +1491,178 @@ I partition_point_hinted(I f, I hint, I l, P p) {
 }
 
 template <typename I, typename V, typename Compare>
-I lower_bound_biased(I f, I l, V v, Compare comp) {
+I lower_bound_biased(I f, I l, const V& v, Compare comp) {
   return partition_point_biased(f, l,
                                 [&](Reference<I> x) { return comp(x, v); });
 }
 
 template <typename I, typename V>
-I lower_bound_biased(I f, I l, V v) {
+I lower_bound_biased(I f, I l, const V& v) {
   return lower_bound_biased(f, l, v, less{});
 }
 
 template <typename I, typename V, typename Compare>
-I lower_bound_hinted(I f, I hint, I l, V v, Compare comp) {
+I lower_bound_hinted(I f, I hint, I l, const V& v, Compare comp) {
   return partition_point_hinted(f, hint, l,
                                 [&](Reference<I> x) { return comp(x, v); });
 }
 
 template <typename I, typename V>
-I lower_bound_hinted(I f, I hint, I l, V v) {
+I lower_bound_hinted(I f, I hint, I l, const V& v) {
   return lower_bound_hinted(f, hint, l, v, less{});
 }
 
-template <typename I>
-I rotate_buffered(I f, I m, I l, ibuffer<I>& buf) {
-  srt::DifferenceType<I> lhs_size = std::distance(f, m);
-  srt::DifferenceType<I> rhs_size = std::distance(m, l);
-
-  if (lhs_size <= rhs_size) {
-    if (buf.capacity() >= lhs_size) {
-      return detail::rotate_buffered_lhs(f, m, l, buf);
-    }
-  } else {
-    if (buf.capacity() >= rhs_size) {
-      return detail::rotate_buffered_rhs(f, m, l, buf);
-    }
-  }
-
-  return std::rotate(f, m, l);
+// Counts elements less than v instead of searching for the first one:
+// no branches to mispredict and arithmetic types get vectorized.
+// Only makes sense for very small ranges.
+template <typename I, typename V, typename Compare>
+I lower_bound_linear(I f, I l, const V& v, Compare comp) {
+  DifferenceType<I> n = 0;
+  for (I it = f; it != l; ++it) n += comp(*it, v) ? 1 : 0;
+  return std::next(f, n);
 }
 
-template <typename I>
-I rotate_buffered(I f, I m, I l) {
-  srt::ibuffer<I> buf(std::min(std::distance(f, m), std::distance(m, l)));
-  return rotate_buffered(f, m, l, buf);
+template <typename I, typename V>
+I lower_bound_linear(I f, I l, const V& v) {
+  return lower_bound_linear(f, l, v, less{});
 }
 
-template <typename I, typename Compare>
-void inplace_merge_rotating_middles(I f, I m, I l, Compare comp) {
-  if (f == m || m == l) return;
-  I left_m = middle(f, m);
-  I right_m = std::lower_bound(m, l, *left_m);
-  m = std::rotate(left_m, m, right_m);
+namespace detail {
 
-  if (f == left_m) return;  // middle of one element is always that element.
-  inplace_merge_rotating_middles(m, right_m, l, comp);
-  inplace_merge_rotating_middles(f, left_m, m, comp);
+// Galloping touches far away elements on every step, so it only pays off
+// when the searched range is this many times larger than the walked one.
+constexpr std::ptrdiff_t kMergeJoinGallopRatio = 10;
+
+template <typename I1, typename I2>
+bool merge_join_should_gallop(I1 walked_f, I1 walked_l, I2 f, I2 l) {
+  return std::distance(walked_f, walked_l) * kMergeJoinGallopRatio <=
+         std::distance(f, l);
 }
 
-template <typename I>
+template <typename I, typename V, typename Compare>
+I merge_join_lower_bound(I f, I l, const V& v, Compare& comp, bool gallop) {
+  if (gallop) return lower_bound_biased(f, l, v, comp);
+  while (f != l && comp(*f, v)) ++f;
+  return f;
+}
+
+template <typename I1, typename I2, typename Compare, typename Callback>
+void merge_join_linear(I1 f1, I1 l1, I2 f2, I2 l2, Compare& comp,
+                       Callback& callback) {
+  while (f1 != l1 && f2 != l2) {
+    if (comp(*f1, *f2)) {
+      ++f1;
+    } else if (comp(*f2, *f1)) {
+      ++f2;
+    } else {
+      callback(*f1, *f2);
+      ++f1;
+      ++f2;
+    }
+  }
+}
+
+}  // namespace detail
+
+// Joins of two sorted ranges with unique keys. |comp| compares elements of
+// the two ranges in both orders. When the other range is much larger, the
+// next match is found by galloping, so stretches without matches are skipped
+// in logarithmic time.
+
+// Calls callback(x, y) for every pair of elements with equivalent keys.
+// For very different sizes walks the smaller range and gallops through the
+// larger one: O(m log(n / m)) instead of O(n + m).
+template <typename I1, typename I2, typename Compare, typename Callback>
+Callback merge_join(I1 f1, I1 l1, I2 f2, I2 l2, Compare comp,
+                    Callback callback) {
+  if (detail::merge_join_should_gallop(f1, l1, f2, l2)) {
+    for (; f1 != l1 && f2 != l2; ++f1) {
+      f2 = lower_bound_biased(f2, l2, *f1, comp);
+      if (f2 == l2 || comp(*f1, *f2)) continue;
+      callback(*f1, *f2);
+      ++f2;
+    }
+  } else if (detail::merge_join_should_gallop(f2, l2, f1, l1)) {
+    for (; f2 != l2 && f1 != l1; ++f2) {
+      f1 = lower_bound_biased(f1, l1, *f2, comp);
+      if (f1 == l1 || comp(*f2, *f1)) continue;
+      callback(*f1, *f2);
+      ++f1;
+    }
+  } else {
+    detail::merge_join_linear(f1, l1, f2, l2, comp, callback);
+  }
+  return callback;
+}
+
+// Left outer join: calls callback(x, p) for every x from [f1, l1), where p
+// points to the element with an equivalent key in [f2, l2) or is nullptr.
+template <typename I1, typename I2, typename Compare, typename Callback>
+Callback merge_join_left(I1 f1, I1 l1, I2 f2, I2 l2, Compare comp,
+                         Callback callback) {
+  using pointer = typename std::remove_reference<Reference<I2>>::type*;
+  const bool gallop = detail::merge_join_should_gallop(f1, l1, f2, l2);
+  for (; f1 != l1; ++f1) {
+    f2 = detail::merge_join_lower_bound(f2, l2, *f1, comp, gallop);
+    if (f2 == l2 || comp(*f1, *f2))
+      callback(*f1, pointer{nullptr});
+    else
+      callback(*f1, std::addressof(*f2));
+  }
+  return callback;
+}
+
+// Anti join: calls callback(x) for every x from [f1, l1) without an
+// equivalent key in [f2, l2).
+template <typename I1, typename I2, typename Compare, typename Callback>
+Callback merge_join_anti(I1 f1, I1 l1, I2 f2, I2 l2, Compare comp,
+                         Callback callback) {
+  const bool gallop = detail::merge_join_should_gallop(f1, l1, f2, l2);
+  for (; f1 != l1 && f2 != l2; ++f1) {
+    f2 = detail::merge_join_lower_bound(f2, l2, *f1, comp, gallop);
+    if (f2 == l2 || comp(*f1, *f2)) callback(*f1);
+  }
+  for (; f1 != l1; ++f1) callback(*f1);
+  return callback;
+}
+
+template <typename I>
+I rotate_buffered(I f, I m, I l, ibuffer<I>& buf) {
+  srt::DifferenceType<I> lhs_size = std::distance(f, m);
+  srt::DifferenceType<I> rhs_size = std::distance(m, l);
+
+  if (lhs_size <= rhs_size) {
+    if (buf.capacity() >= lhs_size) {
+      return detail::do_rotate_buffered(f, m, l, buf, true);
+    }
+  } else {
+    if (buf.capacity() >= rhs_size) {
+      return detail::do_rotate_buffered(f, m, l, buf, false);
+    }
+  }
+
+  return std::rotate(f, m, l);
+}
+
+template <typename I>
+I rotate_buffered(I f, I m, I l) {
+  srt::ibuffer<I> buf(std::min(std::distance(f, m), std::distance(m, l)));
+  return rotate_buffered(f, m, l, buf);
+}
+
+template <typename I, typename Compare>
+void inplace_merge_rotating_middles(I f, I m, I l, Compare comp) {
+  if (f == m || m == l) return;
+  I left_m = middle(f, m);
+  I right_m = std::lower_bound(m, l, *left_m, comp);
+  m = std::rotate(left_m, m, right_m);
+
+  if (f == left_m) return;  // middle of one element is always that element.
+  inplace_merge_rotating_middles(m, right_m, l, comp);
+  inplace_merge_rotating_middles(f, left_m, m, comp);
+}
+
+template <typename I>
 void inplace_merge_rotating_middles(I f, I m, I l) {
   inplace_merge_rotating_middles(f, m, l, less{});
 }
@@ -938,7 +1672,7 @@ void inplace_merge_rotating_middles_buffered(I f, I m, I l, Compare comp,
                                              srt::ibuffer<I>& buf) {
   if (f == m || m == l) return;
   I left_m = srt::middle(f, m);
-  I right_m = std::lower_bound(m, l, *left_m);
+  I right_m = std::lower_bound(m, l, *left_m, comp);
   m = srt::rotate_buffered(left_m, m, right_m, buf);
   buf.clear();
 
@@ -964,173 +1698,4722 @@ void inplace_merge_rotating_middles_buffered(I f, I m, I l) {
   inplace_merge_rotating_middles_buffered(f, m, l, less{});
 }
 
-template <typename C, typename T>
-void resize_with_junk(C& c, T&& sample, ContainerSizeType<C> new_len) {
-  detail::do_resize_with_junk(c, sample, new_len);
-}
+template <typename C, typename T>
+void resize_with_junk(C& c, T&& sample, ContainerSizeType<C> new_len) {
+  detail::do_resize_with_junk(c, sample, new_len);
+}
+
+// small_vector ---------------------------------------------------------------
+
+namespace detail {
+
+template <typename T, std::size_t N>
+struct inline_storage {
+  T* inline_begin() { return reinterpret_cast<T*>(&data_); }
+  const T* inline_begin() const { return reinterpret_cast<const T*>(&data_); }
+
+  typename std::aligned_storage<sizeof(T) * N, alignof(T)>::type data_;
+};
+
+template <typename T>
+struct inline_storage<T, 0> {
+  T* inline_begin() const { return nullptr; }
+};
+
+}  // namespace detail
+
+// Minimal vector that keeps up to N elements inside the object and goes to
+// the heap after that.
+// Gives access to the memory past the end: elements can be constructed at
+// data() + size() and then committed with commit_uninitialized(n). flat_set
+// merges new elements directly into the capacity instead of resizing with
+// junk first.
+// Shifts and reallocations of trivially relocatable types are memmoves.
+template <typename T, std::size_t N, typename Allocator = std::allocator<T>>
+class small_vector : detail::inline_storage<T, N> {
+  using alloc_traits = std::allocator_traits<Allocator>;
+  using relocatable =
+      std::integral_constant<bool, is_trivially_relocatable<T>::value>;
+  using detail::inline_storage<T, N>::inline_begin;
+
+ public:
+  using value_type = T;
+  using allocator_type = Allocator;
+  using size_type = std::size_t;
+  using difference_type = std::ptrdiff_t;
+  using reference = T&;
+  using const_reference = const T&;
+  using pointer = T*;
+  using const_pointer = const T*;
+  using iterator = T*;
+  using const_iterator = const T*;
+  using reverse_iterator = std::reverse_iterator<iterator>;
+  using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
+  static constexpr size_type inline_capacity() { return N; }
+
+  small_vector() : small_vector(Allocator()) {}
+  explicit small_vector(const Allocator& alloc)
+      : alloc_{alloc},
+        f_{inline_begin()},
+        l_{inline_begin()},
+        buf_l_{inline_begin() + N} {}
+
+  template <typename I, typename = typename std::enable_if<
+                            !std::is_integral<I>::value>::type>
+  // requires InputIterator<I>
+  small_vector(I f, I l, const Allocator& alloc = Allocator())
+      : small_vector(alloc) {
+    insert(end(), f, l);
+  }
+
+  small_vector(std::initializer_list<T> il,
+               const Allocator& alloc = Allocator())
+      : small_vector(il.begin(), il.end(), alloc) {}
+
+  small_vector(const small_vector& x)
+      : small_vector(x.begin(), x.end(),
+                     alloc_traits::select_on_container_copy_construction(
+                         x.alloc_)) {}
+
+  small_vector(small_vector&& x) noexcept(
+      N == 0 || std::is_nothrow_move_constructible<T>::value)
+      : small_vector(x.alloc_) {
+    take(x);
+  }
+
+  small_vector& operator=(const small_vector& x) {
+    if (this != &x) assign(x.begin(), x.end());
+    return *this;
+  }
+
+  small_vector& operator=(small_vector&& x) noexcept(
+      N == 0 || std::is_nothrow_move_constructible<T>::value) {
+    if (this == &x) return *this;
+    clear();
+    if (!x.is_inline()) {
+      deallocate();
+      f_ = l_ = inline_begin();
+      buf_l_ = inline_begin() + N;
+    }
+    alloc_ = std::move(x.alloc_);
+    take(x);
+    return *this;
+  }
+
+  small_vector& operator=(std::initializer_list<T> il) {
+    assign(il.begin(), il.end());
+    return *this;
+  }
+
+  ~small_vector() { deallocate(); }
+
+  template <typename I>
+  // requires InputIterator<I>
+  void assign(I f, I l) {
+    clear();
+    insert(end(), f, l);
+  }
+
+  allocator_type get_allocator() const { return alloc_; }
+
+  iterator begin() { return f_; }
+  const_iterator begin() const { return f_; }
+  const_iterator cbegin() const { return f_; }
+  iterator end() { return l_; }
+  const_iterator end() const { return l_; }
+  const_iterator cend() const { return l_; }
+
+  reverse_iterator rbegin() { return reverse_iterator(end()); }
+  const_reverse_iterator rbegin() const {
+    return const_reverse_iterator(end());
+  }
+  const_reverse_iterator crbegin() const { return rbegin(); }
+  reverse_iterator rend() { return reverse_iterator(begin()); }
+  const_reverse_iterator rend() const {
+    return const_reverse_iterator(begin());
+  }
+  const_reverse_iterator crend() const { return rend(); }
+
+  bool empty() const { return f_ == l_; }
+  size_type size() const { return static_cast<size_type>(l_ - f_); }
+  size_type capacity() const { return static_cast<size_type>(buf_l_ - f_); }
+  size_type max_size() const { return alloc_traits::max_size(alloc_); }
+
+  // Elements are stored inside the object.
+  bool is_inline() const { return f_ == inline_begin(); }
+
+  T* data() { return f_; }
+  const T* data() const { return f_; }
+  T& operator[](size_type i) { return f_[i]; }
+  const T& operator[](size_type i) const { return f_[i]; }
+  T& front() { return *f_; }
+  const T& front() const { return *f_; }
+  T& back() { return *(l_ - 1); }
+  const T& back() const { return *(l_ - 1); }
+
+  void reserve(size_type n) {
+    if (n > capacity()) reallocate(n);
+  }
+
+  void shrink_to_fit() {
+    if (is_inline() || size() == capacity()) return;
+    reallocate(size());
+  }
+
+  // requires: n elements are constructed at data() + size().
+  void commit_uninitialized(size_type n) {
+    assert(n <= capacity() - size());
+    l_ += n;
+  }
+
+  void clear() { erase(begin(), end()); }
+
+  void resize(size_type n) {
+    if (n <= size()) {
+      erase(begin() + n, end());
+      return;
+    }
+    reserve(n);
+    while (size() < n) emplace_back();
+  }
+
+  template <typename... Args>
+  void emplace_back(Args&&... args) {
+    if (l_ == buf_l_) {
+      grow_emplace_back(std::forward<Args>(args)...);
+      return;
+    }
+    alloc_traits::construct(alloc_, l_, std::forward<Args>(args)...);
+    ++l_;
+  }
+
+  void push_back(const T& x) { emplace_back(x); }
+  void push_back(T&& x) { emplace_back(std::move(x)); }
+
+  void pop_back() {
+    --l_;
+    alloc_traits::destroy(alloc_, l_);
+  }
+
+  iterator insert(const_iterator pos, const T& x) { return emplace(pos, x); }
+
+  iterator insert(const_iterator pos, T&& x) {
+    return emplace(pos, std::move(x));
+  }
+
+  template <typename... Args>
+  iterator emplace(const_iterator pos, Args&&... args) {
+    auto offset = pos - cbegin();
+    emplace_back(std::forward<Args>(args)...);
+    shift_back_to(begin() + offset, relocatable{});
+    return begin() + offset;
+  }
+
+  template <typename I, typename = typename std::enable_if<
+                            !std::is_integral<I>::value>::type>
+  // requires InputIterator<I>
+  iterator insert(const_iterator pos, I f, I l) {
+    auto offset = pos - cbegin();
+    auto orig_len = size();
+    for (; f != l; ++f) emplace_back(*f);
+    std::rotate(begin() + offset, begin() + orig_len, end());
+    return begin() + offset;
+  }
+
+  iterator insert(const_iterator pos, std::initializer_list<T> il) {
+    return insert(pos, il.begin(), il.end());
+  }
+
+  iterator erase(const_iterator pos) { return erase(pos, pos + 1); }
+
+  iterator erase(const_iterator cf, const_iterator cl) {
+    iterator f = begin() + (cf - cbegin());
+    iterator l = begin() + (cl - cbegin());
+    erase_impl(f, l, relocatable{});
+    return f;
+  }
+
+  void swap(small_vector& x) noexcept(
+      N == 0 || std::is_nothrow_move_constructible<T>::value) {
+    small_vector tmp(std::move(x));
+    x = std::move(*this);
+    *this = std::move(tmp);
+  }
+
+  friend void swap(small_vector& x, small_vector& y) noexcept(
+      N == 0 || std::is_nothrow_move_constructible<T>::value) {
+    x.swap(y);
+  }
+
+  friend bool operator==(const small_vector& x, const small_vector& y) {
+    return x.size() == y.size() && std::equal(x.begin(), x.end(), y.begin());
+  }
+
+  friend bool operator!=(const small_vector& x, const small_vector& y) {
+    return !(x == y);
+  }
+
+  friend bool operator<(const small_vector& x, const small_vector& y) {
+    return std::lexicographical_compare(x.begin(), x.end(), y.begin(),
+                                        y.end());
+  }
+
+ private:
+  // requires: empty() && capacity() >= x.size() if x.is_inline().
+  // Leaves |x| empty.
+  void take(small_vector& x) {
+    if (x.is_inline()) {
+      l_ = x.move_to(l_, relocatable{});
+      x.clear();
+      return;
+    }
+    f_ = x.f_;
+    l_ = x.l_;
+    buf_l_ = x.buf_l_;
+    x.f_ = x.l_ = x.inline_begin();
+    x.buf_l_ = x.inline_begin() + N;
+  }
+
+  void reallocate(size_type n) {
+    T* new_f = n <= N ? inline_begin() : alloc_traits::allocate(alloc_, n);
+    T* new_l = new_f;
+    try {
+      new_l = move_to(new_f, relocatable{});
+    } catch (...) {
+      if (new_f != inline_begin()) alloc_traits::deallocate(alloc_, new_f, n);
+      throw;
+    }
+    adopt(new_f, new_l, new_f + std::max(n, N));
+  }
+
+  // The new element is constructed before the old ones are moved out:
+  // |args| can refer to them (v.push_back(v.front())).
+  template <typename... Args>
+  void grow_emplace_back(Args&&... args) {
+    const size_type n = std::max(size_type(1), 2 * capacity());
+    T* new_f = alloc_traits::allocate(alloc_, n);
+    T* new_back = new_f + size();
+    T* new_l = new_f;
+    try {
+      alloc_traits::construct(alloc_, new_back, std::forward<Args>(args)...);
+    } catch (...) {
+      alloc_traits::deallocate(alloc_, new_f, n);
+      throw;
+    }
+    try {
+      new_l = move_to(new_f, relocatable{});
+    } catch (...) {
+      alloc_traits::destroy(alloc_, new_back);
+      alloc_traits::deallocate(alloc_, new_f, n);
+      throw;
+    }
+    adopt(new_f, new_l + 1, new_f + n);
+  }
+
+  // Frees the current memory and takes [new_f, new_buf_l).
+  void adopt(T* new_f, T* new_l, T* new_buf_l) {
+    deallocate();
+    f_ = new_f;
+    l_ = new_l;
+    buf_l_ = new_buf_l;
+  }
+
+  void deallocate() {
+    while (l_ != f_) pop_back();
+    if (!is_inline()) alloc_traits::deallocate(alloc_, f_, capacity());
+  }
+
+  // Elements are left for deallocate() to destroy. If a copy throws, the
+  // ones already built at |o| are destroyed.
+  T* move_to(T* o, std::false_type) {
+    T* new_f = o;
+    try {
+      for (T* it = f_; it != l_; ++it, ++o)
+        alloc_traits::construct(alloc_, o, std::move_if_noexcept(*it));
+    } catch (...) {
+      for (; new_f != o; ++new_f) alloc_traits::destroy(alloc_, new_f);
+      throw;
+    }
+    return o;
+  }
+
+  // Nothing is left to destroy.
+  T* move_to(T* o, std::true_type) {
+    T* res = detail::relocate(f_, l_, o);
+    l_ = f_;
+    return res;
+  }
+
+  // Moves the last element to pos.
+  void shift_back_to(T* pos, std::false_type) {
+    std::rotate(pos, l_ - 1, l_);
+  }
+
+  void shift_back_to(T* pos, std::true_type) {
+    typename std::aligned_storage<sizeof(T), alignof(T)>::type last;
+    T* tmp = reinterpret_cast<T*>(&last);
+    detail::relocate(l_ - 1, l_, tmp);
+    detail::relocate(pos, l_ - 1, pos + 1);
+    detail::relocate(tmp, tmp + 1, pos);
+  }
+
+  void erase_impl(T* f, T* l, std::false_type) {
+    T* new_l = std::move(l, l_, f);
+    while (l_ != new_l) pop_back();
+  }
+
+  void erase_impl(T* f, T* l, std::true_type) {
+    detail::destroy(f, l);
+    l_ = detail::relocate(l, l_, f);
+  }
+
+  Allocator alloc_;
+  T* f_;
+  T* l_;
+  T* buf_l_;
+};
+
+// small_vector without inline storage.
+template <typename T, typename Allocator = std::allocator<T>>
+using raw_vector = small_vector<T, 0, Allocator>;
+
+namespace detail {
+
+// Growing past the inline storage is a bug.
+template <typename T>
+struct no_heap_allocator {
+  using value_type = T;
+
+  no_heap_allocator() = default;
+  template <typename U>
+  no_heap_allocator(const no_heap_allocator<U>&) {}
+
+  T* allocate(std::size_t) { std::terminate(); }
+  void deallocate(T*, std::size_t) {}
+
+  friend bool operator==(no_heap_allocator, no_heap_allocator) { return true; }
+  friend bool operator!=(no_heap_allocator, no_heap_allocator) {
+    return false;
+  }
+};
+
+}  // namespace detail
+
+// small_vector that never allocates: going over N terminates.
+template <typename T, std::size_t N>
+using static_vector = small_vector<T, N, detail::no_heap_allocator<T>>;
+
+// flat_set -------------------------------------------------------------------
+
+namespace detail {
+
+template <typename Value, typename KeyOf>
+using projected_key = typename std::decay<decltype(
+    std::declval<const KeyOf&>()(std::declval<const Value&>()))>::type;
+
+// Compares elements by the keys KeyOf projects out of them. Either side, or
+// both, can also be a bare key.
+template <typename Value, typename Compare, typename KeyOf>
+struct projected_compare : Compare {
+  using key_type = projected_key<Value, KeyOf>;
+
+  projected_compare() = default;
+  projected_compare(const Compare& comp, const KeyOf& key_of = KeyOf())
+      : Compare(comp), key_of(key_of) {}
+
+  const Compare& key_comp() const { return *this; }
+
+  bool operator()(const Value& x, const Value& y) const {
+    return key_comp()(key_of(x), key_of(y));
+  }
+
+  bool operator()(const key_type& x, const key_type& y) const {
+    return key_comp()(x, y);
+  }
+
+  template <typename K>
+  bool operator()(const Value& x, const K& y) const {
+    return key_comp()(key_of(x), y);
+  }
+
+  template <typename K>
+  bool operator()(const K& x, const Value& y) const {
+    return key_comp()(x, key_of(y));
+  }
+
+  using is_transparent = int;
+
+  KeyOf key_of;
+};
+
+// Key of an apply_delta entry.
+struct delta_key {
+  template <typename P>
+  auto operator()(const P& p) const -> decltype((p.first)) {
+    return p.first;
+  }
+};
+
+// Erases from |c| the elements whose keys are in the sorted range [f, l),
+// projected by |proj|. Each position is found by galloping from the previous
+// one and the survivors are compacted in one forward pass. Returns the number
+// of erased elements.
+template <typename C, typename I, typename P, typename Proj>
+// requires Container<C> && InputIterator<I> &&
+// StrictWeakOrdering<P(ValueType<C>)>
+typename C::size_type erase_sorted_impl(C& c, I f, I l, P p, Proj proj) {
+  auto out = c.begin();
+  auto in = c.begin();
+  auto cur = c.begin();
+  for (; f != l && cur != c.end(); ++f) {
+    cur = lower_bound_biased(cur, c.end(), proj(*f), p);
+    if (cur == c.end() || p(proj(*f), *cur)) continue;
+    out = (out == in) ? cur : std::move(in, cur, out);
+    in = ++cur;
+  }
+  if (out == in) return 0;
+
+  out = std::move(in, c.end(), out);
+  auto res = static_cast<typename C::size_type>(c.end() - out);
+  c.erase(out, c.end());
+  return res;
+}
+
+// Merges |c| with the apply_delta batch [f, l) into the empty |res|. The
+// elements of |c| are moved from.
+template <typename C, typename I, typename P>
+// requires Container<C> && ForwardIterator<I> &&
+// StrictWeakOrdering<P(ValueType<C>)>
+void apply_delta_impl(C& c, I f, I l, C& res, P p) {
+  auto in = c.begin();
+  for (; f != l; ++f) {
+    auto pos = lower_bound_biased(in, c.end(), (*f).first, p);
+    res.insert(res.end(), std::make_move_iterator(in),
+               std::make_move_iterator(pos));
+    in = pos;
+    if (pos != c.end() && !p((*f).first, *pos)) {
+      ++in;
+      if ((*f).second) res.push_back(std::move(*pos));
+    } else if ((*f).second) {
+      res.emplace_back((*f).first);
+    }
+  }
+  res.insert(res.end(), std::make_move_iterator(in),
+             std::make_move_iterator(c.end()));
+}
+
+}  // namespace detail
+
+// Opt-in for flat_set::insert(k), try_emplace(k) and insert_keys to search
+// for a K as it is and to build the element only when it is missing.
+// Specialize to std::true_type when Value is built from K without loss and
+// the comparator orders (Value, K) the same as (Value, Value(k)). Has no
+// effect without a transparent comparator.
+template <typename Value, typename K>
+struct is_heterogeneous_key : std::false_type {};
+
+template <typename C, typename T, typename A>
+struct is_heterogeneous_key<std::basic_string<C, T, A>, const C*>
+    : std::true_type {};
+
+template <typename C, typename T, typename A>
+struct is_heterogeneous_key<std::basic_string<C, T, A>, C*> : std::true_type {
+};
+
+namespace detail {
+
+// Keys that flat_set::try_emplace, insert(k) and insert_keys search for as
+// they are: the key_type and the opted in heterogeneous keys. Others are
+// converted to the key_type first.
+template <typename Set, typename K>
+using try_emplace_key = typename std::conditional<
+    std::is_same<K, typename Set::key_type>::value ||
+        std::is_same<K, typename Set::value_type>::value ||
+        (TransparentComparator<typename Set::key_compare>() &&
+         is_heterogeneous_key<typename Set::value_type, K>::value),
+    K, typename Set::key_type>::type;
+
+}  // namespace detail
+
+// KeyOf projects the key out of an element: flat_set<Order, less,
+// std::vector<Order>, order_id> is searched with bare ids. With the default
+// identity the elements are the keys.
+template <typename Key, typename Compare = less,
+          typename UnderlyingType = std::vector<Key>,
+          typename KeyOf = identity>
+// requires (todo)
+class flat_set {
+  static constexpr bool kProjected = !std::is_same<KeyOf, identity>::value;
+
+ public:
+  using underlying_type = UnderlyingType;
+  using key_type = detail::projected_key<Key, KeyOf>;
+  using value_type = Key;
+  using size_type = typename underlying_type::size_type;
+  using difference_type = typename underlying_type::difference_type;
+  using key_compare = Compare;
+  using value_compare = typename std::conditional<
+      kProjected, detail::projected_compare<Key, Compare, KeyOf>,
+      Compare>::type;
+  using key_of_type = KeyOf;
+  using reference = typename underlying_type::reference;
+  using const_reference = typename underlying_type::const_reference;
+  using pointer = typename underlying_type::pointer;
+  using const_pointer = typename underlying_type::const_pointer;
+  using iterator = typename underlying_type::iterator;
+  using const_iterator = typename underlying_type::const_iterator;
+  using reverse_iterator = typename underlying_type::reverse_iterator;
+  using const_reverse_iterator =
+      typename underlying_type::const_reverse_iterator;
+
+ private:
+  // We cannot use std::tuple for compressed pair, because there is no way to
+  // forward many arguments to one of the members.
+  struct impl_t : value_compare {
+    impl_t() = default;
+
+    template <typename... Args>
+    impl_t(value_compare comp, Args&&... args)
+        : value_compare(comp), body_{std::forward<Args>(args)...} {};
+
+    underlying_type body_;
+  } impl_;
+
+  // Lookup keys are converted once, before the search: to the value_type or,
+  // for projected elements, to the key_type.
+  template <typename V>
+  using type_for_value_compare = typename std::conditional<
+      TransparentComparator<key_compare>() ||
+          std::is_same<V, value_type>::value,
+      V,
+      typename std::conditional<kProjected, key_type, value_type>::type>::type;
+
+  template <typename K>
+  using searched_as_is = std::integral_constant<
+      bool, std::is_same<detail::try_emplace_key<flat_set, K>, K>::value>;
+
+  template <typename K>
+  using insert_converting_should_be_enabled = typename std::enable_if<
+      !std::is_same<typename std::decay<K>::type, value_type>::value &&
+      std::is_constructible<value_type, K&&>::value>::type;
+
+  iterator const_cast_iterator(const_iterator c_it) {
+    return begin() + std::distance(cbegin(), c_it);
+  }
+
+  // While the elements are stored inline, a linear scan beats binary search.
+  bool use_linear_search() const {
+    return size() <= InlineCapacity<underlying_type>();
+  }
+
+  template <typename I>
+  void insert_by_one(I f, I l) {
+    const_iterator hint = cbegin();
+    for (; f != l; ++f) hint = std::next(insert(hint, value_type(*f)));
+  }
+
+  template <typename K>
+  std::pair<iterator, bool> insert_converting(K&& k, std::true_type) {
+    return try_emplace(std::forward<K>(k));
+  }
+
+  template <typename K>
+  std::pair<iterator, bool> insert_converting(K&& k, std::false_type) {
+    return insert(value_type(std::forward<K>(k)));
+  }
+
+  template <typename I>
+  void insert_keys_impl(I f, I l, std::false_type) {
+    std::vector<value_type> buf;
+    for (; f != l; ++f) buf.push_back(value_type(*f));
+    insert(std::make_move_iterator(buf.begin()),
+           std::make_move_iterator(buf.end()));
+  }
+
+  template <typename K, typename... Args>
+  std::pair<iterator, bool> try_emplace_impl(std::false_type, K&& k,
+                                             Args&&... args) {
+    return try_emplace_impl(std::true_type{}, key_type(std::forward<K>(k)),
+                            std::forward<Args>(args)...);
+  }
+
+  template <typename K, typename... Args>
+  std::pair<iterator, bool> try_emplace_impl(std::true_type, K&& k,
+                                             Args&&... args) {
+    iterator pos = lower_bound(k);
+    if (pos != end() && !value_comp()(k, *pos)) return {pos, false};
+
+    pos = body().insert(
+        pos, value_type{std::forward<K>(k), std::forward<Args>(args)...});
+    return {pos, true};
+  }
+
+  template <typename I>
+  void insert_keys_impl(I f, I l, std::true_type) {
+    std::vector<value_type> misses;
+    for (; f != l; ++f) {
+      Reference<I> k = *f;
+      if (count(k)) continue;
+      misses.push_back(value_type{std::forward<Reference<I>>(k)});
+    }
+    insert(std::make_move_iterator(misses.begin()),
+           std::make_move_iterator(misses.end()));
+  }
+
+  // Need to count elements.
+  template <typename I, typename Scratch>
+  void insert_sorted_unique_impl(I f, I l, Scratch& scratch,
+                                 std::input_iterator_tag) {
+    scratch.assign(f, l);
+    detail::insert_sorted_unique_impl(body(),
+                                      std::make_move_iterator(scratch.begin()),
+                                      std::make_move_iterator(scratch.end()),
+                                      value_comp());
+    scratch.clear();
+  }
+
+  template <typename I, typename Scratch>
+  void insert_sorted_unique_impl(I f, I l, Scratch&,
+                                 std::forward_iterator_tag) {
+    insert_sorted_unique_impl(f, l, std::forward_iterator_tag{});
+  }
+
+  // The scratch container is only created when it is needed: for a
+  // static_vector it is Capacity elements on the stack.
+  template <typename I>
+  void insert_sorted_unique_impl(I f, I l, std::input_iterator_tag) {
+    underlying_type buf(body().get_allocator());
+    insert_sorted_unique_impl(f, l, buf, std::input_iterator_tag{});
+  }
+
+  template <typename I>
+  void insert_sorted_unique_impl(I f, I l, std::forward_iterator_tag) {
+    detail::insert_sorted_unique_impl(body(), f, l, value_comp());
+  }
+
+  // Returns false if the new elements have to be sorted in a buffer and
+  // merged.
+  template <typename I>
+  bool insert_without_buffer(I, I, std::input_iterator_tag) {
+    return false;
+  }
+
+  template <typename I>
+  bool insert_without_buffer(I f, I l, std::forward_iterator_tag) {
+    if (f == l) return true;
+
+    const bool is_sorted = std::adjacent_find(f, l, not_fn(value_comp())) == l;
+    if (is_sorted && (empty() || value_comp()(*rbegin(), *f))) {
+      body().insert(end(), f, l);
+      return true;
+    }
+
+    switch (detail::choose_insert_f_l_strategy<value_type>(
+        size(), static_cast<size_type>(std::distance(f, l)), is_sorted)) {
+      case detail::insert_f_l_strategy::by_one:
+        insert_by_one(f, l);
+        return true;
+      case detail::insert_f_l_strategy::rebuild:
+        rebuild_with(f, l);
+        return true;
+      case detail::insert_f_l_strategy::merge:
+        break;
+    }
+
+    if (is_sorted) {
+      insert_sorted_unique(f, l);
+      return true;
+    }
+    return false;
+  }
+
+  template <typename I>
+  void insert_impl(I f, I l, std::input_iterator_tag) {
+    underlying_type buf(f, l, body().get_allocator());
+    buf.erase(sort_and_unique(buf.begin(), buf.end(), value_comp()), buf.end());
+    insert_sorted_unique(std::make_move_iterator(buf.begin()),
+                         std::make_move_iterator(buf.end()));
+  }
+
+  template <typename I>
+  void insert_impl(I f, I l, std::forward_iterator_tag) {
+    if (insert_without_buffer(f, l, std::forward_iterator_tag{})) return;
+
+    const difference_type n = std::distance(f, l);
+    temporary_buffer<value_type> buf(n);
+    if (buf.capacity() < n) {
+      insert_impl(f, l, std::input_iterator_tag{});
+      return;
+    }
+
+    value_type* buf_f;
+    value_type* buf_l;
+    std::tie(std::ignore, buf_f, buf_l) = buf.copy(f, l);
+    buf_l = sort_and_unique(buf_f, buf_l, value_comp());
+    insert_sorted_unique(std::make_move_iterator(buf_f),
+                         std::make_move_iterator(buf_l));
+  }
+
+  // Append the new elements, sort them and merge in place. Existing elements
+  // win over equal new ones, since the merge is stable.
+  template <typename I>
+  void rebuild_with(I f, I l) {
+    difference_type orig_len = static_cast<difference_type>(size());
+    body().insert(end(), f, l);
+    iterator m = begin() + orig_len;
+    iterator new_l = sort_and_unique(m, end(), value_comp());
+    inplace_merge_rotating_middles(begin(), m, new_l, value_comp());
+    erase(std::unique(begin(), new_l, not_fn(value_comp())), end());
+  }
+
+ public:
+  // --------------------------------------------------------------------------
+  // Lifetime -----------------------------------------------------------------
+
+  flat_set() = default;
+  explicit flat_set(const key_compare& comp) : impl_{comp} {}
+
+  template <typename I>
+  // requires InputIterator<I>
+  flat_set(I f, I l, const key_compare& comp = key_compare())
+      : impl_(comp, f, l) {
+    erase(sort_and_unique(begin(), end(), value_comp()), end());
+  }
+
+  // The elements are sorted and deduplicated in |scratch|, so the body is
+  // allocated once, with the exact size. |scratch| is left empty but keeps
+  // its capacity.
+  template <typename I, typename Scratch,
+            typename = detail::scratch_should_be_enabled<value_type, Scratch>>
+  // requires InputIterator<I> && SequenceContainer<Scratch>
+  flat_set(I f, I l, Scratch& scratch, const key_compare& comp = key_compare())
+      : impl_{comp} {
+    scratch.assign(f, l);
+    scratch.erase(sort_and_unique(scratch.begin(), scratch.end(), value_comp()),
+                  scratch.end());
+    body().assign(std::make_move_iterator(scratch.begin()),
+                  std::make_move_iterator(scratch.end()));
+    scratch.clear();
+  }
+
+  flat_set(const flat_set&) = default;
+  flat_set(flat_set&&) = default;
+
+  explicit flat_set(underlying_type buf,
+                    const key_compare& comp = key_compare())
+      : impl_{comp, std::move(buf)} {
+    erase(sort_and_unique(begin(), end(), value_comp()), end());
+  }
+
+  flat_set(std::initializer_list<value_type> il,
+           const key_compare& comp = key_compare())
+      : flat_set(il.begin(), il.end(), comp) {}
+
+  ~flat_set() = default;
+
+  // --------------------------------------------------------------------------
+  // Assignments --------------------------------------------------------------
+
+  flat_set& operator=(const flat_set&) = default;
+  flat_set& operator=(flat_set&&) = default;
+  flat_set& operator=(std::initializer_list<value_type> il) {
+    body() = il;
+    erase(sort_and_unique(begin(), end(), value_comp()), end());
+    return *this;
+  }
+
+  //---------------------------------------------------------------------------
+  // Memory management.
+
+  void reserve(size_type new_capacity) { body().reserve(new_capacity); }
+  size_type capacity() const { return body().capacity(); }
+  void shrink_to_fit() { body().shrink_to_fit(); }
+
+  //---------------------------------------------------------------------------
+  // Size management.
+
+  void clear() { body().clear(); }
+
+  size_type size() const { return body().size(); }
+  size_type max_size() const { return body().max_size(); }
+
+  bool empty() const { return body().empty(); }
+
+  //---------------------------------------------------------------------------
+  // Iterators.
+
+  iterator begin() { return body().begin(); }
+  const_iterator begin() const { return body().begin(); }
+  const_iterator cbegin() const { return body().cbegin(); }
+
+  iterator end() { return body().end(); }
+  const_iterator end() const { return body().end(); }
+  const_iterator cend() const { return body().cend(); }
+
+  reverse_iterator rbegin() { return body().rbegin(); }
+  const_reverse_iterator rbegin() const { return body().rbegin(); }
+  const_reverse_iterator crbegin() const { return body().crbegin(); }
+
+  reverse_iterator rend() { return body().rend(); }
+  const_reverse_iterator rend() const { return body().rend(); }
+  const_reverse_iterator crend() const { return body().crend(); }
+
+  //---------------------------------------------------------------------------
+  // Insert operations.
+
+  template <typename V,
+            typename = detail::insert_should_be_enabled<value_type, V>>
+  std::pair<iterator, bool> insert(V&& v) {
+    iterator pos = lower_bound(v);
+    if (pos == end() || value_comp()(v, *pos))
+      return {body().insert(pos, std::forward<V>(v)), true};
+    return {pos, false};
+  }
+
+  template <typename V,
+            typename = detail::insert_should_be_enabled<value_type, V>>
+  iterator insert(const_iterator hint, V&& v) {
+    auto pos = lower_bound_hinted(cbegin(), hint, cend(), v, value_comp());
+    if (pos == end() || value_comp()(v, *pos))
+      return body().insert(pos, std::forward<V>(v));
+    return const_cast_iterator(pos);
+  }
+
+  template <typename I>
+  void insert_sorted_unique(I f, I l) {
+    insert_sorted_unique_impl(f, l, IteratorCategory<I>{});
+  }
+
+  // Buffers the elements in |scratch| when the iterators cannot be traversed
+  // twice. |scratch| is left empty but keeps its capacity.
+  template <typename I, typename Scratch,
+            typename = detail::scratch_should_be_enabled<value_type, Scratch>>
+  // requires InputIterator<I> && SequenceContainer<Scratch>
+  void insert_sorted_unique(I f, I l, Scratch& scratch) {
+    insert_sorted_unique_impl(f, l, scratch, IteratorCategory<I>{});
+  }
+
+  template <typename I>
+  void insert(I f, I l) {
+    insert_impl(f, l, IteratorCategory<I>{});
+  }
+
+  // Same as insert(f, l) but the new elements are sorted and deduplicated in
+  // |scratch|. |scratch| is left empty but keeps its capacity, so calling
+  // this in a loop with the same |scratch| does not allocate temporary memory.
+  template <typename I, typename Scratch,
+            typename = detail::scratch_should_be_enabled<value_type, Scratch>>
+  // requires InputIterator<I> && SequenceContainer<Scratch>
+  void insert(I f, I l, Scratch& scratch) {
+    if (insert_without_buffer(f, l, IteratorCategory<I>{})) return;
+
+    scratch.assign(f, l);
+    scratch.erase(sort_and_unique(scratch.begin(), scratch.end(), value_comp()),
+                  scratch.end());
+    insert_sorted_unique(std::make_move_iterator(scratch.begin()),
+                         std::make_move_iterator(scratch.end()));
+    scratch.clear();
+  }
+
+  void insert(std::initializer_list<value_type> ilist) {
+    insert(ilist.begin(), ilist.end());
+  }
+
+  template <typename... Args>
+  std::pair<iterator, bool> emplace(Args&&... args) {
+    return insert(value_type{std::forward<Args>(args)...});
+  }
+
+  template <typename... Args>
+  iterator emplace_hint(const_iterator hint, Args&&... args) {
+    return insert(hint, value_type{std::forward<Args>(args)...});
+  }
+
+  // Searches for |k| and constructs value_type{k, args...} only when it is
+  // missing. Unless |k| is a key_type or an is_heterogeneous_key, it is
+  // converted to the key_type first.
+  template <typename K, typename... Args>
+  std::pair<iterator, bool> try_emplace(K&& k, Args&&... args) {
+    return try_emplace_impl(searched_as_is<typename std::decay<K>::type>{},
+                            std::forward<K>(k), std::forward<Args>(args)...);
+  }
+
+  // An is_heterogeneous_key is searched for as is: no value_type is built
+  // when it is already there. Anything else is converted to value_type
+  // first.
+  template <typename K, insert_converting_should_be_enabled<K>* = nullptr>
+  std::pair<iterator, bool> insert(K&& k) {
+    return insert_converting(
+        std::forward<K>(k), searched_as_is<typename std::decay<K>::type>{});
+  }
+
+  // insert(f, l) for is_heterogeneous_key keys: every key is looked up and
+  // only the missing ones are converted to value_type. Pays a binary search
+  // per key, which is cheap next to a conversion that allocates. Other keys
+  // are all converted and inserted like in insert(f, l).
+  template <typename I>
+  // requires InputIterator<I>
+  void insert_keys(I f, I l) {
+    insert_keys_impl(f, l,
+                     searched_as_is<typename std::decay<Reference<I>>::type>{});
+  }
+
+  // --------------------------------------------------------------------------
+  // Erase operations.
+
+  iterator erase(iterator pos) { return body().erase(pos); }
+  iterator erase(const_iterator pos) { return body().erase(pos); }
+
+  iterator erase(const_iterator f, const_iterator l) {
+    return body().erase(f, l);
+  }
+
+  template <typename V>
+  size_type erase(const V& v) {
+    auto eq_range = equal_range(v);
+    size_type res = std::distance(eq_range.first, eq_range.second);
+    erase(eq_range.first, eq_range.second);
+    return res;
+  }
+
+  // Erases every key from the sorted range [f, l). Each position is found by
+  // galloping from the previous one and the survivors are compacted in one
+  // forward pass: O(n + m log(n / m)). Returns the number of erased elements.
+  template <typename I>
+  // requires InputIterator<I>
+  size_type erase_sorted(I f, I l) {
+    return detail::erase_sorted_impl(body(), f, l, value_comp(), identity{});
+  }
+
+  // Applies a batch of insertions and erasures in one forward pass. The
+  // elements of [f, l) are pair-like: first is a key, second is true to insert
+  // it and false to erase it. Keys must be sorted and unique. Positions are
+  // found by galloping and the untouched stretches between them are moved in
+  // bulk. A batch with insertions is built in a new buffer; a batch of only
+  // erasures is compacted in place.
+  template <typename I>
+  // requires ForwardIterator<I>
+  void apply_delta(I f, I l) {
+    size_type inserted = 0;
+    for (I it = f; it != l; ++it)
+      if ((*it).second) ++inserted;
+    if (!inserted) {
+      detail::erase_sorted_impl(body(), f, l, value_comp(),
+                                detail::delta_key{});
+      return;
+    }
+
+    underlying_type res(body().get_allocator());
+    res.reserve(size() + inserted);
+    detail::apply_delta_impl(body(), f, l, res, value_comp());
+    body().swap(res);
+  }
+
+  // Same as erase_sorted for keys in any order: they are converted to
+  // key_type and sorted in a buffer first. Sorting them as they are would use
+  // their own order, which for const char* is the order of the addresses.
+  // Not an erase(f, l) overload, since iterators over keys can have the same
+  // type as const_iterator.
+  template <typename I>
+  // requires InputIterator<I>
+  size_type erase_keys(I f, I l) {
+    std::vector<key_type> buf(f, l);
+    buf.erase(sort_and_unique(buf.begin(), buf.end(), value_comp()), buf.end());
+    return erase_sorted(buf.begin(), buf.end());
+  }
+
+  // --------------------------------------------------------------------------
+  // Search operations.
+
+  template <typename V>
+  size_type count(const V& v) const {
+    auto eq_range = equal_range(v);
+    return std::distance(eq_range.first, eq_range.second);
+  }
+
+  template <typename V>
+  iterator find(const V& v) {
+    auto eq_range = equal_range(v);
+    return (eq_range.first == eq_range.second) ? end() : eq_range.first;
+  }
+
+  template <typename V>
+  const_iterator find(const V& v) const {
+    auto eq_range = equal_range(v);
+    return (eq_range.first == eq_range.second) ? end() : eq_range.first;
+  }
+
+  template <typename V>
+  std::pair<iterator, iterator> equal_range(const V& v) {
+    auto pos = lower_bound(v);
+    if (pos == end() || value_comp()(v, *pos)) return {pos, pos};
+
+    return {pos, std::next(pos)};
+  }
+
+  template <typename V>
+  std::pair<const_iterator, const_iterator> equal_range(const V& v) const {
+    auto pos = lower_bound(v);
+    if (pos == end() || value_comp()(v, *pos)) return {pos, pos};
+
+    return {pos, std::next(pos)};
+  }
+
+  template <typename V>
+  iterator lower_bound(const V& v) {
+    const type_for_value_compare<V>& v_ref = v;
+    if (use_linear_search())
+      return lower_bound_linear(begin(), end(), v_ref, value_comp());
+    return std::lower_bound(begin(), end(), v_ref, value_comp());
+  }
+
+  template <typename V>
+  const_iterator lower_bound(const V& v) const {
+    const type_for_value_compare<V>& v_ref = v;
+    if (use_linear_search())
+      return lower_bound_linear(begin(), end(), v_ref, value_comp());
+    return std::lower_bound(begin(), end(), v_ref, value_comp());
+  }
+
+  template <typename V>
+  iterator upper_bound(const V& v) {
+    const type_for_value_compare<V>& v_ref = v;
+    return std::upper_bound(begin(), end(), v_ref, value_comp());
+  }
+
+  template <typename V>
+  const_iterator upper_bound(const V& v) const {
+    const type_for_value_compare<V>& v_ref = v;
+    return std::upper_bound(begin(), end(), v_ref, value_comp());
+  }
+
+  //---------------------------------------------------------------------------
+  // Getters.
+
+  key_compare key_comp() const { return impl_; }
+  value_compare value_comp() const { return impl_; }
+
+  underlying_type& body() { return impl_.body_; }
+  const underlying_type& body() const { return impl_.body_; }
+
+  //---------------------------------------------------------------------------
+  // General operations.
+
+  void swap(flat_set& x) { body().swap(x.body()); }
+
+  friend void swap(flat_set& x, flat_set& y) { x.swap(y); }
+
+  friend bool operator==(const flat_set& x, const flat_set& y) {
+    return x.body() == y.body();
+  }
+
+  friend bool operator!=(const flat_set& x, const flat_set& y) {
+    return !(x == y);
+  }
+
+  friend bool operator<(const flat_set& x, const flat_set& y) {
+    return x.body() < y.body();
+  }
+
+  friend bool operator>(const flat_set& x, const flat_set& y) { return y < x; }
+
+  friend bool operator<=(const flat_set& x, const flat_set& y) {
+    return !(y < x);
+  }
+
+  friend bool operator>=(const flat_set& x, const flat_set& y) {
+    return !(x < y);
+  }
+};
+
+template <typename Key, typename Comparator, typename UnderlyingType,
+          typename KeyOf, typename P>
+// requires UnaryPredicate<P(reference)>
+void erase_if(flat_set<Key, Comparator, UnderlyingType, KeyOf>& x, P p) {
+  x.erase(std::remove_if(x.begin(), x.end(), p), x.end());
+}
+
+// flat_map -------------------------------------------------------------------
+
+namespace detail {
+
+// Class comparators are a base, so that empty ones take no space. Function
+// pointers cannot be one and are a member.
+template <typename Compare, bool = std::is_class<Compare>::value>
+struct comparator_holder : Compare {
+  comparator_holder() = default;
+  comparator_holder(const Compare& comp) : Compare(comp) {}
+
+  const Compare& get() const { return *this; }
+};
+
+template <typename Compare>
+struct comparator_holder<Compare, false> {
+  comparator_holder() = default;
+  comparator_holder(const Compare& comp) : comp(comp) {}
+
+  const Compare& get() const { return comp; }
+
+  Compare comp;
+};
+
+// Compares pairs by their keys. Either side can also be a bare key.
+template <typename Pair, typename Compare>
+struct map_value_compare : comparator_holder<Compare> {
+  map_value_compare() = default;
+  map_value_compare(const Compare& comp) : comparator_holder<Compare>(comp) {}
+
+  const Compare& key_comp() const { return this->get(); }
+
+  bool operator()(const Pair& x, const Pair& y) const {
+    return key_comp()(x.first, y.first);
+  }
+
+  template <typename K>
+  bool operator()(const Pair& x, const K& y) const {
+    return key_comp()(x.first, y);
+  }
+
+  template <typename K>
+  bool operator()(const K& x, const Pair& y) const {
+    return key_comp()(x, y.first);
+  }
+
+  using is_transparent = int;
+};
+
+// Union policy for pairs with equal keys: combines the mapped values.
+template <typename Pair, typename F>
+struct combine_mapped {
+  F combine;
+
+  template <typename X, typename Y>
+  Pair operator()(X&& x, Y&& y) {
+    return Pair(std::forward<X>(x).first,
+                combine(std::forward<X>(x).second, std::forward<Y>(y).second));
+  }
+};
+
+}  // namespace detail
+
+// Sorted vector of (key, value) pairs. Keys in the body are not const, so that
+// the elements can be shifted; changing them breaks the ordering.
+template <typename Key, typename Value, typename Compare = less,
+          typename UnderlyingType = std::vector<std::pair<Key, Value>>>
+class flat_map {
+ public:
+  using underlying_type = UnderlyingType;
+  using key_type = Key;
+  using mapped_type = Value;
+  using value_type = std::pair<Key, Value>;
+  using size_type = typename underlying_type::size_type;
+  using difference_type = typename underlying_type::difference_type;
+  using key_compare = Compare;
+  using value_compare = detail::map_value_compare<value_type, Compare>;
+  using reference = typename underlying_type::reference;
+  using const_reference = typename underlying_type::const_reference;
+  using pointer = typename underlying_type::pointer;
+  using const_pointer = typename underlying_type::const_pointer;
+  using iterator = typename underlying_type::iterator;
+  using const_iterator = typename underlying_type::const_iterator;
+  using reverse_iterator = typename underlying_type::reverse_iterator;
+  using const_reverse_iterator =
+      typename underlying_type::const_reverse_iterator;
+
+ private:
+  using set_type = flat_set<value_type, value_compare, underlying_type>;
+
+  template <typename K>
+  using type_for_key_compare =
+      typename std::conditional<TransparentComparator<key_compare>(), K,
+                                key_type>::type;
+
+  // Keeps the last of equal keys: the last writer wins.
+  template <typename I>
+  I unique_keep_last(I f, I l) {
+    using reverse_it = std::reverse_iterator<I>;
+    return std::unique(reverse_it(l), reverse_it(f),
+                       inverse_fn(not_fn(value_comp())))
+        .base();
+  }
+
+  template <typename K, typename... Args>
+  std::pair<iterator, bool> try_emplace_impl(K&& k, Args&&... args) {
+    iterator pos = lower_bound(k);
+    if (pos != end() && !key_comp()(k, pos->first)) return {pos, false};
+
+    pos = body().emplace(pos, std::piecewise_construct,
+                         std::forward_as_tuple(std::forward<K>(k)),
+                         std::forward_as_tuple(std::forward<Args>(args)...));
+    return {pos, true};
+  }
+
+  template <typename K, typename M>
+  std::pair<iterator, bool> insert_or_assign_impl(K&& k, M&& m) {
+    iterator pos = lower_bound(k);
+    if (pos != end() && !key_comp()(k, pos->first)) {
+      pos->second = std::forward<M>(m);
+      return {pos, false};
+    }
+
+    pos = body().emplace(pos, std::forward<K>(k), std::forward<M>(m));
+    return {pos, true};
+  }
+
+  template <typename I, typename F>
+  void merge_combine_impl(I f, I l, F combine) {
+    detail::insert_sorted_unique_impl(
+        body(), f, l, value_comp(),
+        detail::combine_mapped<value_type, F>{combine});
+  }
+
+ public:
+  // --------------------------------------------------------------------------
+  // Constructors -------------------------------------------------------------
+
+  flat_map() = default;
+  explicit flat_map(const key_compare& comp) : impl_(comp) {}
+
+  template <typename I>
+  // requires InputIterator<I>
+  flat_map(I f, I l, const key_compare& comp = key_compare())
+      : impl_(f, l, comp) {}
+
+  explicit flat_map(underlying_type buf,
+                    const key_compare& comp = key_compare())
+      : impl_(std::move(buf), comp) {}
+
+  flat_map(std::initializer_list<value_type> il,
+           const key_compare& comp = key_compare())
+      : flat_map(il.begin(), il.end(), comp) {}
+
+  //---------------------------------------------------------------------------
+  // Memory management.
+
+  void reserve(size_type new_capacity) { impl_.reserve(new_capacity); }
+  size_type capacity() const { return impl_.capacity(); }
+  void shrink_to_fit() { impl_.shrink_to_fit(); }
+
+  //---------------------------------------------------------------------------
+  // Size management.
+
+  void clear() { impl_.clear(); }
+
+  size_type size() const { return impl_.size(); }
+  size_type max_size() const { return impl_.max_size(); }
+
+  bool empty() const { return impl_.empty(); }
+
+  //---------------------------------------------------------------------------
+  // Iterators.
+
+  iterator begin() { return body().begin(); }
+  const_iterator begin() const { return body().begin(); }
+  const_iterator cbegin() const { return body().cbegin(); }
+
+  iterator end() { return body().end(); }
+  const_iterator end() const { return body().end(); }
+  const_iterator cend() const { return body().cend(); }
+
+  reverse_iterator rbegin() { return body().rbegin(); }
+  const_reverse_iterator rbegin() const { return body().rbegin(); }
+  const_reverse_iterator crbegin() const { return body().crbegin(); }
+
+  reverse_iterator rend() { return body().rend(); }
+  const_reverse_iterator rend() const { return body().rend(); }
+  const_reverse_iterator crend() const { return body().crend(); }
+
+  //---------------------------------------------------------------------------
+  // Element access.
+
+  mapped_type& operator[](const key_type& k) {
+    return try_emplace(k).first->second;
+  }
+
+  mapped_type& operator[](key_type&& k) {
+    return try_emplace(std::move(k)).first->second;
+  }
+
+  //---------------------------------------------------------------------------
+  // Insert operations.
+
+  template <typename V,
+            typename = detail::insert_should_be_enabled<value_type, V>>
+  std::pair<iterator, bool> insert(V&& v) {
+    return impl_.insert(std::forward<V>(v));
+  }
+
+  template <typename V,
+            typename = detail::insert_should_be_enabled<value_type, V>>
+  iterator insert(const_iterator hint, V&& v) {
+    return impl_.insert(hint, std::forward<V>(v));
+  }
+
+  // Existing keys are kept, like in std::map.
+  template <typename I>
+  // requires InputIterator<I>
+  void insert(I f, I l) {
+    impl_.insert(f, l);
+  }
+
+  void insert(std::initializer_list<value_type> il) {
+    insert(il.begin(), il.end());
+  }
+
+  template <typename... Args>
+  std::pair<iterator, bool> emplace(Args&&... args) {
+    return insert(value_type(std::forward<Args>(args)...));
+  }
+
+  template <typename... Args>
+  iterator emplace_hint(const_iterator hint, Args&&... args) {
+    return insert(hint, value_type(std::forward<Args>(args)...));
+  }
+
+  template <typename... Args>
+  std::pair<iterator, bool> try_emplace(const key_type& k, Args&&... args) {
+    return try_emplace_impl(k, std::forward<Args>(args)...);
+  }
+
+  template <typename... Args>
+  std::pair<iterator, bool> try_emplace(key_type&& k, Args&&... args) {
+    return try_emplace_impl(std::move(k), std::forward<Args>(args)...);
+  }
+
+  template <typename M>
+  std::pair<iterator, bool> insert_or_assign(const key_type& k, M&& m) {
+    return insert_or_assign_impl(k, std::forward<M>(m));
+  }
+
+  template <typename M>
+  std::pair<iterator, bool> insert_or_assign(key_type&& k, M&& m) {
+    return insert_or_assign_impl(std::move(k), std::forward<M>(m));
+  }
+
+  // Bulk version: the last of equal keys in [f, l) wins and it overwrites the
+  // existing value. The batch is deduplicated in a buffer and then merged
+  // into the body in one pass, replacing on equal keys.
+  template <typename I, typename = IteratorCategory<I>>
+  // requires InputIterator<I>
+  void insert_or_assign(I f, I l) {
+    std::vector<value_type> buf(f, l);
+    std::stable_sort(buf.begin(), buf.end(), value_comp());
+    auto buf_f = unique_keep_last(buf.begin(), buf.end());
+    insert_or_assign_sorted_unique(std::make_move_iterator(buf_f),
+                                   std::make_move_iterator(buf.end()));
+  }
+
+  void insert_or_assign(std::initializer_list<value_type> il) {
+    insert_or_assign(il.begin(), il.end());
+  }
+
+  // Keys of [f, l) have to be sorted and unique.
+  template <typename I>
+  // requires ForwardIterator<I>
+  void insert_or_assign_sorted_unique(I f, I l) {
+    detail::insert_sorted_unique_impl(body(), f, l, value_comp(),
+                                      take_second{});
+  }
+
+  // Merges |other| into this map. For equal keys the value becomes
+  // combine(this_value, other_value). Done in the same galloping merge as
+  // insert_sorted_unique, backwards into the free capacity when it fits.
+  template <typename F>
+  // requires BinaryFunction<F(mapped_type, mapped_type)>
+  void merge_combine(const flat_map& other, F combine) {
+    merge_combine_impl(other.begin(), other.end(), combine);
+  }
+
+  template <typename F>
+  // requires BinaryFunction<F(mapped_type, mapped_type)>
+  void merge_combine(flat_map&& other, F combine) {
+    merge_combine_impl(std::make_move_iterator(other.begin()),
+                       std::make_move_iterator(other.end()), combine);
+  }
+
+  // --------------------------------------------------------------------------
+  // Erase operations.
+
+  iterator erase(iterator pos) { return impl_.erase(pos); }
+  iterator erase(const_iterator pos) { return impl_.erase(pos); }
+
+  iterator erase(const_iterator f, const_iterator l) {
+    return impl_.erase(f, l);
+  }
+
+  template <typename K>
+  size_type erase(const K& k) {
+    const type_for_key_compare<K>& k_ref = k;
+    return impl_.erase(k_ref);
+  }
+
+  // --------------------------------------------------------------------------
+  // Search operations.
+
+  template <typename K>
+  size_type count(const K& k) const {
+    return find(k) != end() ? 1 : 0;
+  }
+
+  template <typename K>
+  iterator find(const K& k) {
+    const type_for_key_compare<K>& k_ref = k;
+    return impl_.find(k_ref);
+  }
+
+  template <typename K>
+  const_iterator find(const K& k) const {
+    const type_for_key_compare<K>& k_ref = k;
+    return impl_.find(k_ref);
+  }
+
+  template <typename K>
+  std::pair<iterator, iterator> equal_range(const K& k) {
+    const type_for_key_compare<K>& k_ref = k;
+    return impl_.equal_range(k_ref);
+  }
+
+  template <typename K>
+  std::pair<const_iterator, const_iterator> equal_range(const K& k) const {
+    const type_for_key_compare<K>& k_ref = k;
+    return impl_.equal_range(k_ref);
+  }
+
+  template <typename K>
+  iterator lower_bound(const K& k) {
+    const type_for_key_compare<K>& k_ref = k;
+    return impl_.lower_bound(k_ref);
+  }
+
+  template <typename K>
+  const_iterator lower_bound(const K& k) const {
+    const type_for_key_compare<K>& k_ref = k;
+    return impl_.lower_bound(k_ref);
+  }
+
+  template <typename K>
+  iterator upper_bound(const K& k) {
+    const type_for_key_compare<K>& k_ref = k;
+    return impl_.upper_bound(k_ref);
+  }
+
+  template <typename K>
+  const_iterator upper_bound(const K& k) const {
+    const type_for_key_compare<K>& k_ref = k;
+    return impl_.upper_bound(k_ref);
+  }
+
+  //---------------------------------------------------------------------------
+  // Getters.
+
+  key_compare key_comp() const { return value_comp().key_comp(); }
+  value_compare value_comp() const { return impl_.value_comp(); }
+
+  underlying_type& body() { return impl_.body(); }
+  const underlying_type& body() const { return impl_.body(); }
+
+  //---------------------------------------------------------------------------
+  // General operations.
+
+  void swap(flat_map& x) { impl_.swap(x.impl_); }
+
+  friend void swap(flat_map& x, flat_map& y) { x.swap(y); }
+
+  friend bool operator==(const flat_map& x, const flat_map& y) {
+    return x.body() == y.body();
+  }
+
+  friend bool operator!=(const flat_map& x, const flat_map& y) {
+    return !(x == y);
+  }
+
+  friend bool operator<(const flat_map& x, const flat_map& y) {
+    return x.body() < y.body();
+  }
+
+  friend bool operator>(const flat_map& x, const flat_map& y) { return y < x; }
+
+  friend bool operator<=(const flat_map& x, const flat_map& y) {
+    return !(y < x);
+  }
+
+  friend bool operator>=(const flat_map& x, const flat_map& y) {
+    return !(x < y);
+  }
+
+ private:
+  set_type impl_;
+};
+
+template <typename Key, typename Value, typename Comparator,
+          typename UnderlyingType, typename P>
+// requires UnaryPredicate<P(reference)>
+void erase_if(flat_map<Key, Value, Comparator, UnderlyingType>& x, P p) {
+  x.erase(std::remove_if(x.begin(), x.end(), p), x.end());
+}
+
+namespace detail {
+
+template <typename Compare>
+struct pair_key_compare {
+  Compare comp;
+
+  template <typename X, typename Y>
+  bool operator()(const X& x, const Y& y) {
+    return comp(x.first, y.first);
+  }
+};
+
+}  // namespace detail
+
+// Joins of flat_maps on keys, see merge_join for ranges. The callbacks get
+// the (key, value) pairs.
+template <typename Key, typename V1, typename V2, typename Comparator,
+          typename U1, typename U2, typename Callback>
+Callback merge_join(const flat_map<Key, V1, Comparator, U1>& x,
+                    const flat_map<Key, V2, Comparator, U2>& y,
+                    Callback callback) {
+  return merge_join(x.begin(), x.end(), y.begin(), y.end(),
+                    detail::pair_key_compare<Comparator>{x.key_comp()},
+                    callback);
+}
+
+template <typename Key, typename V1, typename V2, typename Comparator,
+          typename U1, typename U2, typename Callback>
+Callback merge_join_left(const flat_map<Key, V1, Comparator, U1>& x,
+                         const flat_map<Key, V2, Comparator, U2>& y,
+                         Callback callback) {
+  return merge_join_left(x.begin(), x.end(), y.begin(), y.end(),
+                         detail::pair_key_compare<Comparator>{x.key_comp()},
+                         callback);
+}
+
+template <typename Key, typename V1, typename V2, typename Comparator,
+          typename U1, typename U2, typename Callback>
+Callback merge_join_anti(const flat_map<Key, V1, Comparator, U1>& x,
+                         const flat_map<Key, V2, Comparator, U2>& y,
+                         Callback callback) {
+  return merge_join_anti(x.begin(), x.end(), y.begin(), y.end(),
+                         detail::pair_key_compare<Comparator>{x.key_comp()},
+                         callback);
+}
+
+// prefix_sum_flat_map --------------------------------------------------------
+
+// flat_map that keeps prefix sums of its values next to the body, so that
+// the sum of values for keys in [lo, hi) costs two lower_bounds and one
+// subtraction. Value requires +, - and a zero Value{}.
+//
+// Values can only be changed through the map: iterators are const. Inserts,
+// erases and value updates cost O(n) to fix the sums after the position -
+// the same order as the element shift. Bulk operations recompute the sums in
+// one pass. For floating point values updates accumulate rounding errors,
+// recompute_sums() starts over.
+template <typename Key, typename Value, typename Compare = less>
+class prefix_sum_flat_map {
+ public:
+  using flat_map_type = flat_map<Key, Value, Compare>;
+  using key_type = Key;
+  using mapped_type = Value;
+  using value_type = typename flat_map_type::value_type;
+  using size_type = typename flat_map_type::size_type;
+  using key_compare = Compare;
+  using value_compare = typename flat_map_type::value_compare;
+  using const_iterator = typename flat_map_type::const_iterator;
+  using iterator = const_iterator;
+
+  prefix_sum_flat_map() : sums_(1) {}
+  explicit prefix_sum_flat_map(const key_compare& comp)
+      : body_(comp), sums_(1) {}
+
+  template <typename I>
+  // requires InputIterator<I>
+  prefix_sum_flat_map(I f, I l, const key_compare& comp = key_compare())
+      : body_(f, l, comp) {
+    recompute_sums();
+  }
+
+  prefix_sum_flat_map(std::initializer_list<value_type> il,
+                      const key_compare& comp = key_compare())
+      : prefix_sum_flat_map(il.begin(), il.end(), comp) {}
+
+  //---------------------------------------------------------------------------
+  // Iterators.
+
+  const_iterator begin() const { return body_.begin(); }
+  const_iterator cbegin() const { return begin(); }
+  const_iterator end() const { return body_.end(); }
+  const_iterator cend() const { return end(); }
+
+  //---------------------------------------------------------------------------
+  // Size.
+
+  size_type size() const { return body_.size(); }
+  bool empty() const { return body_.empty(); }
+
+  void clear() {
+    body_.clear();
+    sums_.assign(1, mapped_type{});
+  }
+
+  //---------------------------------------------------------------------------
+  // Modifiers.
+
+  std::pair<const_iterator, bool> insert(value_type v) {
+    reserve_sum();
+    auto res = body_.insert(std::move(v));
+    if (res.second) on_inserted(index_of(res.first));
+    return res;
+  }
+
+  std::pair<const_iterator, bool> insert_or_assign(const key_type& k,
+                                                   const mapped_type& m) {
+    auto pos = body_.lower_bound(k);
+    if (pos == body_.end() || key_comp()(k, pos->first))
+      return insert(value_type(k, m));
+
+    add_after(index_of(pos), m - pos->second);
+    pos->second = m;
+    return {pos, false};
+  }
+
+  // Adds |delta| to the value of |k|, inserting k first if needed.
+  const_iterator add(const key_type& k, const mapped_type& delta) {
+    reserve_sum();
+    auto res = body_.try_emplace(k);
+    auto pos = res.first;
+    if (res.second) on_inserted(index_of(pos));
+    pos->second = pos->second + delta;
+    add_after(index_of(pos), delta);
+    return pos;
+  }
+
+  template <typename I>
+  // requires InputIterator<I>
+  void insert(I f, I l) {
+    body_.insert(f, l);
+    on_bulk_change();
+  }
+
+  template <typename I, typename = IteratorCategory<I>>
+  // requires InputIterator<I>
+  void insert_or_assign(I f, I l) {
+    body_.insert_or_assign(f, l);
+    on_bulk_change();
+  }
+
+  template <typename F>
+  // requires BinaryFunction<F(mapped_type, mapped_type)>
+  void merge_combine(const flat_map_type& other, F combine) {
+    body_.merge_combine(other, combine);
+    on_bulk_change();
+  }
+
+  const_iterator erase(const_iterator pos) {
+    size_type idx = index_of(pos);
+    add_after(idx, mapped_type{} - pos->second);
+    sums_.erase(sums_.begin() + static_cast<std::ptrdiff_t>(idx) + 1);
+    return body_.erase(pos);
+  }
+
+  template <typename K>
+  size_type erase(const K& k) {
+    auto pos = find(k);
+    if (pos == end()) return 0;
+    erase(pos);
+    return 1;
+  }
+
+  void recompute_sums() {
+    sums_.resize(body_.size() + 1);
+    for (size_type i = 0; i != body_.size(); ++i)
+      sums_[i + 1] = sums_[i] + body_.body()[i].second;
+  }
+
+  //---------------------------------------------------------------------------
+  // Search.
+
+  template <typename K>
+  size_type count(const K& k) const {
+    return body_.count(k);
+  }
+
+  template <typename K>
+  const_iterator find(const K& k) const {
+    return body_.find(k);
+  }
+
+  template <typename K>
+  const_iterator lower_bound(const K& k) const {
+    return body_.lower_bound(k);
+  }
+
+  template <typename K>
+  const_iterator upper_bound(const K& k) const {
+    return body_.upper_bound(k);
+  }
+
+  //---------------------------------------------------------------------------
+  // Aggregates.
+
+  // Sum of the values before |pos|.
+  const mapped_type& prefix_sum(const_iterator pos) const {
+    return sums_[index_of(pos)];
+  }
+
+  // Sum of the values in [f, l).
+  mapped_type sum(const_iterator f, const_iterator l) const {
+    return prefix_sum(l) - prefix_sum(f);
+  }
+
+  // Sum of the values for keys in [lo, hi). Empty if hi is before lo.
+  template <typename K>
+  mapped_type range_sum(const K& lo, const K& hi) const {
+    if (key_comp()(hi, lo)) return mapped_type();
+    return sum(lower_bound(lo), lower_bound(hi));
+  }
+
+  // Number of keys in [lo, hi). Empty if hi is before lo.
+  template <typename K>
+  size_type range_count(const K& lo, const K& hi) const {
+    if (key_comp()(hi, lo)) return 0;
+    return index_of(lower_bound(hi)) - index_of(lower_bound(lo));
+  }
+
+  //---------------------------------------------------------------------------
+  // Getters.
+
+  key_compare key_comp() const { return body_.key_comp(); }
+  value_compare value_comp() const { return body_.value_comp(); }
+
+  const flat_map_type& body() const { return body_; }
+
+  friend bool operator==(const prefix_sum_flat_map& x,
+                         const prefix_sum_flat_map& y) {
+    return x.body_ == y.body_;
+  }
+
+  friend bool operator!=(const prefix_sum_flat_map& x,
+                         const prefix_sum_flat_map& y) {
+    return !(x == y);
+  }
+
+ private:
+  size_type index_of(const_iterator pos) const {
+    return static_cast<size_type>(pos - body_.begin());
+  }
+
+  // Called before a single insert changes the body, so that on_inserted does
+  // not allocate. Grows geometrically.
+  void reserve_sum() {
+    if (sums_.size() == sums_.capacity()) sums_.reserve(2 * sums_.size());
+  }
+
+  // A bulk change cannot be undone: if the sums cannot be rebuilt, the map is
+  // cleared rather than left with sums that do not match the body.
+  void on_bulk_change() {
+    try {
+      recompute_sums();
+    } catch (...) {
+      clear();
+      throw;
+    }
+  }
+
+  // The element at |idx| is new and holds its value.
+  void on_inserted(size_type idx) {
+    mapped_type before = sums_[idx];
+    sums_.insert(sums_.begin() + static_cast<std::ptrdiff_t>(idx) + 1,
+                 std::move(before));
+    add_after(idx, body_.body()[idx].second);
+  }
+
+  // Adds |delta| to the sums that include the element at |idx|.
+  void add_after(size_type idx, const mapped_type& delta) {
+    for (size_type i = idx + 1; i != sums_.size(); ++i)
+      sums_[i] = sums_[i] + delta;
+  }
+
+  flat_map_type body_;
+  // sums_[i] is the sum of the first i values.
+  std::vector<mapped_type> sums_;
+};
+
+// slab_flat_map --------------------------------------------------------------
+
+namespace detail {
+
+// Objects addressed by 32 bit slots. Memory comes in fixed size chunks, so
+// objects never move. Erased slots are reused by the next emplace.
+// The slab does not know which slots are alive: the owner destroys them.
+template <typename T>
+class value_slab {
+ public:
+  using slot_type = std::uint32_t;
+
+  value_slab() = default;
+  value_slab(value_slab&& x) noexcept
+      : chunks_(std::move(x.chunks_)),
+        free_(std::move(x.free_)),
+        size_(x.size_) {
+    x.free_.clear();
+    x.size_ = 0;
+  }
+
+  T& operator[](slot_type slot) { return *address(slot); }
+  const T& operator[](slot_type slot) const { return *address(slot); }
+
+  template <typename... Args>
+  slot_type emplace(Args&&... args) {
+    const bool reuse = !free_.empty();
+    slot_type slot = reuse ? free_.back() : size_;
+    if (!reuse) {
+      // The largest slot_type is left for the users to mark released slots.
+      if (size_ == std::numeric_limits<slot_type>::max())
+        throw std::length_error("value_slab: out of slots");
+      if (slot / kChunkSize == chunks_.size()) {
+        std::unique_ptr<storage[]> chunk(new storage[kChunkSize]);
+        chunks_.push_back(std::move(chunk));
+      }
+    }
+
+    ::new (static_cast<void*>(address(slot))) T(std::forward<Args>(args)...);
+    if (reuse)
+      free_.pop_back();
+    else
+      ++size_;
+    return slot;
+  }
+
+  void erase(slot_type slot) {
+    address(slot)->~T();
+    free_.push_back(slot);
+  }
+
+  // All objects have to be destroyed already. Keeps the memory.
+  void reset() {
+    free_.clear();
+    size_ = 0;
+  }
+
+  void swap(value_slab& x) noexcept {
+    chunks_.swap(x.chunks_);
+    free_.swap(x.free_);
+    std::swap(size_, x.size_);
+  }
+
+  // Slots ever used, including the free ones.
+  slot_type slot_count() const { return size_; }
+  slot_type free_count() const { return static_cast<slot_type>(free_.size()); }
+
+ private:
+  static constexpr slot_type kChunkSize = 64;
+  using storage = typename std::aligned_storage<sizeof(T), alignof(T)>::type;
+
+  T* address(slot_type slot) const {
+    return reinterpret_cast<T*>(&chunks_[slot / kChunkSize][slot % kChunkSize]);
+  }
+
+  std::vector<std::unique_ptr<storage[]>> chunks_;
+  std::vector<slot_type> free_;
+  slot_type size_ = 0;
+};
+
+// operator-> for iterators that return proxies by value.
+template <typename Reference>
+struct arrow_proxy {
+  Reference ref;
+
+  Reference* operator->() { return &ref; }
+};
+
+}  // namespace detail
+
+// Map for large values: the sorted array holds keys and 32 bit slots, values
+// live in a slab and never move. Inserts shift and merges move only
+// (key, slot) pairs. Lookups are one binary search plus one indirection.
+// Slots of erased values are reused.
+//
+// Iterators return pair<const Key&, Value&> proxies by value.
+template <typename Key, typename Value, typename Compare = less>
+class slab_flat_map {
+  using slab_type = detail::value_slab<Value>;
+  using slot_type = typename slab_type::slot_type;
+
+ public:
+  using index_type = flat_map<Key, slot_type, Compare>;
+  using key_type = Key;
+  using mapped_type = Value;
+  using value_type = std::pair<Key, Value>;
+  using size_type = typename index_type::size_type;
+  using difference_type = typename index_type::difference_type;
+  using key_compare = Compare;
+
+ private:
+  template <bool is_const>
+  class iterator_impl {
+    using index_iterator =
+        typename std::conditional<is_const,
+                                  typename index_type::const_iterator,
+                                  typename index_type::iterator>::type;
+    using slab_pointer =
+        typename std::conditional<is_const, const slab_type*,
+                                  slab_type*>::type;
+    using mapped_reference =
+        typename std::conditional<is_const, const Value&, Value&>::type;
+
+   public:
+    using iterator_category = std::bidirectional_iterator_tag;
+    using value_type = std::pair<Key, Value>;
+    using difference_type = std::ptrdiff_t;
+    using reference = std::pair<const Key&, mapped_reference>;
+    using pointer = detail::arrow_proxy<reference>;
+
+    iterator_impl() = default;
+
+    // Mutable to const conversion.
+    template <bool other_const, typename = typename std::enable_if<
+                                    is_const && !other_const>::type>
+    iterator_impl(const iterator_impl<other_const>& x)
+        : it_{x.it_}, slab_{x.slab_} {}
+
+    reference operator*() const { return {it_->first, (*slab_)[it_->second]}; }
+    pointer operator->() const { return {**this}; }
+
+    iterator_impl& operator++() {
+      ++it_;
+      return *this;
+    }
+
+    iterator_impl operator++(int) {
+      iterator_impl tmp = *this;
+      operator++();
+      return tmp;
+    }
+
+    iterator_impl& operator--() {
+      --it_;
+      return *this;
+    }
+
+    iterator_impl operator--(int) {
+      iterator_impl tmp = *this;
+      operator--();
+      return tmp;
+    }
+
+    friend bool operator==(const iterator_impl& x, const iterator_impl& y) {
+      return x.it_ == y.it_;
+    }
+
+    friend bool operator!=(const iterator_impl& x, const iterator_impl& y) {
+      return !(x == y);
+    }
+
+   private:
+    friend class slab_flat_map;
+    template <bool>
+    friend class iterator_impl;
+
+    iterator_impl(index_iterator it, slab_pointer slab)
+        : it_{it}, slab_{slab} {}
+
+    index_iterator it_;
+    slab_pointer slab_ = nullptr;
+  };
+
+ public:
+  using iterator = iterator_impl<false>;
+  using const_iterator = iterator_impl<true>;
+
+  slab_flat_map() = default;
+  explicit slab_flat_map(const key_compare& comp) : index_(comp) {}
+
+  template <typename I>
+  // requires InputIterator<I>
+  slab_flat_map(I f, I l, const key_compare& comp = key_compare())
+      : index_(comp) {
+    insert(f, l);
+  }
+
+  slab_flat_map(std::initializer_list<value_type> il,
+                const key_compare& comp = key_compare())
+      : slab_flat_map(il.begin(), il.end(), comp) {}
+
+  slab_flat_map(const slab_flat_map& x) : index_(x.index_) {
+    auto& entries = index_.body();
+    size_type copied = 0;
+    try {
+      for (; copied != entries.size(); ++copied)
+        entries[copied].second = slab_.emplace(x.slab_[entries[copied].second]);
+    } catch (...) {
+      for (size_type i = 0; i != copied; ++i) slab_[entries[i].second].~Value();
+      throw;
+    }
+  }
+
+  slab_flat_map(slab_flat_map&& x) noexcept
+      : index_(std::move(x.index_)), slab_(std::move(x.slab_)) {
+    x.index_.clear();
+  }
+
+  slab_flat_map& operator=(slab_flat_map x) noexcept {
+    swap(x);
+    return *this;
+  }
+
+  ~slab_flat_map() { clear(); }
+
+  //---------------------------------------------------------------------------
+  // Iterators.
+
+  iterator begin() { return make_iterator(index_.begin()); }
+  const_iterator begin() const { return make_iterator(index_.begin()); }
+  const_iterator cbegin() const { return begin(); }
+
+  iterator end() { return make_iterator(index_.end()); }
+  const_iterator end() const { return make_iterator(index_.end()); }
+  const_iterator cend() const { return end(); }
+
+  //---------------------------------------------------------------------------
+  // Size.
+
+  size_type size() const { return index_.size(); }
+  bool empty() const { return index_.empty(); }
+
+  void clear() {
+    for (const auto& entry : index_) slab_[entry.second].~Value();
+    index_.clear();
+    slab_.reset();
+  }
+
+  // Slots ever used and the ones waiting for reuse.
+  size_type slot_count() const { return slab_.slot_count(); }
+  size_type free_slot_count() const { return slab_.free_count(); }
+
+  //---------------------------------------------------------------------------
+  // Element access.
+
+  mapped_type& operator[](const key_type& k) {
+    return (*try_emplace(k).first).second;
+  }
+
+  //---------------------------------------------------------------------------
+  // Insert operations.
+
+  template <typename... Args>
+  std::pair<iterator, bool> try_emplace(const key_type& k, Args&&... args) {
+    auto pos = index_.lower_bound(k);
+    if (pos != index_.end() && !key_comp()(k, pos->first))
+      return {make_iterator(pos), false};
+
+    slot_type slot = slab_.emplace(std::forward<Args>(args)...);
+    try {
+      pos = index_.body().emplace(pos, k, slot);
+    } catch (...) {
+      slab_.erase(slot);
+      throw;
+    }
+    return {make_iterator(pos), true};
+  }
+
+  std::pair<iterator, bool> insert(const value_type& v) {
+    return try_emplace(v.first, v.second);
+  }
+
+  std::pair<iterator, bool> insert(value_type&& v) {
+    return try_emplace(v.first, std::move(v.second));
+  }
+
+  // Values of new keys go to the slab as they are read. Their (key, slot)
+  // pairs are then sorted and merged into the index in one pass, like
+  // flat_map::insert(f, l). Of equal keys the first one is kept.
+  template <typename I>
+  // requires InputIterator<I>
+  void insert(I f, I l) {
+    std::vector<key_type> keys;
+    std::vector<slot_type> slots;
+    try {
+      for (; f != l; ++f) {
+        Reference<I> v = *f;
+        if (index_.count(v.first)) continue;
+        keys.push_back(v.first);
+        // Grows with keys, so that the push_back below cannot throw.
+        if (slots.capacity() < keys.capacity()) slots.reserve(keys.capacity());
+        slots.push_back(slab_.emplace(std::forward<Reference<I>>(v).second));
+      }
+      merge_batch(keys, slots);
+    } catch (...) {
+      release_batch(slots);
+      throw;
+    }
+  }
+
+  void insert(std::initializer_list<value_type> il) {
+    insert(il.begin(), il.end());
+  }
+
+  template <typename M>
+  std::pair<iterator, bool> insert_or_assign(const key_type& k, M&& m) {
+    auto res = try_emplace(k, std::forward<M>(m));
+    if (!res.second) (*res.first).second = std::forward<M>(m);
+    return res;
+  }
+
+  // --------------------------------------------------------------------------
+  // Erase operations.
+
+  iterator erase(iterator pos) { return erase(const_iterator(pos)); }
+
+  iterator erase(const_iterator pos) {
+    slab_.erase(pos.it_->second);
+    return make_iterator(index_.erase(pos.it_));
+  }
+
+  template <typename K>
+  size_type erase(const K& k) {
+    auto pos = index_.find(k);
+    if (pos == index_.end()) return 0;
+    erase(make_iterator(pos));
+    return 1;
+  }
+
+  // --------------------------------------------------------------------------
+  // Search operations.
+
+  template <typename K>
+  size_type count(const K& k) const {
+    return index_.count(k);
+  }
+
+  template <typename K>
+  iterator find(const K& k) {
+    return make_iterator(index_.find(k));
+  }
+
+  template <typename K>
+  const_iterator find(const K& k) const {
+    return make_iterator(index_.find(k));
+  }
+
+  template <typename K>
+  iterator lower_bound(const K& k) {
+    return make_iterator(index_.lower_bound(k));
+  }
+
+  template <typename K>
+  const_iterator lower_bound(const K& k) const {
+    return make_iterator(index_.lower_bound(k));
+  }
+
+  template <typename K>
+  iterator upper_bound(const K& k) {
+    return make_iterator(index_.upper_bound(k));
+  }
+
+  template <typename K>
+  const_iterator upper_bound(const K& k) const {
+    return make_iterator(index_.upper_bound(k));
+  }
+
+  //---------------------------------------------------------------------------
+  // Getters.
+
+  key_compare key_comp() const { return index_.key_comp(); }
+
+  const index_type& index() const { return index_; }
+
+  //---------------------------------------------------------------------------
+  // General operations.
+
+  void swap(slab_flat_map& x) noexcept {
+    index_.swap(x.index_);
+    slab_.swap(x.slab_);
+  }
+
+  friend void swap(slab_flat_map& x, slab_flat_map& y) noexcept { x.swap(y); }
+
+  friend bool operator==(const slab_flat_map& x, const slab_flat_map& y) {
+    if (x.size() != y.size()) return false;
+    for (auto it = x.begin(), jt = y.begin(); it != x.end(); ++it, ++jt) {
+      if (!((*it).first == (*jt).first) || !((*it).second == (*jt).second))
+        return false;
+    }
+    return true;
+  }
+
+  friend bool operator!=(const slab_flat_map& x, const slab_flat_map& y) {
+    return !(x == y);
+  }
+
+ private:
+  iterator make_iterator(typename index_type::iterator it) {
+    return {it, &slab_};
+  }
+
+  const_iterator make_iterator(typename index_type::const_iterator it) const {
+    return {it, &slab_};
+  }
+
+  static constexpr slot_type kReleased = std::numeric_limits<slot_type>::max();
+
+  // Sorts a batch of new keys, read in order, and merges it into the index.
+  // Slots of the repeated keys are released.
+  void merge_batch(std::vector<key_type>& keys,
+                   std::vector<slot_type>& slots) {
+    std::vector<size_type> order(keys.size());
+    for (size_type i = 0; i != order.size(); ++i) order[i] = i;
+    std::stable_sort(order.begin(), order.end(),
+                     [&](size_type x, size_type y) {
+                       return key_comp()(keys[x], keys[y]);
+                     });
+
+    std::vector<std::pair<key_type, slot_type>> batch;
+    batch.reserve(order.size());
+    for (size_type i : order) {
+      if (!batch.empty() && !key_comp()(batch.back().first, keys[i])) {
+        slab_.erase(slots[i]);
+        slots[i] = kReleased;
+        continue;
+      }
+      batch.emplace_back(std::move(keys[i]), slots[i]);
+    }
+    index_.insert(std::make_move_iterator(batch.begin()),
+                  std::make_move_iterator(batch.end()));
+  }
+
+  // Destroys the values of a batch that did not make it to the index. A
+  // throwing merge can leave some of them there.
+  void release_batch(const std::vector<slot_type>& slots) {
+    std::vector<bool> in_index(slab_.slot_count(), false);
+    for (const auto& entry : index_) in_index[entry.second] = true;
+    for (slot_type slot : slots) {
+      if (slot != kReleased && !in_index[slot]) slab_.erase(slot);
+    }
+  }
+
+  index_type index_;
+  slab_type slab_;
+};
+
+// soa_flat_map ---------------------------------------------------------------
+
+namespace detail {
+
+// std::index_sequence is C++14.
+template <std::size_t... Is>
+struct index_list {};
+
+template <std::size_t N, std::size_t... Is>
+struct make_index_list_impl : make_index_list_impl<N - 1, N - 1, Is...> {};
+
+template <std::size_t... Is>
+struct make_index_list_impl<0, Is...> {
+  using type = index_list<Is...>;
+};
+
+template <std::size_t N>
+using make_index_list = typename make_index_list_impl<N>::type;
+
+// Appends v[order[0]], v[order[1]], ... to |res|, which has the capacity
+// for them. Elements are moved only if that cannot throw, so |v| is intact
+// if this throws.
+template <typename T, typename Index>
+void gather(std::vector<T>& v, const std::vector<Index>& order,
+            std::vector<T>& res) {
+  for (Index i : order) res.push_back(std::move_if_noexcept(v[i]));
+}
+
+// A single row insert(k, v) must not be taken for insert(f, l).
+template <typename I, typename Key>
+using row_range_should_be_enabled =
+    typename std::enable_if<!std::is_convertible<I, Key>::value>::type;
+
+}  // namespace detail
+
+// Flat map where every value column is a separate vector: soa_flat_map<Key,
+// std::tuple<Timestamp, Flags, Weight>>. A scan over one column reads only
+// that column. Elements are addressed by position: find/lower_bound return
+// indices and find returns size() for a missing key.
+//
+// Bulk insert appends the rows, sorts and merges indices only and then
+// applies the resulting permutation to every column once.
+template <typename Key, typename Columns, typename Compare = less>
+class soa_flat_map;
+
+template <typename Key, typename... Columns, typename Compare>
+class soa_flat_map<Key, std::tuple<Columns...>, Compare> {
+  using columns_indices = detail::make_index_list<sizeof...(Columns)>;
+
+ public:
+  using key_type = Key;
+  using row_type = std::tuple<Key, Columns...>;
+  using size_type = std::size_t;
+  using key_compare = Compare;
+
+  template <std::size_t I>
+  using column_type =
+      typename std::tuple_element<I, std::tuple<Columns...>>::type;
+
+  soa_flat_map() = default;
+  explicit soa_flat_map(const key_compare& comp) : comp_(comp) {}
+
+  template <typename I>
+  // requires InputIterator<I> && ValueType<I> is row_type
+  soa_flat_map(I f, I l, const key_compare& comp = key_compare())
+      : comp_(comp) {
+    insert(f, l);
+  }
+
+  soa_flat_map(std::initializer_list<row_type> il,
+               const key_compare& comp = key_compare())
+      : soa_flat_map(il.begin(), il.end(), comp) {}
+
+  //---------------------------------------------------------------------------
+  // Size and memory.
+
+  size_type size() const { return keys_.size(); }
+  bool empty() const { return keys_.empty(); }
+
+  void clear() {
+    keys_.clear();
+    clear_columns(columns_indices{});
+  }
+
+  void reserve(size_type new_capacity) {
+    keys_.reserve(new_capacity);
+    reserve_columns(new_capacity, columns_indices{});
+  }
+
+  //---------------------------------------------------------------------------
+  // Columns.
+
+  const std::vector<Key>& keys() const { return keys_; }
+
+  // Values can be changed in place, the size must not.
+  template <std::size_t I>
+  std::vector<column_type<I>>& column() {
+    return std::get<I>(columns_);
+  }
+
+  template <std::size_t I>
+  const std::vector<column_type<I>>& column() const {
+    return std::get<I>(columns_);
+  }
+
+  //---------------------------------------------------------------------------
+  // Insert operations.
+
+  std::pair<size_type, bool> insert(const Key& k, Columns... values) {
+    size_type pos = lower_bound(k);
+    if (pos != size() && !comp_(k, keys_[pos])) return {pos, false};
+
+    keys_.insert(keys_.begin() + static_cast<std::ptrdiff_t>(pos), k);
+    size_type inserted = 0;
+    try {
+      insert_columns(pos, std::forward_as_tuple(std::move(values)...),
+                     inserted, columns_indices{});
+    } catch (...) {
+      keys_.erase(keys_.begin() + static_cast<std::ptrdiff_t>(pos));
+      erase_columns(pos, inserted, columns_indices{});
+      throw;
+    }
+    return {pos, true};
+  }
+
+  std::pair<size_type, bool> insert_or_assign(const Key& k,
+                                              Columns... values) {
+    size_type pos = lower_bound(k);
+    if (pos == size() || comp_(k, keys_[pos]))
+      return insert(k, std::move(values)...);
+
+    assign_columns(pos, std::forward_as_tuple(std::move(values)...),
+                   columns_indices{});
+    return {pos, false};
+  }
+
+  // Existing keys win, as in flat_map. If anything throws, the map is left
+  // as it was.
+  template <typename I,
+            typename = detail::row_range_should_be_enabled<I, Key>>
+  // requires InputIterator<I> && ValueType<I> is row_type
+  void insert(I f, I l) {
+    const size_type orig_len = size();
+    std::vector<Key> new_keys;
+    std::tuple<std::vector<Columns>...> new_columns;
+    try {
+      for (; f != l; ++f) append_row(*f, columns_indices{});
+      if (orig_len == size()) return;
+
+      std::vector<size_type> indices(size());
+      for (size_type i = 0; i != size(); ++i) indices[i] = i;
+
+      auto m = indices.begin() + static_cast<std::ptrdiff_t>(orig_len);
+      auto by_key = [this](size_type x, size_type y) {
+        return comp_(keys_[x], keys_[y]);
+      };
+      std::stable_sort(m, indices.end(), by_key);
+      auto new_l = std::unique(m, indices.end(), not_fn(by_key));
+
+      std::vector<size_type> order;
+      order.reserve(static_cast<size_type>(new_l - indices.begin()));
+      set_union_unique_biased(indices.begin(), m, m, new_l,
+                              std::back_inserter(order), by_key);
+
+      gather_rows(order, new_keys, new_columns, columns_indices{});
+    } catch (...) {
+      truncate(orig_len, columns_indices{});
+      throw;
+    }
+    keys_.swap(new_keys);
+    columns_.swap(new_columns);
+  }
+
+  void insert(std::initializer_list<row_type> il) {
+    insert(il.begin(), il.end());
+  }
+
+  // --------------------------------------------------------------------------
+  // Erase operations.
+
+  void erase_at(size_type pos) {
+    keys_.erase(keys_.begin() + static_cast<std::ptrdiff_t>(pos));
+    erase_columns(pos, sizeof...(Columns), columns_indices{});
+  }
+
+  template <typename K>
+  size_type erase(const K& k) {
+    size_type pos = find(k);
+    if (pos == size()) return 0;
+    erase_at(pos);
+    return 1;
+  }
+
+  // --------------------------------------------------------------------------
+  // Search operations.
+
+  template <typename K>
+  size_type lower_bound(const K& k) const {
+    return static_cast<size_type>(
+        std::lower_bound(keys_.begin(), keys_.end(), k, comp_) -
+        keys_.begin());
+  }
+
+  template <typename K>
+  size_type upper_bound(const K& k) const {
+    return static_cast<size_type>(
+        std::upper_bound(keys_.begin(), keys_.end(), k, comp_) -
+        keys_.begin());
+  }
+
+  template <typename K>
+  size_type find(const K& k) const {
+    size_type pos = lower_bound(k);
+    if (pos == size() || comp_(k, keys_[pos])) return size();
+    return pos;
+  }
+
+  template <typename K>
+  size_type count(const K& k) const {
+    return find(k) != size() ? 1 : 0;
+  }
+
+  //---------------------------------------------------------------------------
+  // Getters.
+
+  key_compare key_comp() const { return comp_; }
+
+  friend bool operator==(const soa_flat_map& x, const soa_flat_map& y) {
+    return x.keys_ == y.keys_ && x.columns_ == y.columns_;
+  }
+
+  friend bool operator!=(const soa_flat_map& x, const soa_flat_map& y) {
+    return !(x == y);
+  }
+
+ private:
+  // The pack expansions below call a function for every column.
+  using expand = int[];
+
+  template <std::size_t... Is>
+  void clear_columns(detail::index_list<Is...>) {
+    (void)expand{0, (std::get<Is>(columns_).clear(), 0)...};
+  }
+
+  template <std::size_t... Is>
+  void reserve_columns(size_type n, detail::index_list<Is...>) {
+    (void)expand{0, (std::get<Is>(columns_).reserve(n), 0)...};
+  }
+
+  // Counts the columns done in |inserted|, for the rollback.
+  template <typename Values, std::size_t... Is>
+  void insert_columns(size_type pos, Values values, size_type& inserted,
+                      detail::index_list<Is...>) {
+    (void)expand{0, (std::get<Is>(columns_).insert(
+                         std::get<Is>(columns_).begin() +
+                             static_cast<std::ptrdiff_t>(pos),
+                         std::move(std::get<Is>(values))),
+                     ++inserted, 0)...};
+  }
+
+  template <typename Values, std::size_t... Is>
+  void assign_columns(size_type pos, Values values, detail::index_list<Is...>) {
+    (void)expand{0, (std::get<Is>(columns_)[pos] =
+                         std::move(std::get<Is>(values)),
+                     0)...};
+  }
+
+  template <typename Row, std::size_t... Is>
+  void append_row(Row&& row, detail::index_list<Is...>) {
+    keys_.push_back(std::get<0>(std::forward<Row>(row)));
+    (void)expand{0, (std::get<Is>(columns_).push_back(
+                         std::get<Is + 1>(std::forward<Row>(row))),
+                     0)...};
+  }
+
+  // Erases |pos| from the first |n| columns.
+  template <std::size_t... Is>
+  void erase_columns(size_type pos, size_type n, detail::index_list<Is...>) {
+    (void)expand{0, (Is < n ? (void)std::get<Is>(columns_).erase(
+                                  std::get<Is>(columns_).begin() +
+                                  static_cast<std::ptrdiff_t>(pos))
+                            : (void)0,
+                     0)...};
+  }
+
+  // Drops the rows after the first |n|, including incomplete ones.
+  template <std::size_t... Is>
+  void truncate(size_type n, detail::index_list<Is...>) {
+    const auto offset = static_cast<std::ptrdiff_t>(n);
+    keys_.erase(keys_.begin() + offset, keys_.end());
+    (void)expand{0, (std::get<Is>(columns_).erase(
+                         std::get<Is>(columns_).begin() + offset,
+                         std::get<Is>(columns_).end()),
+                     0)...};
+  }
+
+  // Vectors whose elements are copied, because their moves can throw, are
+  // gathered first: once the first one is moved from, nothing throws.
+  template <std::size_t... Is>
+  void gather_rows(const std::vector<size_type>& order,
+                   std::vector<Key>& new_keys,
+                   std::tuple<std::vector<Columns>...>& new_columns,
+                   detail::index_list<Is...>) {
+    new_keys.reserve(order.size());
+    (void)expand{0, (std::get<Is>(new_columns).reserve(order.size()), 0)...};
+
+    for (bool moves : {false, true}) {
+      if (moves == std::is_nothrow_move_constructible<Key>::value)
+        detail::gather(keys_, order, new_keys);
+      (void)expand{
+          0, (moves == std::is_nothrow_move_constructible<
+                           column_type<Is>>::value
+                  ? detail::gather(std::get<Is>(columns_), order,
+                                   std::get<Is>(new_columns))
+                  : void(),
+              0)...};
+    }
+  }
+
+  Compare comp_;
+  std::vector<Key> keys_;
+  std::tuple<std::vector<Columns>...> columns_;
+};
+
+// string_flat_set ------------------------------------------------------------
+
+namespace detail {
+
+// The first 8 characters as a big-endian integer. Shorter strings are padded
+// with zeroes, which keeps the integer order the same as the lexicographic
+// one; equal prefixes need the full strings to break the tie.
+inline std::uint64_t string_prefix(const char* s, std::size_t n) {
+  std::uint64_t res = 0;
+  for (std::size_t i = 0; i != sizeof(res); ++i) {
+    res <<= 8;
+    if (i < n) res |= static_cast<unsigned char>(s[i]);
+  }
+  return res;
+}
+
+// Three-way comparison of two strings with equal string_prefix: the first
+// 8 characters are skipped.
+inline int compare_after_prefix(const char* x, std::size_t x_n, const char* y,
+                                std::size_t y_n) {
+  constexpr std::size_t kPrefixSize = sizeof(std::uint64_t);
+  const std::size_t n = std::min(x_n, y_n);
+  if (n > kPrefixSize) {
+    int res = std::memcmp(x + kPrefixSize, y + kPrefixSize, n - kPrefixSize);
+    if (res != 0) return res;
+  }
+  if (x_n == y_n) return 0;
+  return x_n < y_n ? -1 : 1;
+}
+
+}  // namespace detail
+
+// Set of strings in lexicographic order with all characters packed into one
+// arena. The sorted array holds 16 byte records: offset and size in the arena
+// and the first 8 characters as a big-endian integer, so most comparisons in
+// a search are settled without touching the arena.
+//
+// Characters of erased and duplicate strings stay in the arena until they
+// outweigh the live ones; then the arena is rebuilt in sorted order.
+//
+// Iterators return views of the characters, valid until the next
+// modification.
+class string_flat_set {
+  struct record {
+    std::uint64_t prefix;
+    std::uint32_t offset;
+    std::uint32_t size;
+  };
+
+ public:
+  using value_type = std::string;
+  using size_type = std::size_t;
+  using difference_type = std::ptrdiff_t;
+
+  class reference {
+   public:
+    const char* data() const { return data_; }
+    size_type size() const { return size_; }
+
+    std::string str() const { return std::string(data_, size_); }
+    operator std::string() const { return str(); }
+
+    friend bool operator==(const reference& x, const std::string& y) {
+      return x.size_ == y.size() &&
+             (x.size_ == 0 || std::memcmp(x.data_, y.data(), x.size_) == 0);
+    }
+
+    friend bool operator!=(const reference& x, const std::string& y) {
+      return !(x == y);
+    }
+
+   private:
+    friend class string_flat_set;
+
+    reference(const char* data, size_type size) : data_{data}, size_{size} {}
+
+    const char* data_;
+    size_type size_;
+  };
+
+  class const_iterator {
+   public:
+    using iterator_category = std::bidirectional_iterator_tag;
+    using value_type = std::string;
+    using difference_type = std::ptrdiff_t;
+    using reference = string_flat_set::reference;
+    using pointer = detail::arrow_proxy<reference>;
+
+    const_iterator() = default;
+
+    reference operator*() const {
+      return {arena_ + it_->offset, it_->size};
+    }
+    pointer operator->() const { return {**this}; }
+
+    const_iterator& operator++() {
+      ++it_;
+      return *this;
+    }
+
+    const_iterator operator++(int) {
+      const_iterator tmp = *this;
+      operator++();
+      return tmp;
+    }
+
+    const_iterator& operator--() {
+      --it_;
+      return *this;
+    }
+
+    const_iterator operator--(int) {
+      const_iterator tmp = *this;
+      operator--();
+      return tmp;
+    }
+
+    friend bool operator==(const const_iterator& x, const const_iterator& y) {
+      return x.it_ == y.it_;
+    }
+
+    friend bool operator!=(const const_iterator& x, const const_iterator& y) {
+      return !(x == y);
+    }
+
+   private:
+    friend class string_flat_set;
+
+    const_iterator(const record* it, const char* arena)
+        : it_{it}, arena_{arena} {}
+
+    const record* it_ = nullptr;
+    const char* arena_ = nullptr;
+  };
+
+  using iterator = const_iterator;
+
+  string_flat_set() = default;
+
+  template <typename I>
+  // requires InputIterator<I> && ValueType<I> is convertible to std::string
+  string_flat_set(I f, I l) {
+    insert(f, l);
+  }
+
+  string_flat_set(std::initializer_list<std::string> il)
+      : string_flat_set(il.begin(), il.end()) {}
+
+  //---------------------------------------------------------------------------
+  // Size and memory.
+
+  size_type size() const { return records_.size(); }
+  bool empty() const { return records_.empty(); }
+
+  void clear() {
+    records_.clear();
+    arena_.clear();
+    live_chars_ = 0;
+  }
+
+  // Characters in the arena, including the garbage.
+  size_type arena_size() const { return arena_.size(); }
+
+  // Drops the garbage and lays the characters out in sorted order.
+  void compact() {
+    std::vector<char> arena;
+    arena.reserve(live_chars_);
+    for (record& r : records_) {
+      const char* chars = arena_.data() + r.offset;
+      r.offset = static_cast<std::uint32_t>(arena.size());
+      arena.insert(arena.end(), chars, chars + r.size);
+    }
+    arena_.swap(arena);
+  }
+
+  //---------------------------------------------------------------------------
+  // Iterators.
+
+  const_iterator begin() const { return iterator_at(0); }
+  const_iterator cbegin() const { return begin(); }
+  const_iterator end() const { return iterator_at(size()); }
+  const_iterator cend() const { return end(); }
+
+  //---------------------------------------------------------------------------
+  // Insert operations.
+
+  std::pair<const_iterator, bool> insert(const char* s, size_type n) {
+    const key k = make_key(s, n);
+    size_type pos = lower_bound_pos(k);
+    if (pos != size() && compare(records_[pos], k) == 0)
+      return {iterator_at(pos), false};
+
+    records_.insert(records_.begin() + static_cast<difference_type>(pos),
+                    append(s, n));
+    live_chars_ += n;
+    return {iterator_at(pos), true};
+  }
+
+  std::pair<const_iterator, bool> insert(const std::string& s) {
+    return insert(s.data(), s.size());
+  }
+
+  // New strings are appended to the arena, their records are sorted and
+  // merged into the existing ones in place. Existing strings win: characters
+  // of the duplicates become garbage.
+  template <typename I>
+  // requires InputIterator<I> && ValueType<I> is convertible to std::string
+  void insert(I f, I l) {
+    std::vector<record> added;
+    for (; f != l; ++f) added.push_back(append_element(*f, 0));
+    if (added.empty()) return;
+
+    auto record_less = [this](const record& x, const record& y) {
+      return compare(x, key_of(y)) < 0;
+    };
+    // Equal new strings have the same characters: any of them can stay.
+    auto added_l = sort_and_unique(added.begin(), added.end(), record_less);
+
+    size_type chars = 0;
+    for (auto it = added.begin(); it != added_l; ++it) chars += it->size;
+    detail::insert_sorted_unique_impl(
+        records_, added.begin(), added_l, record_less,
+        [&chars](const record& existing, const record& duplicate) {
+          chars -= duplicate.size;
+          return existing;
+        });
+
+    live_chars_ += chars;
+    maybe_compact();
+  }
+
+  void insert(std::initializer_list<std::string> il) {
+    insert(il.begin(), il.end());
+  }
+
+  // --------------------------------------------------------------------------
+  // Erase operations.
+
+  size_type erase(const char* s, size_type n) {
+    size_type pos = find_pos(make_key(s, n));
+    if (pos == size()) return 0;
+
+    live_chars_ -= records_[pos].size;
+    records_.erase(records_.begin() + static_cast<difference_type>(pos));
+    maybe_compact();
+    return 1;
+  }
+
+  size_type erase(const std::string& s) { return erase(s.data(), s.size()); }
+
+  // --------------------------------------------------------------------------
+  // Search operations.
+
+  const_iterator find(const char* s, size_type n) const {
+    return iterator_at(find_pos(make_key(s, n)));
+  }
+
+  const_iterator find(const std::string& s) const {
+    return find(s.data(), s.size());
+  }
+
+  size_type count(const char* s, size_type n) const {
+    return find_pos(make_key(s, n)) != size() ? 1 : 0;
+  }
+
+  size_type count(const std::string& s) const {
+    return count(s.data(), s.size());
+  }
+
+  const_iterator lower_bound(const std::string& s) const {
+    return iterator_at(lower_bound_pos(make_key(s.data(), s.size())));
+  }
+
+  //---------------------------------------------------------------------------
+  // General operations.
+
+  friend bool operator==(const string_flat_set& x, const string_flat_set& y) {
+    if (x.size() != y.size()) return false;
+    for (size_type i = 0; i != x.size(); ++i) {
+      if (x.compare(x.records_[i], y.key_of(y.records_[i])) != 0)
+        return false;
+    }
+    return true;
+  }
+
+  friend bool operator!=(const string_flat_set& x, const string_flat_set& y) {
+    return !(x == y);
+  }
+
+ private:
+  // A searched string with its prefix computed once.
+  struct key {
+    const char* data;
+    size_type size;
+    std::uint64_t prefix;
+  };
+
+  static key make_key(const char* s, size_type n) {
+    return {s, n, detail::string_prefix(s, n)};
+  }
+
+  key key_of(const record& r) const {
+    return {arena_.data() + r.offset, r.size, r.prefix};
+  }
+
+  // Three-way comparison: the arena is read only when the prefixes match.
+  int compare(const record& r, const key& k) const {
+    if (r.prefix != k.prefix) return r.prefix < k.prefix ? -1 : 1;
+    return detail::compare_after_prefix(arena_.data() + r.offset, r.size,
+                                        k.data, k.size);
+  }
+
+  size_type lower_bound_pos(const key& k) const {
+    auto pos = std::lower_bound(
+        records_.begin(), records_.end(), k,
+        [this](const record& r, const key& x) { return compare(r, x) < 0; });
+    return static_cast<size_type>(pos - records_.begin());
+  }
+
+  size_type find_pos(const key& k) const {
+    size_type pos = lower_bound_pos(k);
+    if (pos == size() || compare(records_[pos], k) != 0) return size();
+    return pos;
+  }
+
+  const_iterator iterator_at(size_type pos) const {
+    return {records_.data() + pos, arena_.data()};
+  }
+
+  // Records keep 32 bit offsets, so the arena is limited to 4GB.
+  record append(const char* s, size_type n) {
+    const size_type old_size = arena_.size();
+    if (n > std::numeric_limits<std::uint32_t>::max() - old_size)
+      throw std::length_error("string_flat_set: arena over 4GB");
+
+    // |s| can point into the arena, which the resize can move.
+    std::less<const char*> less;
+    const char* arena_f = arena_.data();
+    const bool aliased = !less(s, arena_f) && less(s, arena_f + old_size);
+    const size_type offset = aliased ? static_cast<size_type>(s - arena_f) : 0;
+
+    arena_.resize(old_size + n);
+    if (aliased) s = arena_.data() + offset;
+    if (n) std::memcpy(arena_.data() + old_size, s, n);
+    return {detail::string_prefix(s, n), static_cast<std::uint32_t>(old_size),
+            static_cast<std::uint32_t>(n)};
+  }
+
+  // Elements with data() and size() are appended without building a
+  // std::string.
+  template <typename S>
+  auto append_element(const S& s, int)
+      -> decltype(static_cast<const char*>(s.data()),
+                  static_cast<size_type>(s.size()), record()) {
+    return append(s.data(), static_cast<size_type>(s.size()));
+  }
+
+  record append_element(const char* s, long) {
+    return append(s, std::strlen(s));
+  }
+
+  template <typename S>
+  record append_element(const S& s, long) {
+    const std::string& str = s;
+    return append(str.data(), str.size());
+  }
+
+  void maybe_compact() {
+    if (arena_.size() - live_chars_ > live_chars_) compact();
+  }
+
+  std::vector<record> records_;
+  std::vector<char> arena_;
+  size_type live_chars_ = 0;
+};
+
+// prefixed_string_set --------------------------------------------------------
+
+// Sorted std::strings with a side column of their 8 byte prefixes, aligned
+// with the body. Searches binary search the integer column and compare
+// strings only inside a run of equal prefixes. Merges compare
+// (prefix, string) entries, so most comparisons are integer ones.
+//
+// Elements cannot be modified in place: the column would go stale.
+class prefixed_string_set {
+ public:
+  using underlying_type = std::vector<std::string>;
+  using value_type = std::string;
+  using size_type = underlying_type::size_type;
+  using difference_type = underlying_type::difference_type;
+  using const_iterator = underlying_type::const_iterator;
+  using iterator = const_iterator;
+
+  prefixed_string_set() = default;
+
+  template <typename I>
+  // requires InputIterator<I> && ValueType<I> is convertible to std::string
+  prefixed_string_set(I f, I l) {
+    insert(f, l);
+  }
+
+  prefixed_string_set(std::initializer_list<std::string> il)
+      : prefixed_string_set(il.begin(), il.end()) {}
+
+  //---------------------------------------------------------------------------
+  // Size and memory.
+
+  size_type size() const { return body_.size(); }
+  bool empty() const { return body_.empty(); }
+
+  void clear() {
+    body_.clear();
+    prefixes_.clear();
+  }
+
+  void reserve(size_type new_capacity) {
+    body_.reserve(new_capacity);
+    prefixes_.reserve(new_capacity);
+  }
+
+  //---------------------------------------------------------------------------
+  // Iterators.
+
+  const_iterator begin() const { return body_.begin(); }
+  const_iterator cbegin() const { return begin(); }
+  const_iterator end() const { return body_.end(); }
+  const_iterator cend() const { return end(); }
+
+  //---------------------------------------------------------------------------
+  // Insert operations.
+
+  std::pair<const_iterator, bool> insert(std::string s) {
+    const std::uint64_t prefix = detail::string_prefix(s.data(), s.size());
+    size_type pos = lower_bound_pos(prefix, s);
+    if (pos != size() && prefixes_[pos] == prefix && body_[pos] == s)
+      return {begin() + static_cast<difference_type>(pos), false};
+
+    prefixes_.insert(prefixes_.begin() + static_cast<difference_type>(pos),
+                     prefix);
+    return {body_.insert(begin() + static_cast<difference_type>(pos),
+                         std::move(s)),
+            true};
+  }
+
+  // The new strings are sorted as (prefix, string) entries and merged into
+  // the tail in place. Existing strings win.
+  template <typename I>
+  // requires InputIterator<I> && ValueType<I> is convertible to std::string
+  void insert(I f, I l) {
+    underlying_type added(f, l);
+    if (added.empty()) return;
+
+    std::vector<entry> new_entries = entries_of(added, prefixes_of(added));
+    new_entries.erase(sort_and_unique(new_entries.begin(), new_entries.end(),
+                                      entry_less{}),
+                      new_entries.end());
+    merge_into_tail(new_entries);
+  }
+
+  void insert(std::initializer_list<std::string> il) {
+    insert(il.begin(), il.end());
+  }
+
+  // --------------------------------------------------------------------------
+  // Erase operations.
+
+  const_iterator erase(const_iterator pos) {
+    prefixes_.erase(prefixes_.begin() + (pos - begin()));
+    return body_.erase(pos);
+  }
+
+  size_type erase(const std::string& s) {
+    const_iterator pos = find(s);
+    if (pos == end()) return 0;
+    erase(pos);
+    return 1;
+  }
+
+  // --------------------------------------------------------------------------
+  // Search operations.
+
+  const_iterator lower_bound(const std::string& s) const {
+    const std::uint64_t prefix = detail::string_prefix(s.data(), s.size());
+    return begin() + static_cast<difference_type>(lower_bound_pos(prefix, s));
+  }
+
+  const_iterator find(const std::string& s) const {
+    const_iterator pos = lower_bound(s);
+    if (pos == end() || *pos != s) return end();
+    return pos;
+  }
+
+  size_type count(const std::string& s) const {
+    return find(s) != end() ? 1 : 0;
+  }
+
+  //---------------------------------------------------------------------------
+  // Getters.
+
+  const underlying_type& body() const { return body_; }
+  const std::vector<std::uint64_t>& prefixes() const { return prefixes_; }
+
+  friend bool operator==(const prefixed_string_set& x,
+                         const prefixed_string_set& y) {
+    return x.body_ == y.body_;
+  }
+
+  friend bool operator!=(const prefixed_string_set& x,
+                         const prefixed_string_set& y) {
+    return !(x == y);
+  }
+
+ private:
+  struct entry {
+    std::uint64_t prefix;
+    std::string* str;
+  };
+
+  struct entry_less {
+    bool operator()(const entry& x, const entry& y) const {
+      if (x.prefix != y.prefix) return x.prefix < y.prefix;
+      return detail::compare_after_prefix(x.str->data(), x.str->size(),
+                                          y.str->data(), y.str->size()) < 0;
+    }
+  };
+
+  static std::vector<std::uint64_t> prefixes_of(const underlying_type& c) {
+    std::vector<std::uint64_t> res;
+    res.reserve(c.size());
+    for (const std::string& s : c)
+      res.push_back(detail::string_prefix(s.data(), s.size()));
+    return res;
+  }
+
+  static std::vector<entry> entries_of(
+      underlying_type& c, const std::vector<std::uint64_t>& prefixes) {
+    std::vector<entry> res;
+    res.reserve(c.size());
+    for (size_type i = 0; i != c.size(); ++i)
+      res.push_back(entry{prefixes[i], &c[i]});
+    return res;
+  }
+
+  // Backward merge into the capacity, like insert_sorted_unique_impl: only
+  // the elements after the first insertion point move. Moving strings does
+  // not throw, so once the memory is there nothing can fail.
+  void merge_into_tail(std::vector<entry>& added) {
+    const size_type len = size() + added.size();
+    if (body_.capacity() < len)
+      body_.reserve(detail::grown_capacity(body_, len));
+    if (prefixes_.capacity() < len)
+      prefixes_.reserve(detail::grown_capacity(prefixes_, len));
+
+    size_type in = size();  // Existing elements not merged yet: [0, in).
+    size_type out = len;    // Merged elements: [out, len).
+    body_.resize(len);
+    prefixes_.resize(len);
+
+    for (auto it = added.rbegin(); it != added.rend(); ++it) {
+      const size_type pos = merge_pos(in, *it);
+      std::move_backward(body_.begin() + static_cast<difference_type>(pos),
+                         body_.begin() + static_cast<difference_type>(in),
+                         body_.begin() + static_cast<difference_type>(out));
+      std::copy_backward(
+          prefixes_.begin() + static_cast<difference_type>(pos),
+          prefixes_.begin() + static_cast<difference_type>(in),
+          prefixes_.begin() + static_cast<difference_type>(out));
+      out -= in - pos;
+      in = pos;
+
+      if (in && prefixes_[in - 1] == it->prefix && body_[in - 1] == *it->str)
+        continue;
+      --out;
+      body_[out] = std::move(*it->str);
+      prefixes_[out] = it->prefix;
+    }
+
+    // Duplicates leave a gap between the untouched prefix and the merged
+    // part.
+    if (in == out) return;
+    body_.erase(std::move(body_.begin() + static_cast<difference_type>(out),
+                          body_.end(),
+                          body_.begin() + static_cast<difference_type>(in)),
+                body_.end());
+    prefixes_.erase(
+        std::copy(prefixes_.begin() + static_cast<difference_type>(out),
+                  prefixes_.end(),
+                  prefixes_.begin() + static_cast<difference_type>(in)),
+        prefixes_.end());
+  }
+
+  // The existing elements in [0, in) that go after |e| start at the result.
+  // They are found by galloping back over the prefix column; equal prefixes
+  // are rare, so their strings are compared one by one.
+  size_type merge_pos(size_type in, const entry& e) const {
+    auto f = detail::make_reverse_iterator(
+        prefixes_.begin() + static_cast<difference_type>(in));
+    auto l = detail::make_reverse_iterator(prefixes_.begin());
+    size_type pos = in - static_cast<size_type>(
+        lower_bound_biased(f, l, e.prefix, std::greater<std::uint64_t>()) - f);
+    while (pos && prefixes_[pos - 1] == e.prefix &&
+           detail::compare_after_prefix(body_[pos - 1].data(),
+                                        body_[pos - 1].size(), e.str->data(),
+                                        e.str->size()) > 0) {
+      --pos;
+    }
+    return pos;
+  }
+
+  // Equal prefixes are rare: the run after the integer search is usually
+  // empty or has one string, so it is found by galloping.
+  size_type lower_bound_pos(std::uint64_t prefix, const std::string& s) const {
+    auto f = std::lower_bound(prefixes_.begin(), prefixes_.end(), prefix);
+    auto l = partition_point_biased(
+        f, prefixes_.end(), [prefix](std::uint64_t x) { return x == prefix; });
+    auto pos = std::lower_bound(body_.begin() + (f - prefixes_.begin()),
+                                body_.begin() + (l - prefixes_.begin()), s);
+    return static_cast<size_type>(pos - body_.begin());
+  }
+
+  underlying_type body_;
+  std::vector<std::uint64_t> prefixes_;
+};
+
+// small_flat_set -------------------------------------------------------------
+
+// Keeps up to N keys inside the object.
+template <typename Key, std::size_t N, typename Compare = less>
+using small_flat_set = flat_set<Key, Compare, small_vector<Key, N>>;
+
+// static_flat_set ------------------------------------------------------------
+
+// flat_set that stores at most Capacity keys inside the object and never
+// allocates, including temporary memory: new keys, and the keys given to
+// erase_keys, are sorted in an in-object scratch region of the same capacity.
+// Inserts report overflow through the return value:
+//   * insert(v)/emplace return {end(), false};
+//   * try_emplace returns {end(), false} for a missing key;
+//   * apply_delta returns false and changes nothing;
+//   * insert_keys returns the first key that did not fit;
+//   * insert(hint, v)/emplace_hint return end();
+//   * insert(f, l)/insert_sorted_unique return the first element that did
+//     not fit, elements before it are inserted.
+// Constructors drop the keys that do not fit.
+template <typename Key, std::size_t Capacity, typename Compare = less>
+class static_flat_set
+    : public flat_set<Key, Compare, static_vector<Key, Capacity>> {
+  using base = flat_set<Key, Compare, static_vector<Key, Capacity>>;
+
+ public:
+  using typename base::const_iterator;
+  using typename base::iterator;
+  using typename base::key_compare;
+  using typename base::size_type;
+  using typename base::underlying_type;
+  using typename base::value_type;
+
+  static_flat_set() = default;
+  explicit static_flat_set(const key_compare& comp) : base(comp) {}
+
+  template <typename I>
+  // requires ForwardIterator<I>
+  static_flat_set(I f, I l, const key_compare& comp = key_compare())
+      : base(comp) {
+    insert(f, l);
+  }
+
+  static_flat_set(std::initializer_list<value_type> il,
+                  const key_compare& comp = key_compare())
+      : static_flat_set(il.begin(), il.end(), comp) {}
+
+  bool full() const { return this->size() == Capacity; }
+
+  // Nothing to reserve.
+  void reserve(size_type) {}
+
+  template <typename V,
+            typename = detail::insert_should_be_enabled<value_type, V>>
+  std::pair<iterator, bool> insert(V&& v) {
+    if (full()) return {this->find(v), false};
+    return base::insert(std::forward<V>(v));
+  }
+
+  template <typename V,
+            typename = detail::insert_should_be_enabled<value_type, V>>
+  iterator insert(const_iterator hint, V&& v) {
+    if (full()) return this->find(v);
+    return base::insert(hint, std::forward<V>(v));
+  }
+
+  template <typename I>
+  // requires ForwardIterator<I>
+  I insert(I f, I l) {
+    static_assert(ForwardIterator<I>(), "");
+
+    // Chunks never have more elements than there is space left, so they
+    // always fit and the input is read only once.
+    while (f != l && !full()) {
+      I chunk_l = f;
+      for (size_type n = Capacity - this->size(); chunk_l != l && n; --n)
+        ++chunk_l;
+
+      scratch_.assign(f, chunk_l);
+      scratch_.erase(
+          sort_and_unique(scratch_.begin(), scratch_.end(), this->value_comp()),
+          scratch_.end());
+      detail::insert_sorted_unique_impl(
+          this->body(), std::make_move_iterator(scratch_.begin()),
+          std::make_move_iterator(scratch_.end()), this->value_comp());
+      scratch_.clear();
+      f = chunk_l;
+    }
+    return insert_by_one(f, l);
+  }
+
+  bool insert(std::initializer_list<value_type> il) {
+    return insert(il.begin(), il.end()) == il.end();
+  }
+
+  template <typename I>
+  // requires ForwardIterator<I>
+  I insert_sorted_unique(I f, I l) {
+    static_assert(ForwardIterator<I>(), "");
+    if (count_new(f, l) > Capacity - this->size()) return insert_by_one(f, l);
+
+    detail::insert_sorted_unique_impl(this->body(), f, l, this->value_comp());
+    return l;
+  }
+
+  template <typename... Args>
+  std::pair<iterator, bool> emplace(Args&&... args) {
+    return insert(value_type{std::forward<Args>(args)...});
+  }
+
+  template <typename... Args>
+  iterator emplace_hint(const_iterator hint, Args&&... args) {
+    return insert(hint, value_type{std::forward<Args>(args)...});
+  }
+
+  template <typename K, typename... Args>
+  std::pair<iterator, bool> try_emplace(K&& k, Args&&... args) {
+    using key_ref =
+        detail::try_emplace_key<base, typename std::decay<K>::type>;
+    const key_ref& k_ref = k;
+    if (full()) return {this->find(k_ref), false};
+    return base::try_emplace(std::forward<K>(k), std::forward<Args>(args)...);
+  }
+
+  template <typename I>
+  // requires InputIterator<I>
+  I insert_keys(I f, I l) {
+    for (; f != l; ++f) {
+      if (try_emplace(*f).first == this->end()) break;
+    }
+    return f;
+  }
+
+  // Keys are sorted in the scratch region Capacity at a time and every chunk
+  // is erased with erase_sorted.
+  template <typename I>
+  // requires InputIterator<I>
+  size_type erase_keys(I f, I l) {
+    size_type res = 0;
+    while (f != l && !this->empty()) {
+      for (; f != l && scratch_.size() != Capacity; ++f)
+        scratch_.emplace_back(*f);
+      scratch_.erase(
+          sort_and_unique(scratch_.begin(), scratch_.end(), this->value_comp()),
+          scratch_.end());
+      res += this->erase_sorted(scratch_.begin(), scratch_.end());
+      scratch_.clear();
+    }
+    return res;
+  }
+
+  // Returns false and leaves the set unchanged when the result would not
+  // fit. The merge is built in the scratch region.
+  template <typename I>
+  // requires ForwardIterator<I>
+  bool apply_delta(I f, I l) {
+    size_type new_size = this->size();
+    bool inserts = false;
+    for (I it = f; it != l; ++it) {
+      bool found = this->count((*it).first) != 0;
+      if ((*it).second) {
+        inserts = true;
+        if (!found) ++new_size;
+      } else if (found) {
+        --new_size;
+      }
+    }
+    if (new_size > Capacity) return false;
+
+    if (!inserts) {
+      base::apply_delta(f, l);
+      return true;
+    }
+    detail::apply_delta_impl(this->body(), f, l, scratch_, this->value_comp());
+    this->body() = std::move(scratch_);
+    scratch_.clear();
+    return true;
+  }
+
+ private:
+  template <typename I>
+  size_type count_new(I f, I l) const {
+    size_type res = 0;
+    for (; f != l; ++f) res += this->count(*f) ? 0 : 1;
+    return res;
+  }
+
+  template <typename I>
+  I insert_by_one(I f, I l) {
+    for (; f != l; ++f) {
+      if (insert(*f).first == this->end()) break;
+    }
+    return f;
+  }
+
+  underlying_type scratch_;
+};
+
+// chunked_flat_set -----------------------------------------------------------
+
+namespace detail {
+
+// About a page of keys.
+template <typename Key>
+constexpr std::size_t default_block_size() {
+  return sizeof(Key) * 16 < 4096 ? 4096 / sizeof(Key) : 16;
+}
+
+}  // namespace detail
+
+// Sorted sequence of sorted blocks of at most BlockSize keys, plus the biggest
+// key of every block to find the block for a key. Single element inserts and
+// erases only shift inside one block: full blocks are split in two, small
+// ones are merged with a neighbour.
+template <typename Key, typename Compare = less,
+          std::size_t BlockSize = detail::default_block_size<Key>()>
+// requires CopyConstructible<Key>: the biggest keys are copied to the index.
+class chunked_flat_set {
+  static_assert(BlockSize >= 2, "");
+
+  using block_type = std::vector<Key>;
+
+ public:
+  using key_type = Key;
+  using value_type = Key;
+  using size_type = std::size_t;
+  using difference_type = std::ptrdiff_t;
+  using key_compare = Compare;
+  using value_compare = Compare;
+  using reference = const Key&;
+  using const_reference = const Key&;
+
+  class const_iterator {
+   public:
+    using iterator_category = std::bidirectional_iterator_tag;
+    using value_type = Key;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const Key*;
+    using reference = const Key&;
+
+    const_iterator() = default;
+
+    reference operator*() const { return blocks_[block_][pos_]; }
+    pointer operator->() const { return &**this; }
+
+    const_iterator& operator++() {
+      if (++pos_ == blocks_[block_].size()) {
+        ++block_;
+        pos_ = 0;
+      }
+      return *this;
+    }
+
+    const_iterator operator++(int) {
+      const_iterator tmp = *this;
+      operator++();
+      return tmp;
+    }
+
+    const_iterator& operator--() {
+      if (!pos_) pos_ = blocks_[--block_].size();
+      --pos_;
+      return *this;
+    }
+
+    const_iterator operator--(int) {
+      const_iterator tmp = *this;
+      operator--();
+      return tmp;
+    }
+
+    friend bool operator==(const const_iterator& x, const const_iterator& y) {
+      return x.block_ == y.block_ && x.pos_ == y.pos_;
+    }
+
+    friend bool operator!=(const const_iterator& x, const const_iterator& y) {
+      return !(x == y);
+    }
+
+   private:
+    friend class chunked_flat_set;
+
+    const_iterator(const block_type* blocks, size_type block, size_type pos)
+        : blocks_{blocks}, block_{block}, pos_{pos} {}
+
+    const block_type* blocks_ = nullptr;
+    size_type block_ = 0;
+    size_type pos_ = 0;
+  };
+
+  using iterator = const_iterator;
+  using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+  using reverse_iterator = const_reverse_iterator;
+
+  chunked_flat_set() = default;
+  explicit chunked_flat_set(const key_compare& comp) : comp_{comp} {}
+
+  template <typename I>
+  // requires InputIterator<I>
+  chunked_flat_set(I f, I l, const key_compare& comp = key_compare())
+      : comp_{comp} {
+    insert(f, l);
+  }
+
+  chunked_flat_set(std::initializer_list<value_type> il,
+                   const key_compare& comp = key_compare())
+      : chunked_flat_set(il.begin(), il.end(), comp) {}
+
+  //---------------------------------------------------------------------------
+  // Iterators.
+
+  const_iterator begin() const { return make_iterator(0, 0); }
+  const_iterator cbegin() const { return begin(); }
+  const_iterator end() const { return make_iterator(blocks_.size(), 0); }
+  const_iterator cend() const { return end(); }
+
+  const_reverse_iterator rbegin() const {
+    return const_reverse_iterator(end());
+  }
+  const_reverse_iterator crbegin() const { return rbegin(); }
+  const_reverse_iterator rend() const {
+    return const_reverse_iterator(begin());
+  }
+  const_reverse_iterator crend() const { return rend(); }
+
+  //---------------------------------------------------------------------------
+  // Size.
+
+  bool empty() const { return !size_; }
+  size_type size() const { return size_; }
+  size_type block_count() const { return blocks_.size(); }
+
+  void clear() {
+    blocks_.clear();
+    index_.clear();
+    size_ = 0;
+  }
+
+  //---------------------------------------------------------------------------
+  // Insert operations.
+
+  template <typename V,
+            typename = detail::insert_should_be_enabled<value_type, V>>
+  std::pair<iterator, bool> insert(V&& v) {
+    if (blocks_.empty()) {
+      blocks_.push_back(make_block());
+      blocks_.back().push_back(std::forward<V>(v));
+      index_.push_back(blocks_.back().back());
+      ++size_;
+      return {begin(), true};
+    }
+
+    size_type b = std::min(block_for(v), blocks_.size() - 1);
+    auto pos = std::lower_bound(blocks_[b].begin(), blocks_[b].end(), v, comp_);
+    size_type p = static_cast<size_type>(pos - blocks_[b].begin());
+    if (pos != blocks_[b].end() && !comp_(v, *pos))
+      return {make_iterator(b, p), false};
+
+    if (blocks_[b].size() == BlockSize) {
+      split(b);
+      if (p > blocks_[b].size()) {
+        p -= blocks_[b].size();
+        ++b;
+      }
+    }
+
+    blocks_[b].insert(blocks_[b].begin() + p, std::forward<V>(v));
+    index_[b] = blocks_[b].back();
+    ++size_;
+    return {make_iterator(b, p), true};
+  }
+
+  template <typename V,
+            typename = detail::insert_should_be_enabled<value_type, V>>
+  iterator insert(const_iterator, V&& v) {
+    return insert(std::forward<V>(v)).first;
+  }
+
+  // Every block that gets new keys is merged with its part of the input and
+  // cut again into blocks that are at most full.
+  template <typename I>
+  // requires InputIterator<I>
+  void insert(I f, I l) {
+    block_type buf(f, l);
+    buf.erase(sort_and_unique(buf.begin(), buf.end(), comp_), buf.end());
+    if (buf.empty()) return;
+
+    std::vector<block_type> new_blocks;
+    new_blocks.reserve(blocks_.size() + buf.size() / BlockSize + 1);
+
+    auto it = buf.begin();
+    for (size_type b = 0; b != blocks_.size(); ++b) {
+      auto slice_l = b + 1 == blocks_.size()
+                         ? buf.end()
+                         : std::upper_bound(it, buf.end(), index_[b], comp_);
+      if (it == slice_l) {
+        new_blocks.push_back(std::move(blocks_[b]));
+        continue;
+      }
+
+      block_type merged;
+      merged.reserve(blocks_[b].size() + static_cast<size_type>(slice_l - it));
+      set_union_unique_biased(std::make_move_iterator(blocks_[b].begin()),
+                              std::make_move_iterator(blocks_[b].end()),
+                              std::make_move_iterator(it),
+                              std::make_move_iterator(slice_l),
+                              std::back_inserter(merged), comp_);
+      append_cut_into_blocks(new_blocks, merged);
+      it = slice_l;
+    }
+    if (blocks_.empty()) append_cut_into_blocks(new_blocks, buf);
+
+    blocks_ = std::move(new_blocks);
+    rebuild_index();
+  }
+
+  void insert(std::initializer_list<value_type> ilist) {
+    insert(ilist.begin(), ilist.end());
+  }
+
+  template <typename... Args>
+  std::pair<iterator, bool> emplace(Args&&... args) {
+    return insert(value_type{std::forward<Args>(args)...});
+  }
+
+  template <typename... Args>
+  iterator emplace_hint(const_iterator hint, Args&&... args) {
+    return insert(hint, value_type{std::forward<Args>(args)...});
+  }
+
+  // --------------------------------------------------------------------------
+  // Erase operations.
+
+  iterator erase(const_iterator pos) {
+    size_type b = pos.block_;
+    size_type p = pos.pos_;
+    blocks_[b].erase(blocks_[b].begin() + p);
+    --size_;
+
+    if (blocks_[b].empty()) {
+      blocks_.erase(blocks_.begin() + b);
+      index_.erase(index_.begin() + b);
+      return make_iterator(b, 0);
+    }
+
+    if (blocks_[b].size() <= BlockSize / 4) {
+      if (b + 1 != blocks_.size() &&
+          blocks_[b].size() + blocks_[b + 1].size() <= BlockSize) {
+        merge_with_next(b);
+      } else if (b && blocks_[b - 1].size() + blocks_[b].size() <= BlockSize) {
+        p += blocks_[--b].size();
+        merge_with_next(b);
+      }
+    }
+
+    index_[b] = blocks_[b].back();
+    if (p == blocks_[b].size()) return make_iterator(b + 1, 0);
+    return make_iterator(b, p);
+  }
+
+  template <typename V>
+  size_type erase(const V& v) {
+    auto pos = find(v);
+    if (pos == end()) return 0;
+    erase(pos);
+    return 1;
+  }
+
+  // --------------------------------------------------------------------------
+  // Search operations.
+
+  template <typename V>
+  size_type count(const V& v) const {
+    return find(v) != end() ? 1 : 0;
+  }
+
+  template <typename V>
+  const_iterator find(const V& v) const {
+    auto pos = lower_bound(v);
+    return (pos == end() || comp_(v, *pos)) ? end() : pos;
+  }
+
+  template <typename V>
+  std::pair<const_iterator, const_iterator> equal_range(const V& v) const {
+    auto pos = lower_bound(v);
+    if (pos == end() || comp_(v, *pos)) return {pos, pos};
+    return {pos, std::next(pos)};
+  }
+
+  template <typename V>
+  const_iterator lower_bound(const V& v) const {
+    size_type b = block_for(v);
+    if (b == blocks_.size()) return end();
+    auto pos = std::lower_bound(blocks_[b].begin(), blocks_[b].end(), v, comp_);
+    return make_iterator(b, static_cast<size_type>(pos - blocks_[b].begin()));
+  }
+
+  template <typename V>
+  const_iterator upper_bound(const V& v) const {
+    auto b = static_cast<size_type>(
+        std::upper_bound(index_.begin(), index_.end(), v, comp_) -
+        index_.begin());
+    if (b == blocks_.size()) return end();
+    auto pos = std::upper_bound(blocks_[b].begin(), blocks_[b].end(), v, comp_);
+    return make_iterator(b, static_cast<size_type>(pos - blocks_[b].begin()));
+  }
+
+  //---------------------------------------------------------------------------
+  // Getters.
+
+  key_compare key_comp() const { return comp_; }
+  value_compare value_comp() const { return comp_; }
+
+  //---------------------------------------------------------------------------
+  // General operations.
+
+  void swap(chunked_flat_set& x) {
+    using std::swap;
+    swap(comp_, x.comp_);
+    blocks_.swap(x.blocks_);
+    index_.swap(x.index_);
+    swap(size_, x.size_);
+  }
+
+  friend void swap(chunked_flat_set& x, chunked_flat_set& y) { x.swap(y); }
+
+  friend bool operator==(const chunked_flat_set& x, const chunked_flat_set& y) {
+    return x.size() == y.size() && std::equal(x.begin(), x.end(), y.begin());
+  }
+
+  friend bool operator!=(const chunked_flat_set& x, const chunked_flat_set& y) {
+    return !(x == y);
+  }
+
+  friend bool operator<(const chunked_flat_set& x, const chunked_flat_set& y) {
+    return std::lexicographical_compare(x.begin(), x.end(), y.begin(),
+                                        y.end());
+  }
+
+ private:
+  const_iterator make_iterator(size_type b, size_type p) const {
+    return const_iterator(blocks_.data(), b, p);
+  }
+
+  // First block that can contain v, blocks_.size() if v is bigger than all.
+  template <typename V>
+  size_type block_for(const V& v) const {
+    return static_cast<size_type>(
+        std::lower_bound(index_.begin(), index_.end(), v, comp_) -
+        index_.begin());
+  }
+
+  static block_type make_block() {
+    block_type res;
+    res.reserve(BlockSize);
+    return res;
+  }
+
+  void split(size_type b) {
+    block_type tail = make_block();
+    auto m = blocks_[b].begin() + blocks_[b].size() / 2;
+    tail.insert(tail.end(), std::make_move_iterator(m),
+                std::make_move_iterator(blocks_[b].end()));
+    blocks_[b].erase(m, blocks_[b].end());
+
+    blocks_.insert(blocks_.begin() + b + 1, std::move(tail));
+    index_[b] = blocks_[b].back();
+    index_.insert(index_.begin() + b + 1, blocks_[b + 1].back());
+  }
+
+  void merge_with_next(size_type b) {
+    blocks_[b].insert(blocks_[b].end(),
+                      std::make_move_iterator(blocks_[b + 1].begin()),
+                      std::make_move_iterator(blocks_[b + 1].end()));
+    blocks_.erase(blocks_.begin() + b + 1);
+    index_.erase(index_.begin() + b + 1);
+  }
+
+  // Equal sized blocks, so that both inserts and erases have some room.
+  static void append_cut_into_blocks(std::vector<block_type>& blocks,
+                                     block_type& keys) {
+    size_type block_count = (keys.size() + BlockSize - 1) / BlockSize;
+    auto f = keys.begin();
+    for (size_type i = 0; i != block_count; ++i) {
+      auto l = keys.begin() + static_cast<difference_type>(
+                                  keys.size() * (i + 1) / block_count);
+      blocks.push_back(make_block());
+      blocks.back().insert(blocks.back().end(), std::make_move_iterator(f),
+                           std::make_move_iterator(l));
+      f = l;
+    }
+  }
+
+  void rebuild_index() {
+    index_.clear();
+    size_ = 0;
+    for (const block_type& block : blocks_) {
+      index_.push_back(block.back());
+      size_ += block.size();
+    }
+  }
+
+  Compare comp_;
+  std::vector<block_type> blocks_;
+  std::vector<Key> index_;
+  size_type size_ = 0;
+};
+
+// buffered_flat_set ----------------------------------------------------------
+
+// flat_set with small sorted buffers of recent changes in front of it.
+// Inserts and erases go to the buffers, which are folded into the body once
+// they get bigger than buffer_limit(): one merge instead of a tail shift per
+// key. An erased key that is in the body is kept as a tombstone until then.
+//
+// count/contains are const and look at both the buffers and the body.
+// Everything that returns iterators folds the buffers first, so it is not
+// const: a find after every insert costs a merge each time. Use contains
+// when mixing them.
+//
+// Inserts and erases cost amortized O(sqrt(n)) moves per key, not O(log n):
+// there is one level of buffers. A key shifts up to buffer_limit() keys in
+// its buffer, and each fold moves the n keys of the body for
+// buffer_limit() keys. A limit of about sqrt(n) balances the two. O(log n)
+// needs geometric levels of runs, as in an LSM tree. Then every lookup has
+// to search all the levels, and tombstones have to move down through them.
+// This set is for ingest paths that mix lookups into the inserts, so it
+// keeps lookups at two binary searches and pays the O(sqrt(n)) instead. That
+// is still far below the O(n) tail shift of a plain flat_set insert.
+template <typename Key, typename Compare = less,
+          typename UnderlyingType = std::vector<Key>>
+class buffered_flat_set {
+ public:
+  using flat_set_type = flat_set<Key, Compare, UnderlyingType>;
+  using key_type = Key;
+  using value_type = Key;
+  using size_type = typename flat_set_type::size_type;
+  using key_compare = Compare;
+  using value_compare = Compare;
+  using iterator = typename flat_set_type::iterator;
+  using const_iterator = typename flat_set_type::const_iterator;
+
+  buffered_flat_set() = default;
+  explicit buffered_flat_set(const key_compare& comp) : body_(comp) {}
+
+  template <typename I>
+  // requires InputIterator<I>
+  buffered_flat_set(I f, I l, const key_compare& comp = key_compare())
+      : body_(f, l, comp) {}
+
+  buffered_flat_set(std::initializer_list<value_type> il,
+                    const key_compare& comp = key_compare())
+      : body_(il, comp) {}
+
+  size_type size() const {
+    return body_.size() + added_.size() - tombstones_.size();
+  }
+  bool empty() const { return !size(); }
+
+  void clear() {
+    body_.clear();
+    added_.clear();
+    tombstones_.clear();
+  }
+
+  // About sqrt(n): buffer shifts and folds then both cost O(sqrt(n)) per key.
+  size_type buffer_limit() const {
+    size_type res = kMinBufferLimit;
+    while (res * res < body_.size()) res *= 2;
+    return res;
+  }
+
+  size_type buffer_size() const { return added_.size() + tombstones_.size(); }
+
+  //---------------------------------------------------------------------------
+  // Modifiers.
+
+  // Returns whether v was inserted, no iterator: v might be in the buffer.
+  template <typename V,
+            typename = detail::insert_should_be_enabled<value_type, V>>
+  bool insert(V&& v) {
+    auto tombstone = buffer_find(tombstones_, v);
+    if (tombstone != tombstones_.end()) {
+      tombstones_.erase(tombstone);
+      return true;
+    }
+
+    auto pos = std::lower_bound(added_.begin(), added_.end(), v, value_comp());
+    if (pos != added_.end() && !value_comp()(v, *pos)) return false;
+    if (body_.count(v)) return false;
+
+    added_.insert(pos, std::forward<V>(v));
+    flush_if_full();
+    return true;
+  }
+
+  template <typename... Args>
+  bool emplace(Args&&... args) {
+    return insert(value_type{std::forward<Args>(args)...});
+  }
+
+  // Big ranges do not benefit from buffering.
+  template <typename I>
+  // requires InputIterator<I>
+  void insert(I f, I l) {
+    flush();
+    body_.insert(f, l);
+  }
+
+  void insert(std::initializer_list<value_type> ilist) {
+    insert(ilist.begin(), ilist.end());
+  }
+
+  template <typename V>
+  size_type erase(const V& v) {
+    auto added = buffer_find(added_, v);
+    if (added != added_.end()) {
+      added_.erase(added);
+      return 1;
+    }
+
+    auto pos = std::lower_bound(tombstones_.begin(), tombstones_.end(), v,
+                                value_comp());
+    if (pos != tombstones_.end() && !value_comp()(v, *pos)) return 0;
+
+    auto in_body = body_.find(v);
+    if (in_body == body_.end()) return 0;
+
+    tombstones_.insert(pos, *in_body);
+    flush_if_full();
+    return 1;
+  }
+
+  // Applies all buffered changes to the body.
+  void flush() {
+    if (!tombstones_.empty()) {
+      auto& body = body_.body();
+      auto tombstone = tombstones_.cbegin();
+      auto is_erased = [&](const value_type& x) {
+        while (tombstone != tombstones_.cend() &&
+               value_comp()(*tombstone, x))
+          ++tombstone;
+        return tombstone != tombstones_.cend() &&
+               !value_comp()(x, *tombstone);
+      };
+      body.erase(std::remove_if(body.begin(), body.end(), is_erased),
+                 body.end());
+      tombstones_.clear();
+    }
+
+    if (!added_.empty()) {
+      body_.insert_sorted_unique(std::make_move_iterator(added_.begin()),
+                                 std::make_move_iterator(added_.end()));
+      added_.clear();
+    }
+  }
+
+  //---------------------------------------------------------------------------
+  // Search operations.
+
+  template <typename V>
+  size_type count(const V& v) const {
+    if (buffer_find(added_, v) != added_.end()) return 1;
+    if (buffer_find(tombstones_, v) != tombstones_.end()) return 0;
+    return body_.count(v);
+  }
+
+  template <typename V>
+  bool contains(const V& v) const {
+    return count(v) != 0;
+  }
+
+  template <typename V>
+  const_iterator find(const V& v) {
+    return flushed().find(v);
+  }
+
+  template <typename V>
+  const_iterator lower_bound(const V& v) {
+    return flushed().lower_bound(v);
+  }
+
+  template <typename V>
+  const_iterator upper_bound(const V& v) {
+    return flushed().upper_bound(v);
+  }
+
+  const_iterator begin() { return flushed().begin(); }
+  const_iterator end() { return flushed().end(); }
+
+  //---------------------------------------------------------------------------
+  // Getters.
+
+  key_compare key_comp() const { return body_.key_comp(); }
+  value_compare value_comp() const { return body_.value_comp(); }
+
+  const flat_set_type& flushed() {
+    flush();
+    return body_;
+  }
+
+  //---------------------------------------------------------------------------
+  // General operations.
+
+  // Does not fold the buffers: every key of x is looked up in y.
+  friend bool operator==(const buffered_flat_set& x,
+                         const buffered_flat_set& y) {
+    if (x.size() != y.size()) return false;
+    for (const value_type& v : x.added_)
+      if (!y.count(v)) return false;
+    for (const value_type& v : x.body_)
+      if (!x.is_tombstone(v) && !y.count(v)) return false;
+    return true;
+  }
+
+  friend bool operator!=(const buffered_flat_set& x,
+                         const buffered_flat_set& y) {
+    return !(x == y);
+  }
+
+ private:
+  static constexpr size_type kMinBufferLimit = 32;
+
+  using buffer_type = std::vector<value_type>;
+
+  template <typename V>
+  typename buffer_type::iterator buffer_find(buffer_type& buf,
+                                             const V& v) const {
+    auto pos = std::lower_bound(buf.begin(), buf.end(), v, value_comp());
+    return (pos == buf.end() || value_comp()(v, *pos)) ? buf.end() : pos;
+  }
+
+  template <typename V>
+  typename buffer_type::const_iterator buffer_find(const buffer_type& buf,
+                                                   const V& v) const {
+    auto pos = std::lower_bound(buf.begin(), buf.end(), v, value_comp());
+    return (pos == buf.end() || value_comp()(v, *pos)) ? buf.end() : pos;
+  }
+
+  bool is_tombstone(const value_type& v) const {
+    return buffer_find(tombstones_, v) != tombstones_.end();
+  }
+
+  void flush_if_full() {
+    if (buffer_size() > buffer_limit()) flush();
+  }
+
+  flat_set_type body_;
+  // Keys that are not in the body.
+  buffer_type added_;
+  // Keys of the body that are erased.
+  buffer_type tombstones_;
+};
+
+// gap_flat_set ---------------------------------------------------------------
+
+// Sorted keys with a gap of unconstructed memory left at the position of the
+// last insert or erase. The next change moves the gap there first, so a run
+// of inserts or erases around one spot costs the distance between them
+// instead of shifting the whole tail every time.
+// Iterators are random access and step over the gap.
+template <typename Key, typename Compare = less,
+          typename Allocator = std::allocator<Key>>
+class gap_flat_set {
+  static_assert(std::is_nothrow_move_constructible<Key>::value,
+                "moving the gap cannot be undone");
+
+  using alloc_traits = std::allocator_traits<Allocator>;
+  using relocatable =
+      std::integral_constant<bool, is_trivially_relocatable<Key>::value>;
+
+ public:
+  using key_type = Key;
+  using value_type = Key;
+  using size_type = std::size_t;
+  using difference_type = std::ptrdiff_t;
+  using key_compare = Compare;
+  using value_compare = Compare;
+  using allocator_type = Allocator;
+  using reference = const Key&;
+  using const_reference = const Key&;
+
+  class const_iterator {
+   public:
+    using iterator_category = std::random_access_iterator_tag;
+    using value_type = Key;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const Key*;
+    using reference = const Key&;
+
+    const_iterator() = default;
+
+    reference operator*() const {
+      return data_[idx_ < gap_f_ ? idx_ : idx_ + gap_size_];
+    }
+    pointer operator->() const { return &**this; }
+    reference operator[](difference_type n) const { return *(*this + n); }
+
+    const_iterator& operator+=(difference_type n) {
+      idx_ = static_cast<size_type>(static_cast<difference_type>(idx_) + n);
+      return *this;
+    }
+    const_iterator& operator-=(difference_type n) { return *this += -n; }
+    const_iterator& operator++() { return *this += 1; }
+    const_iterator& operator--() { return *this -= 1; }
+
+    const_iterator operator++(int) {
+      const_iterator tmp = *this;
+      ++*this;
+      return tmp;
+    }
+
+    const_iterator operator--(int) {
+      const_iterator tmp = *this;
+      --*this;
+      return tmp;
+    }
+
+    friend const_iterator operator+(const_iterator x, difference_type n) {
+      return x += n;
+    }
+    friend const_iterator operator+(difference_type n, const_iterator x) {
+      return x += n;
+    }
+    friend const_iterator operator-(const_iterator x, difference_type n) {
+      return x -= n;
+    }
+    friend difference_type operator-(const const_iterator& x,
+                                     const const_iterator& y) {
+      return static_cast<difference_type>(x.idx_) -
+             static_cast<difference_type>(y.idx_);
+    }
+
+    friend bool operator==(const const_iterator& x, const const_iterator& y) {
+      return x.idx_ == y.idx_;
+    }
+    friend bool operator!=(const const_iterator& x, const const_iterator& y) {
+      return !(x == y);
+    }
+    friend bool operator<(const const_iterator& x, const const_iterator& y) {
+      return x.idx_ < y.idx_;
+    }
+    friend bool operator>(const const_iterator& x, const const_iterator& y) {
+      return y < x;
+    }
+    friend bool operator<=(const const_iterator& x, const const_iterator& y) {
+      return !(y < x);
+    }
+    friend bool operator>=(const const_iterator& x, const const_iterator& y) {
+      return !(x < y);
+    }
+
+   private:
+    friend class gap_flat_set;
+
+    const_iterator(const Key* data, size_type gap_f, size_type gap_size,
+                   size_type idx)
+        : data_{data}, gap_f_{gap_f}, gap_size_{gap_size}, idx_{idx} {}
+
+    const Key* data_ = nullptr;
+    size_type gap_f_ = 0;
+    size_type gap_size_ = 0;
+    size_type idx_ = 0;
+  };
+
+  using iterator = const_iterator;
+  using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+  using reverse_iterator = const_reverse_iterator;
+
+  gap_flat_set() = default;
+  explicit gap_flat_set(const key_compare& comp,
+                        const allocator_type& alloc = allocator_type())
+      : comp_{comp}, alloc_{alloc} {}
+
+  template <typename I>
+  // requires InputIterator<I>
+  gap_flat_set(I f, I l, const key_compare& comp = key_compare(),
+               const allocator_type& alloc = allocator_type())
+      : comp_{comp}, alloc_{alloc} {
+    std::vector<Key> buf(f, l);
+    buf.erase(sort_and_unique(buf.begin(), buf.end(), comp_), buf.end());
+    assign_sorted_unique(std::make_move_iterator(buf.begin()),
+                         std::make_move_iterator(buf.end()));
+  }
+
+  gap_flat_set(std::initializer_list<value_type> il,
+               const key_compare& comp = key_compare(),
+               const allocator_type& alloc = allocator_type())
+      : gap_flat_set(il.begin(), il.end(), comp, alloc) {}
+
+  gap_flat_set(const gap_flat_set& x)
+      : comp_{x.comp_},
+        alloc_{alloc_traits::select_on_container_copy_construction(x.alloc_)} {
+    assign_sorted_unique(x.begin(), x.end());
+  }
+
+  gap_flat_set(gap_flat_set&& x) noexcept
+      : comp_{x.comp_}, alloc_{std::move(x.alloc_)} {
+    steal(x);
+  }
+
+  gap_flat_set& operator=(const gap_flat_set& x) {
+    if (this != &x) {
+      gap_flat_set tmp(x);
+      swap(tmp);
+    }
+    return *this;
+  }
+
+  gap_flat_set& operator=(gap_flat_set&& x) noexcept {
+    gap_flat_set tmp(std::move(x));
+    swap(tmp);
+    return *this;
+  }
+
+  ~gap_flat_set() { deallocate(); }
+
+  //---------------------------------------------------------------------------
+  // Iterators.
+
+  const_iterator begin() const { return make_iterator(0); }
+  const_iterator cbegin() const { return begin(); }
+  const_iterator end() const { return make_iterator(size()); }
+  const_iterator cend() const { return end(); }
+
+  const_reverse_iterator rbegin() const {
+    return const_reverse_iterator(end());
+  }
+  const_reverse_iterator crbegin() const { return rbegin(); }
+  const_reverse_iterator rend() const {
+    return const_reverse_iterator(begin());
+  }
+  const_reverse_iterator crend() const { return rend(); }
+
+  //---------------------------------------------------------------------------
+  // Size.
+
+  size_type size() const { return capacity_ - gap_size(); }
+  bool empty() const { return !size(); }
+  size_type capacity() const { return capacity_; }
+
+  // Logical position of the gap.
+  size_type gap_position() const { return gap_f_; }
+
+  void clear() {
+    destroy_all();
+    gap_f_ = 0;
+    gap_l_ = capacity_;
+  }
+
+  //---------------------------------------------------------------------------
+  // Insert operations.
+
+  template <typename V,
+            typename = detail::insert_should_be_enabled<value_type, V>>
+  std::pair<iterator, bool> insert(V&& v) {
+    return insert_at(lower_bound(v), std::forward<V>(v));
+  }
+
+  template <typename V,
+            typename = detail::insert_should_be_enabled<value_type, V>>
+  iterator insert(const_iterator hint, V&& v) {
+    auto pos = lower_bound_hinted(begin(), hint, end(), v, comp_);
+    return insert_at(pos, std::forward<V>(v)).first;
+  }
+
+  template <typename I>
+  // requires InputIterator<I>
+  void insert(I f, I l) {
+    const_iterator hint = begin();
+    for (; f != l; ++f) hint = std::next(insert(hint, value_type(*f)));
+  }
+
+  void insert(std::initializer_list<value_type> ilist) {
+    insert(ilist.begin(), ilist.end());
+  }
+
+  template <typename... Args>
+  std::pair<iterator, bool> emplace(Args&&... args) {
+    return insert(value_type{std::forward<Args>(args)...});
+  }
+
+  template <typename... Args>
+  iterator emplace_hint(const_iterator hint, Args&&... args) {
+    return insert(hint, value_type{std::forward<Args>(args)...});
+  }
+
+  // --------------------------------------------------------------------------
+  // Erase operations.
+
+  iterator erase(const_iterator pos) {
+    move_gap_to(pos.idx_ + 1);
+    --gap_f_;
+    alloc_traits::destroy(alloc_, data_ + gap_f_);
+    return make_iterator(gap_f_);
+  }
+
+  template <typename V>
+  size_type erase(const V& v) {
+    auto pos = find(v);
+    if (pos == end()) return 0;
+    erase(pos);
+    return 1;
+  }
+
+  // --------------------------------------------------------------------------
+  // Search operations.
+
+  template <typename V>
+  size_type count(const V& v) const {
+    return find(v) != end() ? 1 : 0;
+  }
+
+  template <typename V>
+  const_iterator find(const V& v) const {
+    auto pos = lower_bound(v);
+    return (pos == end() || comp_(v, *pos)) ? end() : pos;
+  }
+
+  template <typename V>
+  std::pair<const_iterator, const_iterator> equal_range(const V& v) const {
+    auto pos = lower_bound(v);
+    if (pos == end() || comp_(v, *pos)) return {pos, pos};
+    return {pos, std::next(pos)};
+  }
+
+  // Both sides of the gap are sorted, only one of them needs a search.
+  template <typename V>
+  const_iterator lower_bound(const V& v) const {
+    if (gap_f_ && !comp_(data_[gap_f_ - 1], v)) {
+      return make_iterator(static_cast<size_type>(
+          std::lower_bound(data_, data_ + gap_f_, v, comp_) - data_));
+    }
+    return make_iterator(static_cast<size_type>(
+        std::lower_bound(data_ + gap_l_, data_ + capacity_, v, comp_) -
+        data_) - gap_size());
+  }
+
+  template <typename V>
+  const_iterator upper_bound(const V& v) const {
+    if (gap_f_ && comp_(v, data_[gap_f_ - 1])) {
+      return make_iterator(static_cast<size_type>(
+          std::upper_bound(data_, data_ + gap_f_, v, comp_) - data_));
+    }
+    return make_iterator(static_cast<size_type>(
+        std::upper_bound(data_ + gap_l_, data_ + capacity_, v, comp_) -
+        data_) - gap_size());
+  }
+
+  //---------------------------------------------------------------------------
+  // Getters.
+
+  key_compare key_comp() const { return comp_; }
+  value_compare value_comp() const { return comp_; }
+  allocator_type get_allocator() const { return alloc_; }
+
+  //---------------------------------------------------------------------------
+  // General operations.
+
+  void swap(gap_flat_set& x) noexcept {
+    using std::swap;
+    swap(comp_, x.comp_);
+    swap(alloc_, x.alloc_);
+    swap(data_, x.data_);
+    swap(capacity_, x.capacity_);
+    swap(gap_f_, x.gap_f_);
+    swap(gap_l_, x.gap_l_);
+  }
+
+  friend void swap(gap_flat_set& x, gap_flat_set& y) noexcept { x.swap(y); }
+
+  friend bool operator==(const gap_flat_set& x, const gap_flat_set& y) {
+    return x.size() == y.size() && std::equal(x.begin(), x.end(), y.begin());
+  }
+
+  friend bool operator!=(const gap_flat_set& x, const gap_flat_set& y) {
+    return !(x == y);
+  }
+
+  friend bool operator<(const gap_flat_set& x, const gap_flat_set& y) {
+    return std::lexicographical_compare(x.begin(), x.end(), y.begin(),
+                                        y.end());
+  }
+
+ private:
+  size_type gap_size() const { return gap_l_ - gap_f_; }
+
+  const_iterator make_iterator(size_type idx) const {
+    return const_iterator(data_, gap_f_, gap_size(), idx);
+  }
+
+  template <typename V>
+  std::pair<iterator, bool> insert_at(const_iterator pos, V&& v) {
+    if (pos != end() && !comp_(v, *pos)) return {pos, false};
+
+    if (gap_f_ == gap_l_) grow(pos.idx_);
+    move_gap_to(pos.idx_);
+    alloc_traits::construct(alloc_, data_ + gap_f_, std::forward<V>(v));
+    return {make_iterator(gap_f_++), true};
+  }
+
+  void move_gap_to(size_type idx) {
+    if (gap_f_ == gap_l_) {
+      gap_f_ = gap_l_ = idx;
+    } else if (idx < gap_f_) {
+      size_type n = gap_f_ - idx;
+      move_elements_back(data_ + idx, data_ + gap_f_, data_ + gap_l_,
+                         relocatable{});
+      gap_f_ -= n;
+      gap_l_ -= n;
+    } else if (idx > gap_f_) {
+      size_type n = idx - gap_f_;
+      move_elements_front(data_ + gap_l_, data_ + gap_l_ + n, data_ + gap_f_,
+                          relocatable{});
+      gap_f_ += n;
+      gap_l_ += n;
+    }
+  }
+
+  // Moves [f, l) so that it ends at o_l, going from the back.
+  void move_elements_back(Key* f, Key* l, Key* o_l, std::false_type) {
+    while (f != l) {
+      --l;
+      --o_l;
+      alloc_traits::construct(alloc_, o_l, std::move(*l));
+      alloc_traits::destroy(alloc_, l);
+    }
+  }
+
+  void move_elements_back(Key* f, Key* l, Key* o_l, std::true_type) {
+    detail::relocate(f, l, o_l - (l - f));
+  }
+
+  // Moves [f, l) to o, going from the front.
+  void move_elements_front(Key* f, Key* l, Key* o, std::false_type) {
+    for (; f != l; ++f, ++o) {
+      alloc_traits::construct(alloc_, o, std::move(*f));
+      alloc_traits::destroy(alloc_, f);
+    }
+  }
+
+  void move_elements_front(Key* f, Key* l, Key* o, std::true_type) {
+    detail::relocate(f, l, o);
+  }
+
+  // New memory gets the gap at idx.
+  void grow(size_type idx) {
+    size_type new_capacity = std::max(size_type(16), 2 * capacity_);
+    Key* new_data = alloc_traits::allocate(alloc_, new_capacity);
+
+    move_gap_to(idx);
+    move_elements_front(data_, data_ + gap_f_, new_data, relocatable{});
+    move_elements_front(data_ + gap_l_, data_ + capacity_,
+                        new_data + new_capacity - (capacity_ - gap_l_),
+                        relocatable{});
+    if (data_) alloc_traits::deallocate(alloc_, data_, capacity_);
+
+    gap_l_ = new_capacity - (capacity_ - gap_l_);
+    data_ = new_data;
+    capacity_ = new_capacity;
+  }
+
+  // requires: empty.
+  template <typename I>
+  void assign_sorted_unique(I f, I l) {
+    auto n = static_cast<size_type>(std::distance(f, l));
+    if (!n) return;
+    data_ = alloc_traits::allocate(alloc_, n);
+    capacity_ = gap_l_ = n;
+    try {
+      for (; f != l; ++f, ++gap_f_)
+        alloc_traits::construct(alloc_, data_ + gap_f_, *f);
+    } catch (...) {
+      deallocate();
+      throw;
+    }
+  }
+
+  void steal(gap_flat_set& x) {
+    data_ = x.data_;
+    capacity_ = x.capacity_;
+    gap_f_ = x.gap_f_;
+    gap_l_ = x.gap_l_;
+    x.data_ = nullptr;
+    x.capacity_ = x.gap_f_ = x.gap_l_ = 0;
+  }
+
+  void destroy_all() {
+    for (size_type i = 0; i != gap_f_; ++i)
+      alloc_traits::destroy(alloc_, data_ + i);
+    for (size_type i = gap_l_; i != capacity_; ++i)
+      alloc_traits::destroy(alloc_, data_ + i);
+  }
+
+  void deallocate() {
+    if (!data_) return;
+    destroy_all();
+    alloc_traits::deallocate(alloc_, data_, capacity_);
+  }
+
+  Compare comp_;
+  Allocator alloc_;
+  Key* data_ = nullptr;
+  size_type capacity_ = 0;
+  size_type gap_f_ = 0;
+  size_type gap_l_ = 0;
+};
 
-// flat_set -------------------------------------------------------------------
+// lazy_erase_flat_set --------------------------------------------------------
 
+// flat_set where erase only marks the slot as dead in a side bitmap. Searches
+// and iteration skip dead slots. They are removed all at once in one linear
+// pass when more than max_dead_percent() of the slots are dead, or before a
+// bulk insert. A loop of erases becomes linear instead of quadratic.
 template <typename Key, typename Compare = less,
           typename UnderlyingType = std::vector<Key>>
-// requires (todo)
-class flat_set {
+class lazy_erase_flat_set {
  public:
-  using underlying_type = UnderlyingType;
+  using flat_set_type = flat_set<Key, Compare, UnderlyingType>;
   using key_type = Key;
-  using value_type = key_type;
-  using size_type = typename underlying_type::size_type;
-  using difference_type = typename underlying_type::difference_type;
+  using value_type = Key;
+  using size_type = typename flat_set_type::size_type;
+  using difference_type = typename flat_set_type::difference_type;
   using key_compare = Compare;
   using value_compare = Compare;
-  using reference = typename underlying_type::reference;
-  using const_reference = typename underlying_type::const_reference;
-  using pointer = typename underlying_type::pointer;
-  using const_pointer = typename underlying_type::const_pointer;
-  using iterator = typename underlying_type::iterator;
-  using const_iterator = typename underlying_type::const_iterator;
-  using reverse_iterator = typename underlying_type::reverse_iterator;
-  using const_reverse_iterator =
-      typename underlying_type::const_reverse_iterator;
+  using reference = const Key&;
+  using const_reference = const Key&;
 
- private:
-  // We cannot use std::tuple for compressed pair, because there is no way to
-  // forward many arguments to one of the members.
-  struct impl_t : value_compare {
-    impl_t() = default;
+  class const_iterator {
+   public:
+    using iterator_category = std::bidirectional_iterator_tag;
+    using value_type = Key;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const Key*;
+    using reference = const Key&;
 
-    template <typename... Args>
-    impl_t(value_compare comp, Args&&... args)
-        : value_compare(comp), body_{std::forward<Args>(args)...} {};
+    const_iterator() = default;
 
-    underlying_type body_;
-  } impl_;
+    reference operator*() const { return set_->body_.body()[idx_]; }
+    pointer operator->() const { return &**this; }
 
-  template <typename V>
-  using type_for_value_compare =
-      typename std::conditional<TransparentComparator<value_compare>(), V,
-                                value_type>::type;
+    const_iterator& operator++() {
+      idx_ = set_->next_live(idx_ + 1);
+      return *this;
+    }
 
-  iterator const_cast_iterator(const_iterator c_it) {
-    return begin() + std::distance(cbegin(), c_it);
-  }
+    const_iterator operator++(int) {
+      const_iterator tmp = *this;
+      operator++();
+      return tmp;
+    }
 
- public:
-  // --------------------------------------------------------------------------
-  // Lifetime -----------------------------------------------------------------
+    const_iterator& operator--() {
+      --idx_;
+      while (set_->dead_[idx_]) --idx_;
+      return *this;
+    }
 
-  flat_set() = default;
-  explicit flat_set(const key_compare& comp) : impl_{comp} {}
+    const_iterator operator--(int) {
+      const_iterator tmp = *this;
+      operator--();
+      return tmp;
+    }
 
-  template <typename I>
-  // requires InputIterator<I>
-  flat_set(I f, I l, const key_compare& comp = key_compare())
-      : impl_(comp, f, l) {
-    erase(sort_and_unique(begin(), end(), key_compare()), end());
-  }
+    friend bool operator==(const const_iterator& x, const const_iterator& y) {
+      return x.idx_ == y.idx_;
+    }
 
-  flat_set(const flat_set&) = default;
-  flat_set(flat_set&&) = default;
+    friend bool operator!=(const const_iterator& x, const const_iterator& y) {
+      return !(x == y);
+    }
 
-  explicit flat_set(underlying_type buf,
-                    const key_compare& comp = key_compare())
-      : impl_{comp, std::move(buf)} {
-    erase(sort_and_unique(begin(), end(), key_compare()), end());
-  }
+   private:
+    friend class lazy_erase_flat_set;
 
-  flat_set(std::initializer_list<value_type> il,
-           const key_compare& comp = key_compare())
-      : flat_set(il.begin(), il.end(), comp) {}
+    const_iterator(const lazy_erase_flat_set* set, size_type idx)
+        : set_{set}, idx_{idx} {}
 
-  ~flat_set() = default;
+    const lazy_erase_flat_set* set_ = nullptr;
+    size_type idx_ = 0;
+  };
 
-  // --------------------------------------------------------------------------
-  // Assignments --------------------------------------------------------------
+  using iterator = const_iterator;
+  using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+  using reverse_iterator = const_reverse_iterator;
 
-  flat_set& operator=(const flat_set&) = default;
-  flat_set& operator=(flat_set&&) = default;
-  flat_set& operator=(std::initializer_list<value_type> il) {
-    body() = il;
-    erase(sort_and_unique(begin(), end(), key_compare()), end());
-    return *this;
-  }
+  lazy_erase_flat_set() = default;
+  explicit lazy_erase_flat_set(const key_compare& comp) : body_(comp) {}
 
-  //---------------------------------------------------------------------------
-  // Memory management.
+  template <typename I>
+  // requires InputIterator<I>
+  lazy_erase_flat_set(I f, I l, const key_compare& comp = key_compare())
+      : body_(f, l, comp), dead_(body_.size(), false) {}
 
-  void reserve(size_type new_capacity) { body().reserve(new_capacity); }
-  size_type capacity() const { return body().capacity(); }
-  void shrink_to_fit() { body().shrink_to_fit(); }
+  lazy_erase_flat_set(std::initializer_list<value_type> il,
+                      const key_compare& comp = key_compare())
+      : lazy_erase_flat_set(il.begin(), il.end(), comp) {}
 
   //---------------------------------------------------------------------------
-  // Size management.
-
-  void clear() { body().clear(); }
+  // Iterators.
 
-  size_type size() const { return body().size(); }
-  size_type max_size() const { return body().max_size(); }
+  const_iterator begin() const { return make_iterator(next_live(0)); }
+  const_iterator cbegin() const { return begin(); }
+  const_iterator end() const { return make_iterator(body_.size()); }
+  const_iterator cend() const { return end(); }
 
-  bool empty() const { return body().empty(); }
+  const_reverse_iterator rbegin() const {
+    return const_reverse_iterator(end());
+  }
+  const_reverse_iterator crbegin() const { return rbegin(); }
+  const_reverse_iterator rend() const {
+    return const_reverse_iterator(begin());
+  }
+  const_reverse_iterator crend() const { return rend(); }
 
   //---------------------------------------------------------------------------
-  // Iterators.
-
-  iterator begin() { return body().begin(); }
-  const_iterator begin() const { return body().begin(); }
-  const_iterator cbegin() const { return body().cbegin(); }
+  // Size.
 
-  iterator end() { return body().end(); }
-  const_iterator end() const { return body().end(); }
-  const_iterator cend() const { return body().cend(); }
+  size_type size() const { return body_.size() - dead_count_; }
+  bool empty() const { return !size(); }
+  size_type dead_count() const { return dead_count_; }
 
-  reverse_iterator rbegin() { return body().rbegin(); }
-  const_reverse_iterator rbegin() const { return body().rbegin(); }
-  const_reverse_iterator crbegin() const { return body().crbegin(); }
+  size_type max_dead_percent() const { return max_dead_percent_; }
+  void set_max_dead_percent(size_type percent) {
+    max_dead_percent_ = percent;
+    compact_if_needed();
+  }
 
-  reverse_iterator rend() { return body().rend(); }
-  const_reverse_iterator rend() const { return body().rend(); }
-  const_reverse_iterator crend() const { return body().crend(); }
+  void clear() {
+    body_.clear();
+    dead_.clear();
+    dead_count_ = 0;
+  }
 
   //---------------------------------------------------------------------------
   // Insert operations.
 
+  // Inserting an erased key revives its slot.
   template <typename V,
             typename = detail::insert_should_be_enabled<value_type, V>>
   std::pair<iterator, bool> insert(V&& v) {
-    iterator pos = lower_bound(v);
-    if (pos == end() || value_comp()(v, *pos))
-      return {body().insert(pos, std::forward<V>(v)), true};
-    return {pos, false};
+    size_type idx = physical_lower_bound(v);
+    if (idx != body_.size() && !value_comp()(v, body_.body()[idx])) {
+      if (!dead_[idx]) return {make_iterator(idx), false};
+      // Equivalent is not identical: the new value replaces the erased one.
+      body_.body()[idx] = std::forward<V>(v);
+      dead_[idx] = false;
+      --dead_count_;
+      return {make_iterator(idx), true};
+    }
+
+    body_.body().insert(body_.body().begin() + idx, std::forward<V>(v));
+    dead_.insert(dead_.begin() + idx, false);
+    return {make_iterator(idx), true};
   }
 
   template <typename V,
             typename = detail::insert_should_be_enabled<value_type, V>>
-  iterator insert(const_iterator hint, V&& v) {
-    auto pos = lower_bound_hinted(cbegin(), hint, cend(), v, value_comp());
-    if (pos == end() || value_comp()(v, *pos))
-      return body().insert(pos, std::forward<V>(v));
-    return const_cast_iterator(pos);
-  }
-
-  template <typename I>
-  void insert_sorted_unique(I f, I l) {
-    // Need to count elements.
-    if (!ForwardIterator<I>()) {
-      underlying_type buf(f, l, body().get_allocator());
-      insert_sorted_unique(std::make_move_iterator(buf.begin()),
-                           std::make_move_iterator(buf.end()));
-      return;
-    }
-
-    detail::insert_sorted_unique_impl(body(), f, l, value_comp());
+  iterator insert(const_iterator, V&& v) {
+    return insert(std::forward<V>(v)).first;
   }
 
+  // Dead slots are removed first, so that they do not take part in the merge.
   template <typename I>
+  // requires InputIterator<I>
   void insert(I f, I l) {
-    underlying_type buf(f, l, body().get_allocator());
-    buf.erase(sort_and_unique(buf.begin(), buf.end(), value_comp()), buf.end());
-    insert_sorted_unique(std::make_move_iterator(buf.begin()),
-                         std::make_move_iterator(buf.end()));
+    compact();
+    body_.insert(f, l);
+    dead_.assign(body_.size(), false);
   }
 
   void insert(std::initializer_list<value_type> ilist) {
@@ -1142,27 +6425,48 @@ class flat_set {
     return insert(value_type{std::forward<Args>(args)...});
   }
 
-  template <typename... Args>
-  iterator emplace_hint(const_iterator hint, Args&&... args) {
-    return insert(hint, value_type{std::forward<Args>(args)...});
-  }
-
   // --------------------------------------------------------------------------
   // Erase operations.
 
-  iterator erase(iterator pos) { return body().erase(pos); }
-  iterator erase(const_iterator pos) { return body().erase(pos); }
-
-  iterator erase(const_iterator f, const_iterator l) {
-    return body().erase(f, l);
+  // Can compact: iterators are invalidated like in flat_set.
+  iterator erase(const_iterator pos) {
+    size_type idx = pos.idx_;
+    dead_[idx] = true;
+    ++dead_count_;
+    if (!should_compact()) return make_iterator(next_live(idx + 1));
+
+    // After compaction the next live element sits right after the live
+    // elements that preceded pos.
+    auto dead_before = std::count(dead_.begin(),
+                                  dead_.begin() +
+                                      static_cast<difference_type>(idx),
+                                  true);
+    compact();
+    return make_iterator(idx - static_cast<size_type>(dead_before));
   }
 
   template <typename V>
   size_type erase(const V& v) {
-    auto eq_range = equal_range(v);
-    size_type res = std::distance(eq_range.first, eq_range.second);
-    erase(eq_range.first, eq_range.second);
-    return res;
+    auto pos = find(v);
+    if (pos == end()) return 0;
+    erase(pos);
+    return 1;
+  }
+
+  // Removes dead slots in one pass.
+  void compact() {
+    if (!dead_count_) return;
+
+    auto& body = body_.body();
+    size_type o = 0;
+    for (size_type i = 0; i != body.size(); ++i) {
+      if (dead_[i]) continue;
+      if (o != i) body[o] = std::move(body[i]);
+      ++o;
+    }
+    body.erase(body.begin() + static_cast<difference_type>(o), body.end());
+    dead_.assign(o, false);
+    dead_count_ = 0;
   }
 
   // --------------------------------------------------------------------------
@@ -1170,108 +6474,242 @@ class flat_set {
 
   template <typename V>
   size_type count(const V& v) const {
-    auto eq_range = equal_range(v);
-    return std::distance(eq_range.first, eq_range.second);
+    return find(v) != end() ? 1 : 0;
   }
 
   template <typename V>
-  iterator find(const V& v) {
-    auto eq_range = equal_range(v);
-    return (eq_range.first == eq_range.second) ? end() : eq_range.first;
+  const_iterator find(const V& v) const {
+    size_type idx = physical_lower_bound(v);
+    if (idx == body_.size() || dead_[idx] ||
+        value_comp()(v, body_.body()[idx]))
+      return end();
+    return make_iterator(idx);
   }
 
   template <typename V>
-  const_iterator find(const V& v) const {
-    auto eq_range = equal_range(v);
-    return (eq_range.first == eq_range.second) ? end() : eq_range.first;
+  const_iterator lower_bound(const V& v) const {
+    return make_iterator(next_live(physical_lower_bound(v)));
   }
 
   template <typename V>
-  std::pair<iterator, iterator> equal_range(const V& v) {
-    auto pos = lower_bound(v);
-    if (pos == end() || value_comp()(v, *pos)) return {pos, pos};
+  const_iterator upper_bound(const V& v) const {
+    auto pos = std::upper_bound(body_.body().begin(), body_.body().end(), v,
+                                value_comp());
+    return make_iterator(next_live(
+        static_cast<size_type>(pos - body_.body().begin())));
+  }
 
-    return {pos, std::next(pos)};
+  //---------------------------------------------------------------------------
+  // Getters.
+
+  key_compare key_comp() const { return body_.key_comp(); }
+  value_compare value_comp() const { return body_.value_comp(); }
+
+  //---------------------------------------------------------------------------
+  // General operations.
+
+  friend bool operator==(const lazy_erase_flat_set& x,
+                         const lazy_erase_flat_set& y) {
+    return x.size() == y.size() && std::equal(x.begin(), x.end(), y.begin());
   }
 
-  template <typename V>
-  std::pair<const_iterator, const_iterator> equal_range(const V& v) const {
-    auto pos = lower_bound(v);
-    if (pos == end() || value_comp()(v, *pos)) return {pos, pos};
+  friend bool operator!=(const lazy_erase_flat_set& x,
+                         const lazy_erase_flat_set& y) {
+    return !(x == y);
+  }
 
-    return {pos, std::next(pos)};
+ private:
+  const_iterator make_iterator(size_type idx) const {
+    return const_iterator(this, idx);
   }
 
-  template <typename V>
-  iterator lower_bound(const V& v) {
-    const type_for_value_compare<V>& v_ref = v;
-    return std::lower_bound(begin(), end(), v_ref, value_comp());
+  size_type next_live(size_type idx) const {
+    while (idx != body_.size() && dead_[idx]) ++idx;
+    return idx;
   }
 
   template <typename V>
-  const_iterator lower_bound(const V& v) const {
-    const type_for_value_compare<V>& v_ref = v;
-    return std::lower_bound(begin(), end(), v_ref, value_comp());
+  size_type physical_lower_bound(const V& v) const {
+    return static_cast<size_type>(body_.lower_bound(v) - body_.begin());
   }
 
-  template <typename V>
-  iterator upper_bound(const V& v) {
-    const type_for_value_compare<V>& v_ref = v;
-    return std::upper_bound(begin(), end(), v_ref, value_comp());
+  bool should_compact() const {
+    return dead_count_ * 100 > body_.size() * max_dead_percent_;
   }
 
-  template <typename V>
-  const_iterator upper_bound(const V& v) const {
-    const type_for_value_compare<V>& v_ref = v;
-    return std::upper_bound(begin(), end(), v_ref, value_comp());
+  void compact_if_needed() {
+    if (should_compact()) compact();
   }
 
-  //---------------------------------------------------------------------------
-  // Getters.
+  flat_set_type body_;
+  std::vector<bool> dead_;
+  size_type dead_count_ = 0;
+  size_type max_dead_percent_ = 50;
+};
 
-  key_compare key_comp() const { return impl_; }
-  value_compare value_comp() const { return impl_; }
+// frozen_set -----------------------------------------------------------------
 
-  underlying_type& body() { return impl_.body_; }
-  const underlying_type& body() const { return impl_.body_; }
+// Relies on C++14 constexpr.
+#if __cplusplus >= 201402L
 
-  //---------------------------------------------------------------------------
-  // General operations.
+namespace detail {
 
-  void swap(flat_set& x) { body().swap(x.body()); }
+template <typename T, std::size_t N>
+struct frozen_buffer {
+  T data[N];
+  std::size_t size;
+};
 
-  friend void swap(flat_set& x, flat_set& y) { x.swap(y); }
+// std::swap is not constexpr before C++20.
+template <typename T>
+constexpr void frozen_swap(T& x, T& y) {
+  T tmp = x;
+  x = y;
+  y = tmp;
+}
 
-  friend bool operator==(const flat_set& x, const flat_set& y) {
-    return x.body() == y.body();
+template <typename T, typename Compare>
+constexpr void frozen_sift_down(T* heap, std::size_t root, std::size_t n,
+                                Compare comp) {
+  while (true) {
+    std::size_t child = 2 * root + 1;
+    if (child >= n) return;
+    if (child + 1 < n && comp(heap[child], heap[child + 1])) ++child;
+    if (!comp(heap[root], heap[child])) return;
+    frozen_swap(heap[root], heap[child]);
+    root = child;
   }
+}
 
-  friend bool operator!=(const flat_set& x, const flat_set& y) {
-    return !(x == y);
+// Heap sort and unique. Runs in the compiler: O(N log N) steps keep big
+// tables within the constexpr evaluation limits.
+// The tail is padded with copies of the biggest element.
+template <typename T, std::size_t N, typename Compare>
+constexpr frozen_buffer<T, N> frozen_sort_and_unique(const T (&keys)[N],
+                                                     Compare comp) {
+  frozen_buffer<T, N> res{};
+  for (std::size_t i = 0; i < N; ++i) res.data[i] = keys[i];
+
+  for (std::size_t i = N / 2; i--;) frozen_sift_down(res.data, i, N, comp);
+  for (std::size_t n = N; n > 1; --n) {
+    frozen_swap(res.data[0], res.data[n - 1]);
+    frozen_sift_down(res.data, 0, n - 1, comp);
   }
 
-  friend bool operator<(const flat_set& x, const flat_set& y) {
-    return x.body() < y.body();
+  for (std::size_t i = 0; i < N; ++i) {
+    if (res.size && !comp(res.data[res.size - 1], res.data[i])) continue;
+    res.data[res.size++] = res.data[i];
   }
+  for (std::size_t i = res.size; i < N; ++i) res.data[i] = res.data[i - 1];
+  return res;
+}
 
-  friend bool operator>(const flat_set& x, const flat_set& y) { return y < x; }
+// Number of steps only depends on N, so the search unrolls completely and
+// every step compiles to a conditional move.
+template <std::size_t N>
+struct branchless_lower_bound {
+  template <typename T, typename V, typename Compare>
+  static constexpr const T* apply(const T* f, const V& v, Compare comp) {
+    return branchless_lower_bound<N - N / 2>::apply(
+        comp(f[N / 2], v) ? f + N / 2 : f, v, comp);
+  }
+};
 
-  friend bool operator<=(const flat_set& x, const flat_set& y) {
-    return !(y < x);
+template <>
+struct branchless_lower_bound<1> {
+  template <typename T, typename V, typename Compare>
+  static constexpr const T* apply(const T* f, const V& v, Compare comp) {
+    return f + (comp(*f, v) ? 1 : 0);
   }
+};
 
-  friend bool operator>=(const flat_set& x, const flat_set& y) {
-    return !(x < y);
+}  // namespace detail
+
+// Sorted unique keys known at compile time, see make_frozen_set.
+// Keys are stored in a std::array of the input size: duplicates are replaced
+// with copies of the biggest key at the end, which keeps the search
+// independent of the number of unique keys.
+template <typename Key, std::size_t N, typename Compare = less>
+class frozen_set {
+ public:
+  using key_type = Key;
+  using value_type = Key;
+  using size_type = std::size_t;
+  using key_compare = Compare;
+  using value_compare = Compare;
+  using underlying_type = std::array<Key, N>;
+  using const_iterator = const Key*;
+  using iterator = const_iterator;
+
+  // requires: the first size elements of body are sorted and unique,
+  //           the rest are copies of the last one.
+  constexpr frozen_set(const underlying_type& body, size_type size,
+                       const key_compare& comp)
+      : comp_{comp}, body_(body), size_{size} {}
+
+  constexpr const_iterator begin() const { return &body_[0]; }
+  constexpr const_iterator end() const { return &body_[0] + size_; }
+
+  constexpr size_type size() const { return size_; }
+  constexpr bool empty() const { return size_ == 0; }
+
+  template <typename V>
+  constexpr const_iterator lower_bound(const V& v) const {
+    const_iterator res =
+        detail::branchless_lower_bound<N>::apply(&body_[0], v, comp_);
+    return res < end() ? res : end();
+  }
+
+  template <typename V>
+  constexpr const_iterator find(const V& v) const {
+    const_iterator res = lower_bound(v);
+    return res != end() && !comp_(v, *res) ? res : end();
+  }
+
+  template <typename V>
+  constexpr size_type count(const V& v) const {
+    return find(v) != end() ? 1 : 0;
   }
+
+  constexpr key_compare key_comp() const { return comp_; }
+  constexpr value_compare value_comp() const { return comp_; }
+
+  constexpr const underlying_type& body() const { return body_; }
+
+ private:
+  Compare comp_;
+  underlying_type body_;
+  size_type size_;
 };
 
-template <typename Key, typename Comparator, typename UnderlyingType,
-          typename P>
-// requires UnaryPredicate<P(reference)>
-void erase_if(flat_set<Key, Comparator, UnderlyingType>& x, P p) {
-  x.erase(std::remove_if(x.begin(), x.end(), p), x.end());
+namespace detail {
+
+template <typename Key, std::size_t N, typename Compare, std::size_t... Is>
+constexpr frozen_set<Key, N, Compare> make_frozen_set(
+    const frozen_buffer<Key, N>& buf, Compare comp,
+    std::index_sequence<Is...>) {
+  return {std::array<Key, N>{{buf.data[Is]...}}, buf.size, comp};
+}
+
+}  // namespace detail
+
+// Sorts and removes duplicates at compile time:
+//   constexpr auto keywords = srt::make_frozen_set({3, 1, 2, 1});
+template <typename Key, std::size_t N, typename Compare>
+// requires LiteralType<Key> && StrictWeakOrdering<Compare, Key>
+constexpr frozen_set<Key, N, Compare> make_frozen_set(const Key (&keys)[N],
+                                                      Compare comp) {
+  return detail::make_frozen_set(detail::frozen_sort_and_unique(keys, comp),
+                                 comp, std::make_index_sequence<N>{});
+}
+
+template <typename Key, std::size_t N>
+constexpr frozen_set<Key, N> make_frozen_set(const Key (&keys)[N]) {
+  return make_frozen_set(keys, less{});
 }
 
+#endif  // __cplusplus >= 201402L
+
 }  // namespace srt
 
 #endif  // SRT_LIBRARY_H_
@@ -1,17 +1,61 @@
 #include "srt.h"
 
 #include <algorithm>
+#include <cstdlib>
 #include <functional>
+#include <iterator>
 #include <list>
+#include <map>
+#include <memory>
+#include <new>
 #include <numeric>
 #include <random>
 #include <set>
+#include <sstream>
 #include <string>
 #include <vector>
 
 #define CATCH_CONFIG_MAIN
 #include "srt_test_templates.h"
 
+// Counts heap allocations, for the containers that promise not to allocate.
+std::size_t heap_allocations = 0;
+
+// Throwing allocations fail once this many more have succeeded. Negative
+// means never.
+int allocations_before_failure = -1;
+
+void* operator new(std::size_t n) {
+  if (allocations_before_failure == 0) throw std::bad_alloc();
+  if (allocations_before_failure > 0) --allocations_before_failure;
+  ++heap_allocations;
+  if (void* p = std::malloc(n ? n : 1)) return p;
+  throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t n) { return operator new(n); }
+
+void* operator new(std::size_t n, const std::nothrow_t&) noexcept {
+  ++heap_allocations;
+  return std::malloc(n ? n : 1);
+}
+
+void* operator new[](std::size_t n, const std::nothrow_t& tag) noexcept {
+  return operator new(n, tag);
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept {
+  std::free(p);
+}
+
+#if __cplusplus >= 201402L
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+#endif
+
 namespace {
 
 struct strange_cmp : srt::less {
@@ -62,6 +106,37 @@ static_assert(!std::is_default_constructible<no_default_or_copy>::value, "");
 static_assert(!std::is_copy_constructible<no_default_or_copy>::value, "");
 static_assert(!std::is_copy_assignable<no_default_or_copy>::value, "");
 
+struct relocatable_handle {
+  relocatable_handle(int x) : body(new int(x)) {}
+  relocatable_handle(relocatable_handle&&) = default;
+  relocatable_handle& operator=(relocatable_handle&&) = default;
+
+  friend bool operator<(const relocatable_handle& x,
+                        const relocatable_handle& y) {
+    return *x.body < *y.body;
+  }
+
+  std::unique_ptr<int> body;
+};
+
+std_int_vec handles_to_ints(const relocatable_handle* f,
+                            const relocatable_handle* l) {
+  std_int_vec res;
+  for (; f != l; ++f) res.push_back(*f->body);
+  return res;
+}
+
+}  // namespace
+
+namespace srt {
+
+template <>
+struct is_trivially_relocatable<relocatable_handle> : std::true_type {};
+
+}  // namespace srt
+
+namespace {
+
 template <typename I, typename Op>
 void lower_bound_test_run_for_one_input(I f, I l, Op op) {
   for (I looking_for = f; looking_for != l; ++looking_for) {
@@ -161,6 +236,70 @@ TEST_CASE("string_tmp_buffer", "[temporary_buffer]") {
   REQUIRE(in_buffer == vec({"1", "2", "3"}));
 }
 
+TEST_CASE("scratch_arena", "[scratch_arena]") {
+  srt::scratch_arena arena;
+  REQUIRE(0U == arena.capacity());
+
+  void* first = arena.allocate(100);
+  REQUIRE(first);
+  REQUIRE(100U <= arena.capacity());
+  REQUIRE(100U <= arena.used());
+
+  // Does not fit - served outside of the arena.
+  void* nested = arena.allocate(arena.capacity());
+  REQUIRE(nested);
+  REQUIRE(arena.capacity() < arena.high_water_mark());
+
+  arena.deallocate(nested, arena.capacity());
+  arena.deallocate(first, 100);
+  REQUIRE(0U == arena.used());
+
+  // Grows to the high water mark once idle.
+  first = arena.allocate(10);
+  REQUIRE(arena.high_water_mark() <= arena.capacity());
+  nested = arena.allocate(100);
+  REQUIRE(first < nested);
+  auto capacity = arena.capacity();
+  arena.deallocate(nested, 100);
+  arena.deallocate(first, 10);
+
+  for (int i = 0; i < 10; ++i) {
+    void* p = arena.allocate(capacity);
+    REQUIRE(p == first);
+    arena.deallocate(p, capacity);
+  }
+  REQUIRE(capacity == arena.capacity());
+
+  arena.shrink_to_fit();
+  REQUIRE(0U == arena.capacity());
+}
+
+TEST_CASE("scratch_arena_cap", "[scratch_arena]") {
+  srt::scratch_arena arena;
+  arena.set_cap(64);
+
+  void* p = arena.allocate(1000);
+  REQUIRE(p);
+  REQUIRE(arena.capacity() <= 64U);
+  arena.deallocate(p, 1000);
+
+  p = arena.allocate(10);
+  REQUIRE(p);
+  REQUIRE(0U < arena.capacity());
+  REQUIRE(arena.capacity() <= 64U);
+  arena.deallocate(p, 10);
+}
+
+TEST_CASE("tmp_buffer_uses_scratch_arena", "[temporary_buffer]") {
+  srt::scratch_arena& arena = srt::scratch_arena::this_thread();
+  {
+    srt::temporary_buffer<int> buf(100);
+    REQUIRE(100 == buf.capacity());
+    REQUIRE(100 * sizeof(int) <= arena.used());
+  }
+  REQUIRE(0U == arena.used());
+}
+
 struct lower_bound_functor {
   template <typename I, typename V>
   I operator()(I f, I l, const V& v) {
@@ -183,6 +322,17 @@ TEST_CASE("lower_bound_biased", "[algorithms]") {
   lower_bound_test(lower_bound_biased_functor());
 }
 
+struct lower_bound_linear_functor {
+  template <typename I, typename V>
+  I operator()(I f, I l, const V& v) {
+    return srt::lower_bound_linear(f, l, v);
+  }
+};
+
+TEST_CASE("lower_bound_linear", "[algorithms]") {
+  lower_bound_test(lower_bound_linear_functor());
+}
+
 TEST_CASE("lower_bound_hinted", "[algorithms]") {
   std::vector<int> vec(100);
   std::iota(vec.begin(), vec.end(), 1);
@@ -201,6 +351,28 @@ TEST_CASE("rotate_buffered", "[algorithms]") {
   rotate_test([](I f, I m, I l) { return srt::rotate_buffered(f, m, l); });
 }
 
+TEST_CASE("rotate_buffered_relocating", "[algorithms]") {
+  static_assert(srt::is_trivially_relocatable<int>::value, "");
+  static_assert(!srt::is_trivially_relocatable<std::string>::value, "");
+
+  for (int size = 0; size < 10; ++size) {
+    for (int m = 0; m <= size; ++m) {
+      std::vector<relocatable_handle> v;
+      for (int i = 0; i < size; ++i) v.emplace_back(i);
+      std_int_vec expected(static_cast<size_t>(size));
+      std::iota(expected.begin(), expected.end(), 0);
+
+      relocatable_handle* f = v.data();
+      relocatable_handle* res = srt::rotate_buffered(f, f + m, f + size);
+      auto expected_res =
+          std::rotate(expected.begin(), expected.begin() + m, expected.end());
+
+      REQUIRE(expected_res - expected.begin() == res - f);
+      REQUIRE(expected == handles_to_ints(f, f + size));
+    }
+  }
+}
+
 TEST_CASE("inplace_merge_rotating_middles", "[algorithms]") {
   using I = std_int_vec::iterator;
   inplace_merge_test([](I f, I m, I l) {
@@ -237,6 +409,99 @@ TEST_CASE("set_union_unique_biased", "[algorithms]") {
   set_union_unique_test(set_union_unique_biased{});
 }
 
+struct set_union_take_second {
+  template <typename I1, typename I2, typename O>
+  O operator()(I1 f1, I1 l1, I2 f2, I2 l2, O o) const {
+    return srt::set_union_unique_biased(f1, l1, f2, l2, o, srt::less{},
+                                        srt::take_second{});
+  }
+};
+
+TEST_CASE("set_union_unique_biased_take_second", "[algorithms]") {
+  set_union_unique_test(set_union_take_second{});
+}
+
+TEST_CASE("set_union_combine", "[algorithms]") {
+  using kv = std::pair<int, int>;
+  auto by_key = [](const kv& x, const kv& y) { return x.first < y.first; };
+  auto sum = [](const kv& x, const kv& y) {
+    return kv{x.first, x.second + y.second};
+  };
+
+  std::mt19937 g;
+  std::uniform_int_distribution<> dis(0, 100);
+  for (int i = 0; i < 100; ++i) {
+    std::map<int, int> lhs, rhs;
+    for (int j = 0; j < i; ++j) lhs[dis(g)] = dis(g);
+    for (int j = 0; j < 100 - i; ++j) rhs[dis(g)] = dis(g);
+
+    std::map<int, int> expected = lhs;
+    for (const auto& x : rhs) expected[x.first] += x.second;
+
+    std::vector<kv> lhs_v(lhs.begin(), lhs.end());
+    std::vector<kv> rhs_v(rhs.begin(), rhs.end());
+    std::vector<kv> actual;
+    srt::set_union_combine(lhs_v.begin(), lhs_v.end(), rhs_v.begin(),
+                           rhs_v.end(), std::back_inserter(actual), by_key,
+                           sum);
+    REQUIRE(std::vector<kv>(expected.begin(), expected.end()) == actual);
+  }
+}
+
+TEST_CASE("merge_join", "[algorithms]") {
+  std::mt19937 g;
+  std::uniform_int_distribution<> dis(0, 1000);
+  auto random_set = [&](size_t size) {
+    std::set<int> res;
+    while (res.size() < size) res.insert(dis(g));
+    return std_int_vec(res.begin(), res.end());
+  };
+
+  for (size_t lhs_size : {0u, 1u, 10u, 100u}) {
+    for (size_t rhs_size : {0u, 1u, 10u, 100u, 500u}) {
+      std_int_vec lhs = random_set(lhs_size);
+      std_int_vec rhs = random_set(rhs_size);
+
+      std_int_vec expected_inner;
+      std::set_intersection(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(),
+                            std::back_inserter(expected_inner));
+      std_int_vec expected_anti;
+      std::set_difference(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(),
+                          std::back_inserter(expected_anti));
+
+      std_int_vec inner;
+      srt::merge_join(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(),
+                      srt::less{}, [&](int x, int y) {
+                        REQUIRE(x == y);
+                        inner.push_back(x);
+                      });
+      REQUIRE(expected_inner == inner);
+
+      inner.clear();
+      srt::merge_join(rhs.begin(), rhs.end(), lhs.begin(), lhs.end(),
+                      srt::less{}, [&](int x, int) { inner.push_back(x); });
+      REQUIRE(expected_inner == inner);
+
+      std_int_vec left_matched;
+      std_int_vec left_all;
+      srt::merge_join_left(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(),
+                           srt::less{}, [&](int x, const int* y) {
+                             left_all.push_back(x);
+                             if (!y) return;
+                             REQUIRE(x == *y);
+                             left_matched.push_back(x);
+                           });
+      REQUIRE(lhs == left_all);
+      REQUIRE(expected_inner == left_matched);
+
+      std_int_vec anti;
+      srt::merge_join_anti(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(),
+                           srt::less{}, [&](int x) { anti.push_back(x); });
+      REQUIRE(expected_anti == anti);
+    }
+  }
+}
+
 TEST_CASE("resize_with_junk int", "[algorithms]") {
   std_int_vec v;
   int int_sample = 0;
@@ -569,193 +834,1738 @@ TEST_CASE("flat_set_insert_f_l_weird_types", "[flat_cainers, flat_set]") {
   REQUIRE(expected == c.body());
 }
 
-TEST_CASE("flat_set_erase_pos", "[flat_cainers, flat_set]") {
-  {
-    int_set c{1, 2, 3, 4, 5, 6, 7, 8};
-    std_int_vec expected;
+TEST_CASE("flat_set_insert_f_l_strategies", "[flat_cainers, flat_set]") {
+  std::mt19937 g;
+  std::uniform_int_distribution<> dis(1, 10000);
+  auto rand_int = [&] { return dis(g); };
 
-    int_set::iterator it = c.erase(std::next(c.cbegin(), 3));
-    REQUIRE(std::next(c.cbegin(), 3) == it);
-    expected = {1, 2, 3, 5, 6, 7, 8};
-    REQUIRE(expected == c.body());
+  for (size_t c_size : {0, 1, 2, 10, 100, 1000}) {
+    for (size_t range_size : {1, 2, 10, 100, 1000}) {
+      std_int_vec already_in(c_size);
+      std::generate(already_in.begin(), already_in.end(), rand_int);
 
-    it = c.erase(std::next(c.begin(), 0));
-    REQUIRE(c.begin() == it);
-    expected = {2, 3, 5, 6, 7, 8};
-    REQUIRE(expected == c.body());
+      std_int_vec new_elements(range_size);
+      std::generate(new_elements.begin(), new_elements.end(), rand_int);
 
-    it = c.erase(std::next(c.cbegin(), 5));
-    REQUIRE(c.end() == it);
-    expected = {2, 3, 5, 6, 7};
-    REQUIRE(expected == c.body());
+      std::set<int, std::greater<int>> expected(already_in.begin(),
+                                                already_in.end());
+      expected.insert(new_elements.begin(), new_elements.end());
+
+      {
+        reverse_set actual(already_in);
+        actual.insert(new_elements.begin(), new_elements.end());
+        REQUIRE(std::equal(expected.begin(), expected.end(), actual.begin()));
+        REQUIRE(expected.size() == actual.size());
+      }
+      {
+        std::sort(new_elements.begin(), new_elements.end(),
+                  std::greater<int>());
+        reverse_set actual(already_in);
+        actual.insert(new_elements.begin(), new_elements.end());
+        REQUIRE(std::equal(expected.begin(), expected.end(), actual.begin()));
+        REQUIRE(expected.size() == actual.size());
+      }
+      {
+        new_elements.erase(
+            std::unique(new_elements.begin(), new_elements.end()),
+            new_elements.end());
+        reverse_set actual(already_in);
+        actual.insert(new_elements.begin(), new_elements.end());
+        REQUIRE(std::equal(expected.begin(), expected.end(), actual.begin()));
+        REQUIRE(expected.size() == actual.size());
+      }
+    }
+  }
+}
 
-    it = c.erase(std::next(c.cbegin(), 1));
-    REQUIRE(std::next(c.begin()) == it);
-    expected = {2, 5, 6, 7};
-    REQUIRE(expected == c.body());
+TEST_CASE("flat_set_insert_f_l_keeps_existing", "[flat_cainers, flat_set]") {
+  struct tagged {
+    int key;
+    bool is_new;
 
-    it = c.erase(std::next(c.cbegin(), 2));
-    REQUIRE(std::next(c.begin(), 2) == it);
-    expected = {2, 5, 7};
-    REQUIRE(expected == c.body());
+    bool operator<(const tagged& x) const { return key < x.key; }
+  };
 
-    it = c.erase(std::next(c.cbegin(), 2));
-    REQUIRE(std::next(c.begin(), 2) == it);
-    expected = {2, 5};
-    REQUIRE(expected == c.body());
+  for (int c_size : {0, 1, 5, 100, 1000}) {
+    for (int range_size : {1, 5, 100, 1000}) {
+      std::vector<tagged> already_in;
+      for (int i = 0; i < c_size; ++i) already_in.push_back({i * 2, false});
 
-    it = c.erase(std::next(c.cbegin(), 0));
-    REQUIRE(std::next(c.begin(), 0) == it);
-    expected = {5};
-    REQUIRE(expected == c.body());
+      std::vector<tagged> new_elements;
+      for (int i = range_size; i; --i) new_elements.push_back({i, true});
 
-    it = c.erase(c.begin());
-    REQUIRE(c.begin() == it);
-    REQUIRE(c.end() == it);
-  }
-  //  This is LWG #2059.
-  //  There is a potential ambiguity between erase with an iterator and erase
-  //  with a key, if key has a templated constructor.
-  {
-    srt::flat_set<template_constructor> c;
-    template_constructor v(0);
+      srt::flat_set<tagged> c(already_in.begin(), already_in.end());
+      c.insert(new_elements.begin(), new_elements.end());
 
-    auto it = c.find(v);
-    if (it != c.end()) c.erase(it);
+      for (const tagged& x : c) {
+        const bool was_in = x.key % 2 == 0 && x.key < c_size * 2;
+        REQUIRE(was_in != x.is_new);
+      }
+    }
   }
 }
 
-TEST_CASE("flat_set_erase_range", "[flat_cainers, flat_set]") {
-  int_set c{1, 2, 3, 4, 5, 6, 7, 8};
+TEST_CASE("flat_set_insert_f_l_reuses_scratch", "[flat_cainers, flat_set]") {
+  std::mt19937 g;
+  std::uniform_int_distribution<> dis(1, 10000);
+  auto rand_int = [&] { return dis(g); };
 
-  int_set::iterator it =
-      c.erase(std::next(c.cbegin(), 5), std::next(c.cbegin(), 5));
-  REQUIRE(std::next(c.begin(), 5) == it);
-  std_int_vec expected = {1, 2, 3, 4, 5, 6, 7, 8};
-  REQUIRE(expected == c.body());
+  std_int_vec already_in(1000);
+  std::generate(already_in.begin(), already_in.end(), rand_int);
+  std_int_vec new_elements(500);
+
+  srt::scratch_arena& arena = srt::scratch_arena::this_thread();
+  std::size_t capacity = 0;
+  for (int i = 0; i < 10; ++i) {
+    std::generate(new_elements.begin(), new_elements.end(), rand_int);
+    int_set c(already_in);
+    c.insert(new_elements.begin(), new_elements.end());
+    if (!i) capacity = arena.capacity();
+    REQUIRE(new_elements.size() * sizeof(int) <= arena.capacity());
+    REQUIRE(capacity == arena.capacity());
+  }
+}
 
-  it = c.erase(std::next(c.cbegin(), 3), std::next(c.cbegin(), 4));
-  REQUIRE(std::next(c.begin(), 3) == it);
-  expected = {1, 2, 3, 5, 6, 7, 8};
-  REQUIRE(expected == c.body());
+TEST_CASE("flat_set_scratch_overloads", "[flat_cainers, flat_set]") {
+  std::mt19937 g;
+  std::uniform_int_distribution<> dis(1, 1000);
+  auto rand_int = [&] { return dis(g); };
 
-  it = c.erase(std::next(c.cbegin(), 2), std::next(c.cbegin(), 5));
-  REQUIRE(std::next(c.begin(), 2) == it);
-  expected = {1, 2, 7, 8};
-  REQUIRE(expected == c.body());
+  std_int_vec scratch;
+  scratch.reserve(1000);
+  const int* scratch_data = scratch.data();
 
-  it = c.erase(std::next(c.cbegin(), 0), std::next(c.cbegin(), 2));
-  REQUIRE(std::next(c.begin(), 0) == it);
-  expected = {7, 8};
-  REQUIRE(expected == c.body());
+  for (size_t c_size : {0, 1, 10, 100, 1000}) {
+    for (size_t range_size : {0, 1, 10, 100}) {
+      std_int_vec already_in(c_size);
+      std::generate(already_in.begin(), already_in.end(), rand_int);
 
-  it = c.erase(c.cbegin(), c.cend());
-  REQUIRE(c.begin() == it);
-  REQUIRE(c.end() == it);
-}
+      std_int_vec new_elements(range_size);
+      std::generate(new_elements.begin(), new_elements.end(), rand_int);
 
-TEST_CASE("flat_set_erase_v", "[flat_cainers, flat_set]") {
-  int_set c{1, 2, 3, 4, 5, 6, 7, 8};
+      std_int_vec expected = already_in;
+      expected.insert(expected.end(), new_elements.begin(), new_elements.end());
+      expected.erase(srt::sort_and_unique(expected.begin(), expected.end()),
+                     expected.end());
 
-  REQUIRE(0U == c.erase(9));
-  std_int_vec expected = {1, 2, 3, 4, 5, 6, 7, 8};
-  REQUIRE(expected == c.body());
+      int_set actual(already_in.begin(), already_in.end(), scratch);
+      REQUIRE(actual.size() == actual.capacity());
+      actual.insert(new_elements.begin(), new_elements.end(), scratch);
+      REQUIRE(expected == actual.body());
 
-  REQUIRE(1U == c.erase(4));
-  expected = {1, 2, 3, 5, 6, 7, 8};
-  REQUIRE(expected == c.body());
+      std::sort(new_elements.begin(), new_elements.end());
+      new_elements.erase(std::unique(new_elements.begin(), new_elements.end()),
+                         new_elements.end());
+      std::istringstream in_stream;
+      {
+        std::ostringstream out_stream;
+        for (int x : new_elements) out_stream << x << ' ';
+        in_stream.str(out_stream.str());
+      }
+
+      int_set actual_sorted(already_in);
+      actual_sorted.insert_sorted_unique(std::istream_iterator<int>(in_stream),
+                                         std::istream_iterator<int>(), scratch);
+      REQUIRE(expected == actual_sorted.body());
+
+      REQUIRE(scratch.empty());
+      REQUIRE(scratch_data == scratch.data());
+    }
+  }
+}
 
-  REQUIRE(1U == c.erase(1));
-  expected = {2, 3, 5, 6, 7, 8};
-  REQUIRE(expected == c.body());
+TEST_CASE("flat_set_insert_sorted_unique_reallocating",
+          "[flat_cainers, flat_set]") {
+  struct counting_int {
+    counting_int(int x, int& moves) : body(x), moves(&moves) {}
+    counting_int(counting_int&& x) noexcept : body(x.body), moves(x.moves) {
+      ++*moves;
+    }
+    counting_int& operator=(counting_int&& x) noexcept {
+      body = x.body;
+      moves = x.moves;
+      ++*moves;
+      return *this;
+    }
 
-  REQUIRE(1U == c.erase(8));
-  expected = {2, 3, 5, 6, 7};
-  REQUIRE(expected == c.body());
+    bool operator<(const counting_int& x) const { return body < x.body; }
 
-  REQUIRE(1U == c.erase(3));
-  expected = {2, 5, 6, 7};
-  REQUIRE(expected == c.body());
+    int body;
+    int* moves;
+  };
 
-  REQUIRE(1U == c.erase(6));
-  expected = {2, 5, 7};
-  REQUIRE(expected == c.body());
+  int moves = 0;
+  srt::flat_set<counting_int> c;
+  c.reserve(4);
+  for (int x : {1, 3, 5, 7}) c.emplace(x, moves);
+  REQUIRE(c.size() == c.capacity());
 
-  REQUIRE(1U == c.erase(7));
-  expected = {2, 5};
-  REQUIRE(expected == c.body());
+  std::vector<counting_int> new_elements;
+  for (int x : {0, 2, 3, 8}) new_elements.emplace_back(x, moves);
 
-  REQUIRE(1U == c.erase(2));
-  expected = {5};
-  REQUIRE(expected == c.body());
+  moves = 0;
+  c.insert_sorted_unique(std::make_move_iterator(new_elements.begin()),
+                         std::make_move_iterator(new_elements.end()));
+  REQUIRE(7 == moves);
 
-  REQUIRE(1U == c.erase(5));
-  expected = {};
-  REQUIRE(expected == c.body());
+  std_int_vec actual;
+  for (const counting_int& x : c) actual.push_back(x.body);
+  REQUIRE(std_int_vec({0, 1, 2, 3, 5, 7, 8}) == actual);
 }
 
-TEST_CASE("flat_set_key_value_compare", "[flat_cainers, flat_set]") {
-  reverse_set c{1, 2, 3, 4, 5};
-
-  REQUIRE(std::is_sorted(c.begin(), c.end(), c.key_comp()));
-  REQUIRE(std::is_sorted(c.begin(), c.end(), c.value_comp()));
+TEST_CASE("raw_vector", "[raw_vector]") {
+  srt::raw_vector<std::string> v{"b", "d"};
+  v.insert(v.begin(), "a");
+  v.insert(v.begin() + 2, {"c"});
+  v.push_back("e");
+  REQUIRE(std::vector<std::string>({"a", "b", "c", "d", "e"}) ==
+          std::vector<std::string>(v.begin(), v.end()));
+
+  v.erase(v.begin() + 1, v.begin() + 3);
+  REQUIRE(srt::raw_vector<std::string>({"a", "d", "e"}) == v);
+
+  v.reserve(10);
+  REQUIRE(10u == v.capacity());
+  ::new (static_cast<void*>(v.data() + v.size())) std::string("f");
+  v.commit_uninitialized(1);
+  REQUIRE(srt::raw_vector<std::string>({"a", "d", "e", "f"}) == v);
+
+  srt::raw_vector<std::string> copy(v);
+  srt::raw_vector<std::string> moved(std::move(v));
+  REQUIRE(copy == moved);
+  REQUIRE(v.empty());
+
+  moved.shrink_to_fit();
+  REQUIRE(moved.size() == moved.capacity());
+  moved.resize(2);
+  REQUIRE(srt::raw_vector<std::string>({"a", "d"}) == moved);
+
+  static_assert(srt::UninitializedTailContainer<decltype(moved)>(), "");
+  static_assert(!srt::UninitializedTailContainer<std::vector<int>>(), "");
+}
 
-  int new_elements[] = {6, 7, 8, 9, 10};
-  std::copy(std::begin(new_elements), std::end(new_elements),
-            std::inserter(c, c.end()));
+TEST_CASE("small_vector", "[small_vector]") {
+  using vec = srt::small_vector<std::string, 4>;
+  auto str = [](int x) { return std::string(20, 'a') + std::to_string(x); };
+  auto to_std = [](const vec& v) {
+    return std::vector<std::string>(v.begin(), v.end());
+  };
 
-  REQUIRE(std::is_sorted(c.begin(), c.end(), c.key_comp()));
-  REQUIRE(std::is_sorted(c.begin(), c.end(), c.value_comp()));
+  vec v;
+  REQUIRE(v.is_inline());
+  REQUIRE(4u == v.capacity());
+
+  for (int i = 0; i < 4; ++i) v.push_back(str(i));
+  REQUIRE(v.is_inline());
+  v.insert(v.begin(), str(4));
+  REQUIRE(!v.is_inline());
+  REQUIRE(std::vector<std::string>({str(4), str(0), str(1), str(2), str(3)}) ==
+          to_std(v));
+
+  vec inline_v{str(5)};
+  vec heap_copy(v);
+  vec heap_moved(std::move(heap_copy));
+  REQUIRE(heap_copy.empty());
+  REQUIRE(heap_copy.is_inline());
+  REQUIRE(v == heap_moved);
+
+  vec inline_moved(std::move(inline_v));
+  REQUIRE(inline_moved.is_inline());
+  REQUIRE(std::vector<std::string>({str(5)}) == to_std(inline_moved));
+
+  swap(inline_moved, heap_moved);
+  REQUIRE(v == inline_moved);
+  REQUIRE(std::vector<std::string>({str(5)}) == to_std(heap_moved));
+  REQUIRE(heap_moved.is_inline());
+
+  v.erase(v.begin() + 1, v.end() - 1);
+  v.shrink_to_fit();
+  REQUIRE(v.is_inline());
+  REQUIRE(std::vector<std::string>({str(4), str(3)}) == to_std(v));
+
+  v = inline_moved;
+  REQUIRE(v == inline_moved);
+  v = std::move(heap_moved);
+  REQUIRE(std::vector<std::string>({str(5)}) == to_std(v));
+
+  static_assert(4 == srt::InlineCapacity<vec>(), "");
+  static_assert(0 == srt::InlineCapacity<std::vector<int>>(), "");
 }
 
-TEST_CASE("flat_set_count", "[flat_cainers, flat_set]") {
-  const int_set c{5, 6, 7, 8, 9, 10, 11, 12};
+namespace {
 
-  REQUIRE(1U == c.count(5));
-  REQUIRE(1U == c.count(6));
-  REQUIRE(1U == c.count(7));
-  REQUIRE(1U == c.count(8));
-  REQUIRE(1U == c.count(9));
-  REQUIRE(1U == c.count(10));
-  REQUIRE(1U == c.count(11));
-  REQUIRE(1U == c.count(12));
-  REQUIRE(0U == c.count(4));
-}
+int throwing_copies_left = 1000;
+int throwing_copy_live = 0;
 
-TEST_CASE("flat_set_find", "[flat_cainers, flat_set]") {
-  {
-    int_set c{5, 6, 7, 8, 9, 10, 11, 12};
+// Copies throw once throwing_copies_left runs out.
+template <bool NothrowMove>
+struct throwing_copy {
+  explicit throwing_copy(int x) : body(x) { ++throwing_copy_live; }
 
-    int_set::iterator it = c.find(5);
-    REQUIRE(c.begin() == it);
-    REQUIRE(std::next(c.begin()) == c.find(6));
-    REQUIRE(std::next(c.begin(), 2) == c.find(7));
-    REQUIRE(std::next(c.begin(), 3) == c.find(8));
-    REQUIRE(std::next(c.begin(), 4) == c.find(9));
-    REQUIRE(std::next(c.begin(), 5) == c.find(10));
-    REQUIRE(std::next(c.begin(), 6) == c.find(11));
-    REQUIRE(std::next(c.begin(), 7) == c.find(12));
-    REQUIRE(std::next(c.begin(), 8) == c.find(4));
+  throwing_copy(const throwing_copy& x) : body(x.body) {
+    if (!throwing_copies_left--) throw 0;
+    ++throwing_copy_live;
   }
-  {
-    const int_set c({5, 6, 7, 8, 9, 10, 11, 12});
 
-    int_set::const_iterator it = c.find(5);
-    REQUIRE(c.begin() == it);
-    REQUIRE(std::next(c.begin()) == c.find(6));
-    REQUIRE(std::next(c.begin(), 2) == c.find(7));
-    REQUIRE(std::next(c.begin(), 3) == c.find(8));
-    REQUIRE(std::next(c.begin(), 4) == c.find(9));
-    REQUIRE(std::next(c.begin(), 5) == c.find(10));
-    REQUIRE(std::next(c.begin(), 6) == c.find(11));
-    REQUIRE(std::next(c.begin(), 7) == c.find(12));
-    REQUIRE(std::next(c.begin(), 8) == c.find(4));
+  throwing_copy(throwing_copy&& x) noexcept(NothrowMove) : body(x.body) {
+    ++throwing_copy_live;
   }
-}
 
-TEST_CASE("flat_set_equal_range", "[flat_cainers, flat_set]") {
-  {
-    int_set c({5, 7, 9, 11, 13, 15, 17, 19});
+  throwing_copy& operator=(const throwing_copy& x) {
+    if (!throwing_copies_left--) throw 0;
+    body = x.body;
+    return *this;
+  }
+
+  throwing_copy& operator=(throwing_copy&& x) noexcept {
+    body = x.body;
+    return *this;
+  }
+
+  ~throwing_copy() { --throwing_copy_live; }
+
+  friend bool operator<(const throwing_copy& x, const throwing_copy& y) {
+    return x.body < y.body;
+  }
+
+  int body;
+};
+
+}  // namespace
+
+TEST_CASE("small_vector_push_back_own_element", "[small_vector]") {
+  auto str = [](int x) { return std::string(20, 'a') + std::to_string(x); };
+
+  srt::raw_vector<std::string> v{str(0)};
+  std::vector<std::string> expected{str(0)};
+  for (int i = 0; i < 5; ++i) {
+    v.shrink_to_fit();
+    REQUIRE(v.size() == v.capacity());
+    v.push_back(v.front());
+    v.emplace_back(v.back());
+    expected.push_back(str(0));
+    expected.push_back(str(0));
+  }
+  REQUIRE(expected == std::vector<std::string>(v.begin(), v.end()));
+
+  srt::small_vector<std::string, 2> inline_v{str(1), str(2)};
+  inline_v.push_back(inline_v.front());
+  REQUIRE(std::vector<std::string>({str(1), str(2), str(1)}) ==
+          std::vector<std::string>(inline_v.begin(), inline_v.end()));
+}
+
+TEST_CASE("small_vector_throwing_copy", "[small_vector]") {
+  using elem = throwing_copy<false>;
+  {
+    srt::raw_vector<elem> v;
+    for (int i = 0; i < 4; ++i) v.emplace_back(i);
+    v.shrink_to_fit();
+
+    // The move is not noexcept, so reallocation copies; the third one throws.
+    throwing_copies_left = 2;
+    REQUIRE_THROWS(v.emplace_back(4));
+    throwing_copies_left = 1000;
+    REQUIRE(4 == throwing_copy_live);
+    REQUIRE(4u == v.size());
+    REQUIRE(3 == v.back().body);
+  }
+  REQUIRE(0 == throwing_copy_live);
+}
+
+TEST_CASE("flat_set_insert_into_capacity_throwing_copy",
+          "[flat_cainers, flat_set]") {
+  using elem = throwing_copy<true>;
+  {
+    srt::flat_set<elem, srt::less, srt::raw_vector<elem>> c;
+    for (int i : {1, 3, 5, 7}) c.emplace(i);
+    c.reserve(10);
+
+    std::vector<elem> new_elements;
+    for (int i : {0, 2, 4, 6, 8}) new_elements.emplace_back(i);
+
+    // New elements are copied into the capacity from the back: 8 and 6 are
+    // built in the raw memory before the copy of 4 throws.
+    throwing_copies_left = 2;
+    REQUIRE_THROWS(
+        c.insert_sorted_unique(new_elements.begin(), new_elements.end()));
+    throwing_copies_left = 1000;
+    REQUIRE(static_cast<int>(c.size() + new_elements.size()) ==
+            throwing_copy_live);
+  }
+  REQUIRE(0 == throwing_copy_live);
+}
+
+TEST_CASE("small_flat_set", "[flat_cainers, flat_set]") {
+  std::mt19937 g;
+  std::uniform_int_distribution<> dis(1, 40);
+
+  srt::small_flat_set<int, 16> c;
+  std::set<int> expected;
+  for (int i = 0; i < 100; ++i) {
+    int x = dis(g);
+    c.insert(x);
+    expected.insert(x);
+    REQUIRE(std_int_vec(expected.begin(), expected.end()) ==
+            std_int_vec(c.begin(), c.end()));
+
+    for (int y = 0; y <= 41; ++y) {
+      REQUIRE(expected.count(y) == c.count(y));
+      REQUIRE(static_cast<size_t>(
+                  std::distance(expected.begin(), expected.lower_bound(y))) ==
+              static_cast<size_t>(c.lower_bound(y) - c.begin()));
+    }
+  }
+}
+
+TEST_CASE("static_flat_set", "[flat_cainers, flat_set]") {
+  using set = srt::static_flat_set<int, 4>;
+
+  set c{3, 1};
+  REQUIRE(c.insert(2).second);
+  REQUIRE(!c.insert(2).second);
+  REQUIRE(c.end() != c.insert(2).first);
+  auto inserted = c.insert(c.end(), 4);
+  REQUIRE(inserted == c.end() - 1);
+  REQUIRE(c.full());
+
+  REQUIRE(c.insert(5) == std::make_pair(c.end(), false));
+  REQUIRE(c.insert(c.begin(), 0) == c.end());
+  REQUIRE(c.emplace(3).first == c.begin() + 2);
+  REQUIRE(std_int_vec({1, 2, 3, 4}) == std_int_vec(c.begin(), c.end()));
+
+  set truncated{5, 4, 3, 2, 1};
+  REQUIRE(std_int_vec({2, 3, 4, 5}) ==
+          std_int_vec(truncated.begin(), truncated.end()));
+
+  static_assert(sizeof(set) >= 8 * sizeof(int), "both regions are inline");
+}
+
+TEST_CASE("static_flat_set_insert_f_l", "[flat_cainers, flat_set]") {
+  using set = srt::static_flat_set<std::string, 10>;
+  auto str = [](int x) { return std::string(20, 'a') + std::to_string(x); };
+
+  std::mt19937 g;
+  std::uniform_int_distribution<> dis(1, 20);
+
+  for (int test = 0; test < 100; ++test) {
+    std::vector<std::string> already_in(static_cast<size_t>(test % 8));
+    std::generate(already_in.begin(), already_in.end(),
+                  [&] { return str(dis(g)); });
+    std::vector<std::string> new_elements(static_cast<size_t>(test % 13));
+    std::generate(new_elements.begin(), new_elements.end(),
+                  [&] { return str(dis(g)); });
+
+    set c(already_in.begin(), already_in.end());
+    auto stopped = c.insert(new_elements.begin(), new_elements.end());
+
+    std::set<std::string> expected(already_in.begin(), already_in.end());
+    auto expected_stop = new_elements.begin();
+    for (; expected_stop != new_elements.end(); ++expected_stop) {
+      if (expected.size() == 10 && !expected.count(*expected_stop)) break;
+      expected.insert(*expected_stop);
+    }
+
+    REQUIRE(expected_stop == stopped);
+    REQUIRE(std::vector<std::string>(expected.begin(), expected.end()) ==
+            std::vector<std::string>(c.begin(), c.end()));
+  }
+}
+
+TEST_CASE("static_flat_set_insert_sorted_unique", "[flat_cainers, flat_set]") {
+  srt::static_flat_set<move_only_int, 4> c;
+  c.emplace(2);
+
+  std::vector<move_only_int> fits;
+  for (int x : {1, 2, 3}) fits.emplace_back(x);
+  REQUIRE(fits.end() == c.insert_sorted_unique(
+                            std::make_move_iterator(fits.begin()),
+                            std::make_move_iterator(fits.end()))
+                            .base());
+
+  std::vector<move_only_int> overflows;
+  for (int x : {0, 2, 4, 5}) overflows.emplace_back(x);
+  auto stopped = c.insert_sorted_unique(
+      std::make_move_iterator(overflows.begin()),
+      std::make_move_iterator(overflows.end()));
+  REQUIRE(overflows.begin() + 2 == stopped.base());
+  REQUIRE(4 == overflows[2].body);
+
+  std::vector<move_only_int> expected;
+  for (int x : {0, 1, 2, 3}) expected.emplace_back(x);
+  REQUIRE(std::equal(expected.begin(), expected.end(), c.begin()));
+}
+
+TEST_CASE("static_flat_set_apply_delta", "[flat_cainers, flat_set]") {
+  using delta = std::vector<std::pair<int, bool>>;
+  srt::static_flat_set<int, 4> c{1, 2, 3};
+
+  // Reinserting 2 and 3 does not need room.
+  delta ops = {{2, true}, {3, true}, {4, true}};
+  REQUIRE(c.apply_delta(ops.begin(), ops.end()));
+  REQUIRE(std_int_vec({1, 2, 3, 4}) == std_int_vec(c.begin(), c.end()));
+
+  ops = {{0, true}, {5, true}, {6, false}};
+  REQUIRE(!c.apply_delta(ops.begin(), ops.end()));
+  REQUIRE(std_int_vec({1, 2, 3, 4}) == std_int_vec(c.begin(), c.end()));
+
+  ops = {{0, true}, {2, false}, {3, false}, {5, true}};
+  REQUIRE(c.apply_delta(ops.begin(), ops.end()));
+  REQUIRE(std_int_vec({0, 1, 4, 5}) == std_int_vec(c.begin(), c.end()));
+
+  ops = {{1, false}, {5, false}};
+  REQUIRE(c.apply_delta(ops.begin(), ops.end()));
+  REQUIRE(std_int_vec({0, 4}) == std_int_vec(c.begin(), c.end()));
+}
+
+TEST_CASE("static_flat_set_erase_keys", "[flat_cainers, flat_set]") {
+  // The scratch region is a static_vector: going over its capacity would
+  // reach no_heap_allocator and terminate. Nothing else may allocate.
+  using set = srt::static_flat_set<int, 4>;
+  static_assert(
+      std::is_same<srt::detail::no_heap_allocator<int>,
+                   set::underlying_type::allocator_type>::value,
+      "");
+  set c{1, 2, 3, 4};
+
+  std_int_vec keys = {9, 4, 8, 7, 6, 5, 4, 3, 0, 1, 11};
+  const std::size_t allocations = heap_allocations;
+  REQUIRE(3u == c.erase_keys(keys.begin(), keys.end()));
+  REQUIRE(allocations == heap_allocations);
+  REQUIRE(std_int_vec({2}) == std_int_vec(c.begin(), c.end()));
+
+  c = {1, 2, 3, 4};
+  std::list<int> list_keys = {5, 6, 7, 8, 9, 10, 2};
+  const std::size_t list_allocations = heap_allocations;
+  REQUIRE(1u == c.erase_keys(list_keys.begin(), list_keys.end()));
+  REQUIRE(list_allocations == heap_allocations);
+  REQUIRE(std_int_vec({1, 3, 4}) == std_int_vec(c.begin(), c.end()));
+}
+
+TEST_CASE("chunked_flat_set", "[flat_cainers, chunked_flat_set]") {
+  using set = srt::chunked_flat_set<int, srt::less, 4>;
+  std::mt19937 g;
+  std::uniform_int_distribution<> dis(1, 100);
+
+  set c;
+  std::set<int> expected;
+  auto check = [&] {
+    REQUIRE(expected.size() == c.size());
+    REQUIRE(std_int_vec(expected.begin(), expected.end()) ==
+            std_int_vec(c.begin(), c.end()));
+    REQUIRE(std_int_vec(expected.rbegin(), expected.rend()) ==
+            std_int_vec(c.rbegin(), c.rend()));
+    for (int x = 0; x <= 101; ++x) {
+      REQUIRE(expected.count(x) == c.count(x));
+      REQUIRE(std::distance(expected.begin(), expected.lower_bound(x)) ==
+              std::distance(c.begin(), c.lower_bound(x)));
+      REQUIRE(std::distance(expected.begin(), expected.upper_bound(x)) ==
+              std::distance(c.begin(), c.upper_bound(x)));
+    }
+  };
+
+  for (int i = 0; i < 300; ++i) {
+    int x = dis(g);
+    if (i % 50 == 49) {
+      std_int_vec bulk(static_cast<size_t>(dis(g) / 4));
+      std::generate(bulk.begin(), bulk.end(), [&] { return dis(g); });
+      c.insert(bulk.begin(), bulk.end());
+      expected.insert(bulk.begin(), bulk.end());
+    } else if (i % 3 == 0) {
+      auto pos = c.find(x);
+      if (pos != c.end()) {
+        auto next = c.erase(pos);
+        auto expected_next = expected.upper_bound(x);
+        REQUIRE((expected_next == expected.end()) == (next == c.end()));
+        if (next != c.end()) REQUIRE(*expected_next == *next);
+      }
+      expected.erase(x);
+    } else {
+      auto res = c.insert(x);
+      REQUIRE(res.second == expected.insert(x).second);
+      REQUIRE(x == *res.first);
+    }
+    check();
+  }
+
+  REQUIRE(c.block_count() > 1);
+  while (!c.empty()) {
+    expected.erase(*c.begin());
+    c.erase(c.begin());
+    check();
+  }
+  REQUIRE(0u == c.block_count());
+}
+
+TEST_CASE("chunked_flat_set_strings", "[flat_cainers, chunked_flat_set]") {
+  auto str = [](int x) { return std::string(20, 'a') + std::to_string(x); };
+  std::vector<std::string> keys;
+  for (int i = 0; i < 100; ++i) keys.push_back(str(i * 7 % 100));
+
+  srt::chunked_flat_set<std::string, srt::less, 8> c(keys.begin(),
+                                                     keys.end());
+  std::set<std::string> expected(keys.begin(), keys.end());
+  REQUIRE(std::equal(expected.begin(), expected.end(), c.begin()));
+  REQUIRE(c.block_count() >= 100 / 8);
+
+  for (int i = 0; i < 100; i += 2) c.erase(str(i));
+  for (int i = 0; i < 100; i += 2) expected.erase(str(i));
+  REQUIRE(expected.size() == c.size());
+  REQUIRE(std::equal(expected.begin(), expected.end(), c.begin()));
+}
+
+TEST_CASE("buffered_flat_set", "[flat_cainers, buffered_flat_set]") {
+  auto str = [](int x) { return std::string(20, 'a') + std::to_string(x); };
+  std::mt19937 g;
+  std::uniform_int_distribution<> dis(1, 200);
+
+  srt::buffered_flat_set<std::string> c;
+  std::set<std::string> expected;
+  bool flushed_once = false;
+
+  for (int i = 0; i < 2000; ++i) {
+    std::string x = str(dis(g));
+    if (i % 3 == 0) {
+      REQUIRE(expected.erase(x) == c.erase(x));
+    } else {
+      REQUIRE(expected.insert(x).second == c.insert(x));
+    }
+    REQUIRE(expected.size() == c.size());
+    REQUIRE(expected.count(x) == c.count(x));
+    flushed_once = flushed_once || c.buffer_size() == 0;
+
+    if (i % 100 == 99) {
+      REQUIRE(std::vector<std::string>(expected.begin(), expected.end()) ==
+              std::vector<std::string>(c.begin(), c.end()));
+      REQUIRE(0u == c.buffer_size());
+    }
+  }
+  REQUIRE(flushed_once);
+
+  std::vector<std::string> bulk{str(1000), str(1), str(1001)};
+  c.insert(bulk.begin(), bulk.end());
+  expected.insert(bulk.begin(), bulk.end());
+  REQUIRE(std::vector<std::string>(expected.begin(), expected.end()) ==
+          std::vector<std::string>(c.begin(), c.end()));
+}
+
+TEST_CASE("buffered_flat_set_tombstones", "[flat_cainers, buffered_flat_set]") {
+  srt::buffered_flat_set<int> c{1, 2, 3, 4};
+  REQUIRE(1u == c.erase(2));
+  REQUIRE(0u == c.erase(2));
+  REQUIRE(1u == c.buffer_size());
+  REQUIRE(!c.contains(2));
+  REQUIRE(c.insert(2));
+  REQUIRE(0u == c.buffer_size());
+  REQUIRE(c.insert(5));
+  REQUIRE(1u == c.erase(5));
+  REQUIRE(0u == c.buffer_size());
+
+  c.erase(1);
+  c.insert(0);
+  REQUIRE(2u == c.buffer_size());
+  REQUIRE(c.end() == c.find(1));
+  REQUIRE(0u == c.buffer_size());
+  REQUIRE(std_int_vec({0, 2, 3, 4}) == std_int_vec(c.begin(), c.end()));
+}
+
+TEST_CASE("buffered_flat_set_const_reads",
+          "[flat_cainers, buffered_flat_set]") {
+  srt::buffered_flat_set<int> x{1, 2, 3};
+  x.erase(2);
+  x.insert(4);
+  srt::buffered_flat_set<int> y{1, 3, 4};
+
+  const auto& cx = x;
+  REQUIRE(cx.contains(4));
+  REQUIRE(!cx.contains(2));
+  REQUIRE(cx == y);
+  REQUIRE(y == cx);
+  REQUIRE(2u == cx.buffer_size());
+
+  y.insert(5);
+  REQUIRE(cx != y);
+}
+
+TEST_CASE("gap_flat_set", "[flat_cainers, gap_flat_set]") {
+  auto str = [](int x) {
+    std::string res = std::to_string(x);
+    return std::string(20 - res.size(), '0') + res;
+  };
+  std::mt19937 g;
+  std::uniform_int_distribution<> dis(1, 300);
+  std::uniform_int_distribution<> step(-3, 3);
+
+  srt::gap_flat_set<std::string> c;
+  std::set<std::string> expected;
+  auto hint = c.begin();
+  int cursor = 150;
+
+  for (int i = 0; i < 2000; ++i) {
+    if (i % 200 == 0) cursor = dis(g);
+    cursor += step(g);
+    std::string x = str(cursor);
+
+    if (i % 4 == 0) {
+      REQUIRE(expected.erase(x) == c.erase(x));
+      hint = c.lower_bound(x);
+    } else {
+      bool inserted = expected.insert(x).second;
+      REQUIRE(inserted == !c.count(x));
+      hint = c.insert(hint, x);
+      REQUIRE(x == *hint);
+    }
+
+    REQUIRE(expected.size() == c.size());
+    REQUIRE(std::distance(expected.begin(), expected.lower_bound(x)) ==
+            c.lower_bound(x) - c.begin());
+    REQUIRE(std::distance(expected.begin(), expected.upper_bound(x)) ==
+            c.upper_bound(x) - c.begin());
+  }
+
+  REQUIRE(std::vector<std::string>(expected.begin(), expected.end()) ==
+          std::vector<std::string>(c.begin(), c.end()));
+  REQUIRE(std::vector<std::string>(expected.rbegin(), expected.rend()) ==
+          std::vector<std::string>(c.rbegin(), c.rend()));
+
+  srt::gap_flat_set<std::string> copy(c);
+  REQUIRE(copy == c);
+  srt::gap_flat_set<std::string> moved(std::move(copy));
+  REQUIRE(moved == c);
+  REQUIRE(copy.empty());
+}
+
+TEST_CASE("gap_flat_set_gap_position", "[flat_cainers, gap_flat_set]") {
+  srt::gap_flat_set<int> c{1, 3, 5, 7, 9};
+  REQUIRE(5u == c.capacity());
+
+  c.insert(4);
+  REQUIRE(3u == c.gap_position());
+  REQUIRE(std_int_vec({1, 3, 4, 5, 7, 9}) == std_int_vec(c.begin(), c.end()));
+
+  c.erase(3);
+  REQUIRE(1u == c.gap_position());
+  REQUIRE(c.end() == c.find(3));
+  REQUIRE(4 == *c.find(4));
+  REQUIRE(c.begin() + 1 == c.lower_bound(2));
+
+  c.insert({2, 6, 8});
+  REQUIRE(std_int_vec({1, 2, 4, 5, 6, 7, 8, 9}) ==
+          std_int_vec(c.begin(), c.end()));
+
+  srt::gap_flat_set<relocatable_handle> handles;
+  for (int x : {5, 1, 3, 2, 4}) handles.emplace(x);
+  handles.erase(handles.begin() + 2);
+  std_int_vec actual;
+  for (const relocatable_handle& x : handles) actual.push_back(*x.body);
+  REQUIRE(std_int_vec({1, 2, 4, 5}) == actual);
+}
+
+TEST_CASE("lazy_erase_flat_set", "[flat_cainers, lazy_erase_flat_set]") {
+  srt::lazy_erase_flat_set<int> c{1, 2, 3, 4, 5, 6, 7, 8};
+  c.set_max_dead_percent(100);
+
+  REQUIRE(1u == c.erase(3));
+  REQUIRE(0u == c.erase(3));
+  REQUIRE(1u == c.erase(1));
+  REQUIRE(1u == c.erase(8));
+  REQUIRE(3u == c.dead_count());
+  REQUIRE(5u == c.size());
+  REQUIRE(std_int_vec({2, 4, 5, 6, 7}) == std_int_vec(c.begin(), c.end()));
+  REQUIRE(std_int_vec({7, 6, 5, 4, 2}) == std_int_vec(c.rbegin(), c.rend()));
+
+  REQUIRE(c.end() == c.find(3));
+  REQUIRE(0u == c.count(1));
+  REQUIRE(4 == *c.lower_bound(3));
+  REQUIRE(4 == *c.upper_bound(2));
+  REQUIRE(c.end() == c.lower_bound(8));
+
+  // Reviving a dead slot.
+  REQUIRE(c.insert(3).second);
+  REQUIRE(!c.insert(3).second);
+  REQUIRE(2u == c.dead_count());
+  REQUIRE(c.insert(10).second);
+  REQUIRE(std_int_vec({2, 3, 4, 5, 6, 7, 10}) ==
+          std_int_vec(c.begin(), c.end()));
+
+  c.insert({9, 1, 11});
+  REQUIRE(0u == c.dead_count());
+  REQUIRE(std_int_vec({1, 2, 3, 4, 5, 6, 7, 9, 10, 11}) ==
+          std_int_vec(c.begin(), c.end()));
+
+  c.erase(c.find(5));
+  c.compact();
+  REQUIRE(0u == c.dead_count());
+  REQUIRE(std_int_vec({1, 2, 3, 4, 6, 7, 9, 10, 11}) ==
+          std_int_vec(c.begin(), c.end()));
+}
+
+TEST_CASE("lazy_erase_flat_set_compaction",
+          "[flat_cainers, lazy_erase_flat_set]") {
+  srt::lazy_erase_flat_set<std::string> c;
+  std::set<std::string> expected;
+  for (int i = 0; i < 100; ++i) {
+    c.insert(std::to_string(i));
+    expected.insert(std::to_string(i));
+  }
+
+  for (int i = 0; i < 100; i += 3) {
+    c.erase(std::to_string(i));
+    expected.erase(std::to_string(i));
+    REQUIRE(c.dead_count() * 2 <= c.size() + c.dead_count());
+  }
+  REQUIRE(std::vector<std::string>(expected.begin(), expected.end()) ==
+          std::vector<std::string>(c.begin(), c.end()));
+
+  while (!c.empty()) c.erase(c.begin());
+  REQUIRE(c.begin() == c.end());
+  REQUIRE(0u == c.dead_count());
+}
+
+TEST_CASE("lazy_erase_flat_set_revive_assigns",
+          "[flat_cainers, lazy_erase_flat_set]") {
+  using entry = std::pair<int, int>;
+  auto by_first = [](const entry& x, const entry& y) {
+    return x.first < y.first;
+  };
+  srt::lazy_erase_flat_set<entry, decltype(by_first)> c(
+      {entry{1, 0}, entry{2, 0}}, by_first);
+  c.set_max_dead_percent(100);
+
+  REQUIRE(1u == c.erase(entry{2, 0}));
+  REQUIRE(c.insert(entry{2, 5}).second);
+  REQUIRE(5 == c.find(entry{2, 0})->second);
+}
+
+TEST_CASE("lazy_erase_flat_set_erase_returns_next",
+          "[flat_cainers, lazy_erase_flat_set]") {
+  srt::lazy_erase_flat_set<int> c{1, 2, 3, 4, 5, 6, 7, 8, 9, 10};
+
+  // Erase the even numbers, compacting along the way.
+  for (auto it = c.begin(); it != c.end();) {
+    if (*it % 2 == 0) {
+      it = c.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  REQUIRE(std_int_vec({1, 3, 5, 7, 9}) == std_int_vec(c.begin(), c.end()));
+
+  // Every erase compacts.
+  c.set_max_dead_percent(0);
+  auto it = c.erase(c.find(5));
+  REQUIRE(0u == c.dead_count());
+  REQUIRE(7 == *it);
+  REQUIRE(c.end() == c.erase(c.find(9)));
+  REQUIRE(std_int_vec({1, 3, 7}) == std_int_vec(c.begin(), c.end()));
+}
+
+TEST_CASE("flat_map", "[flat_cainers, flat_map]") {
+  using map = srt::flat_map<int, std::string>;
+  map c{{3, "c"}, {1, "a"}, {2, "b"}};
+
+  REQUIRE(3u == c.size());
+  REQUIRE(1 == c.begin()->first);
+  REQUIRE("b" == c.find(2)->second);
+  REQUIRE(c.end() == c.find(4));
+  REQUIRE(1u == c.count(3));
+  REQUIRE(3 == c.lower_bound(3)->first);
+  REQUIRE(c.end() == c.upper_bound(3));
+
+  REQUIRE(!c.insert(map::value_type(2, "x")).second);
+  REQUIRE("b" == c.find(2)->second);
+
+  REQUIRE(c.try_emplace(4, 3, 'd').second);
+  REQUIRE("ddd" == c.find(4)->second);
+  REQUIRE(!c.try_emplace(4, "x").second);
+
+  c[5] = "e";
+  c[1] += "a";
+  REQUIRE("aa" == c[1]);
+  REQUIRE(5u == c.size());
+
+  REQUIRE(!c.insert_or_assign(5, "ee").second);
+  REQUIRE(c.insert_or_assign(0, "z").second);
+  REQUIRE("ee" == c[5]);
+  REQUIRE("z" == c[0]);
+
+  REQUIRE(1u == c.erase(0));
+  REQUIRE(0u == c.erase(0));
+  srt::erase_if(c, [](const map::value_type& x) { return x.first % 2 == 0; });
+
+  std::vector<map::value_type> expected = {{1, "aa"}, {3, "c"}, {5, "ee"}};
+  REQUIRE(expected == c.body());
+}
+
+bool int_greater(const int& x, const int& y) { return x > y; }
+
+TEST_CASE("flat_map_function_pointer", "[flat_cainers, flat_map]") {
+  using map = srt::flat_map<int, char, bool (*)(const int&, const int&)>;
+  map c({{1, 'a'}, {3, 'c'}, {2, 'b'}}, &int_greater);
+
+  REQUIRE(3 == c.begin()->first);
+  REQUIRE('b' == c.find(2)->second);
+  REQUIRE(c.insert(map::value_type(0, 'z')).second);
+  REQUIRE(c.try_emplace(4, 'd').second);
+  c[5] = 'e';
+  REQUIRE(1u == c.erase(3));
+
+  std::vector<map::value_type> expected = {
+      {5, 'e'}, {4, 'd'}, {2, 'b'}, {1, 'a'}, {0, 'z'}};
+  REQUIRE(expected == c.body());
+
+  static_assert(sizeof(srt::flat_map<int, int>) ==
+                    sizeof(std::vector<std::pair<int, int>>),
+                "empty comparators take no space");
+}
+
+TEST_CASE("flat_map_insert_or_assign_f_l", "[flat_cainers, flat_map]") {
+  using kv = std::pair<int, int>;
+  std::vector<kv> batch = {{5, 1}, {2, 1}, {5, 2}, {7, 1}, {2, 2}, {5, 3}};
+
+  srt::flat_map<int, int> c{{1, 0}, {5, 0}, {9, 0}};
+  c.insert_or_assign(batch.begin(), batch.end());
+  std::vector<kv> expected = {{1, 0}, {2, 2}, {5, 3}, {7, 1}, {9, 0}};
+  REQUIRE(expected == c.body());
+
+  c.insert_or_assign({{1, 10}, {10, 10}});
+  expected = {{1, 10}, {2, 2}, {5, 3}, {7, 1}, {9, 0}, {10, 10}};
+  REQUIRE(expected == c.body());
+
+  std::mt19937 g;
+  std::uniform_int_distribution<> dis(0, 100);
+  for (int i = 0; i < 100; ++i) {
+    std::map<int, int> expected_map;
+    srt::flat_map<int, int> by_vector;
+    srt::flat_map<int, int, srt::less, srt::raw_vector<kv>> by_raw_vector;
+    for (int j = 0; j < 30; ++j) {
+      kv x{dis(g), dis(g)};
+      expected_map.insert(x);
+      by_vector.insert(x);
+      by_raw_vector.insert(x);
+    }
+    by_raw_vector.reserve(by_raw_vector.size() + static_cast<size_t>(i));
+
+    batch.clear();
+    for (int j = 0; j < i; ++j) batch.emplace_back(dis(g), j);
+    for (const kv& x : batch) expected_map[x.first] = x.second;
+
+    by_vector.insert_or_assign(batch.begin(), batch.end());
+    by_raw_vector.insert_or_assign(batch.begin(), batch.end());
+    std::vector<kv> expected_body(expected_map.begin(), expected_map.end());
+    REQUIRE(expected_body == by_vector.body());
+    REQUIRE(expected_body ==
+            std::vector<kv>(by_raw_vector.begin(), by_raw_vector.end()));
+  }
+}
+
+TEST_CASE("flat_map_insert_or_assign_move_only",
+          "[flat_cainers, flat_map, weird_types]") {
+  using kv = std::pair<int, std::unique_ptr<int>>;
+  srt::flat_map<int, std::unique_ptr<int>> c;
+  c.try_emplace(1, new int(1));
+  c.try_emplace(3, new int(3));
+
+  std::vector<kv> batch;
+  batch.emplace_back(3, std::unique_ptr<int>(new int(30)));
+  batch.emplace_back(2, std::unique_ptr<int>(new int(20)));
+  c.insert_or_assign_sorted_unique(std::make_move_iterator(batch.rbegin()),
+                                   std::make_move_iterator(batch.rend()));
+  REQUIRE(3u == c.size());
+  REQUIRE(1 == *c[1]);
+  REQUIRE(20 == *c[2]);
+  REQUIRE(30 == *c[3]);
+}
+
+TEST_CASE("flat_map_merge_combine", "[flat_cainers, flat_map]") {
+  using kv = std::pair<int, int>;
+  srt::flat_map<int, int> c{{1, 1}, {3, 3}, {5, 5}};
+  srt::flat_map<int, int> other{{3, 30}, {4, 40}, {5, 50}};
+  c.merge_combine(other, std::plus<int>{});
+  std::vector<kv> expected = {{1, 1}, {3, 33}, {4, 40}, {5, 55}};
+  REQUIRE(expected == c.body());
+
+  std::mt19937 g;
+  std::uniform_int_distribution<> dis(0, 100);
+  for (int i = 0; i < 100; ++i) {
+    std::map<int, int> expected_map;
+    srt::flat_map<int, int> by_vector;
+    srt::flat_map<int, int, srt::less, srt::raw_vector<kv>> by_raw_vector;
+    for (int j = 0; j < 30; ++j) {
+      kv x{dis(g), dis(g)};
+      expected_map.insert(x);
+      by_vector.insert(x);
+      by_raw_vector.insert(x);
+    }
+    by_raw_vector.reserve(by_raw_vector.size() + static_cast<size_t>(i));
+
+    srt::flat_map<int, int> counts;
+    for (int j = 0; j < i; ++j) counts[dis(g)] += 1;
+    srt::flat_map<int, int, srt::less, srt::raw_vector<kv>> raw_counts(
+        counts.begin(), counts.end());
+    for (const kv& x : counts) expected_map[x.first] += x.second;
+
+    by_vector.merge_combine(counts, std::plus<int>{});
+    by_raw_vector.merge_combine(std::move(raw_counts), std::plus<int>{});
+    std::vector<kv> expected_body(expected_map.begin(), expected_map.end());
+    REQUIRE(expected_body == by_vector.body());
+    REQUIRE(expected_body ==
+            std::vector<kv>(by_raw_vector.begin(), by_raw_vector.end()));
+  }
+
+  srt::flat_map<std::string, std::string> strings{{"a", "1"}, {"b", "2"}};
+  strings.merge_combine(
+      srt::flat_map<std::string, std::string>{{"b", "3"}, {"c", "4"}},
+      [](const std::string& x, const std::string& y) { return x + y; });
+  REQUIRE("23" == strings["b"]);
+  REQUIRE("4" == strings["c"]);
+  REQUIRE(3u == strings.size());
+}
+
+TEST_CASE("flat_map_merge_join", "[flat_cainers, flat_map]") {
+  srt::flat_map<int, std::string> names{{1, "a"}, {2, "b"}, {4, "d"}};
+  srt::flat_map<int, int> counts{{2, 20}, {3, 30}, {4, 40}};
+
+  std::vector<std::string> inner;
+  srt::merge_join(names, counts,
+                  [&](const std::pair<int, std::string>& x,
+                      const std::pair<int, int>& y) {
+                    inner.push_back(x.second + std::to_string(y.second));
+                  });
+  REQUIRE(std::vector<std::string>({"b20", "d40"}) == inner);
+
+  std_int_vec left;
+  srt::merge_join_left(names, counts,
+                       [&](const std::pair<int, std::string>&,
+                           const std::pair<int, int>* y) {
+                         left.push_back(y ? y->second : 0);
+                       });
+  REQUIRE(std_int_vec({0, 20, 40}) == left);
+
+  std_int_vec anti;
+  srt::merge_join_anti(counts, names, [&](const std::pair<int, int>& x) {
+    anti.push_back(x.first);
+  });
+  REQUIRE(std_int_vec({3}) == anti);
+}
+
+TEST_CASE("prefix_sum_flat_map", "[flat_cainers, prefix_sum_flat_map]") {
+  srt::prefix_sum_flat_map<int, int> c{{10, 1}, {20, 2}, {30, 3}, {40, 4}};
+
+  REQUIRE(10 == c.range_sum(0, 100));
+  REQUIRE(5 == c.range_sum(20, 40));
+  REQUIRE(5 == c.range_sum(15, 31));
+  REQUIRE(0 == c.range_sum(41, 100));
+  REQUIRE(2u == c.range_count(15, 31));
+  REQUIRE(0u == c.range_count(31, 15));
+  REQUIRE(0 == c.range_sum(31, 15));
+  REQUIRE(3 == c.prefix_sum(c.find(30)));
+
+  REQUIRE(c.insert({25, 10}).second);
+  REQUIRE(!c.insert({25, 100}).second);
+  REQUIRE(15 == c.range_sum(20, 40));
+
+  REQUIRE(!c.insert_or_assign(20, 5).second);
+  REQUIRE(18 == c.range_sum(20, 40));
+
+  c.add(30, 7);
+  c.add(35, 1);
+  REQUIRE(26 == c.range_sum(20, 40));
+  REQUIRE(1 == c.find(35)->second);
+
+  REQUIRE(1u == c.erase(25));
+  REQUIRE(16 == c.range_sum(20, 40));
+  REQUIRE(21 == c.range_sum(0, 100));
+
+  std::vector<std::pair<int, int>> batch = {{5, 5}, {20, 0}, {50, 50}};
+  c.insert_or_assign(batch.begin(), batch.end());
+  REQUIRE(71 == c.range_sum(0, 100));
+
+  c.merge_combine(srt::flat_map<int, int>{{5, 1}, {60, 1}}, std::plus<int>{});
+  REQUIRE(73 == c.range_sum(0, 100));
+}
+
+TEST_CASE("prefix_sum_flat_map_random", "[flat_cainers, prefix_sum_flat_map]") {
+  std::mt19937 g;
+  std::uniform_int_distribution<> dis(0, 100);
+
+  srt::prefix_sum_flat_map<int, long> c;
+  std::map<int, long> expected;
+  for (int i = 0; i < 1000; ++i) {
+    int key = dis(g);
+    switch (dis(g) % 3) {
+      case 0:
+        c.add(key, i);
+        expected[key] += i;
+        break;
+      case 1:
+        c.insert_or_assign(key, i);
+        expected[key] = i;
+        break;
+      case 2:
+        c.erase(key);
+        expected.erase(key);
+        break;
+    }
+
+    int lo = dis(g);
+    int hi = lo + dis(g) / 4;
+    long expected_sum = 0;
+    for (auto it = expected.lower_bound(lo); it != expected.lower_bound(hi);
+         ++it)
+      expected_sum += it->second;
+    REQUIRE(expected_sum == c.range_sum(lo, hi));
+    REQUIRE(expected.size() == c.size());
+  }
+}
+
+TEST_CASE("prefix_sum_flat_map_bad_alloc",
+          "[flat_cainers, prefix_sum_flat_map]") {
+  for (int failure = 0; failure != 4; ++failure) {
+    srt::prefix_sum_flat_map<int, int> c{{10, 1}, {20, 2}, {30, 3}};
+    allocations_before_failure = failure;
+    try {
+      c.insert({25, 10});
+      c.add(5, 100);
+    } catch (const std::bad_alloc&) {
+    }
+    allocations_before_failure = -1;
+
+    int total = 0;
+    for (const auto& x : c) total += x.second;
+    REQUIRE(total == c.prefix_sum(c.end()));
+    REQUIRE(total == c.range_sum(0, 100));
+  }
+}
+
+TEST_CASE("slab_flat_map", "[flat_cainers, slab_flat_map]") {
+  using map = srt::slab_flat_map<int, std::string>;
+  map c{{3, "c"}, {1, "a"}, {2, "b"}};
+
+  REQUIRE(3u == c.size());
+  REQUIRE("b" == c.find(2)->second);
+  REQUIRE(c.end() == c.find(4));
+  REQUIRE(1u == c.count(3));
+  REQUIRE(3 == c.lower_bound(3)->first);
+  REQUIRE(c.end() == c.upper_bound(3));
+
+  std::vector<std::string> values;
+  for (auto x : c) values.push_back(x.second);
+  REQUIRE(std::vector<std::string>({"a", "b", "c"}) == values);
+
+  const std::string* stable = &c.find(2)->second;
+  for (int i = 10; i < 200; ++i) c[i] = std::to_string(i);
+  REQUIRE(stable == &c.find(2)->second);
+  REQUIRE("150" == c[150]);
+
+  REQUIRE(!c.try_emplace(2, "x").second);
+  REQUIRE(!c.insert_or_assign(2, "bb").second);
+  REQUIRE("bb" == c[2]);
+  REQUIRE(stable == &c.find(2)->second);
+
+  // Erased slots are reused.
+  const size_t slots = c.slot_count();
+  REQUIRE(1u == c.erase(150));
+  REQUIRE(0u == c.erase(150));
+  c.erase(c.find(151));
+  REQUIRE(2u == c.free_slot_count());
+  c[1000] = "x";
+  c[1001] = "y";
+  REQUIRE(slots == c.slot_count());
+  REQUIRE(0u == c.free_slot_count());
+
+  map copy(c);
+  REQUIRE(copy == c);
+  copy[1] = "changed";
+  REQUIRE(copy != c);
+  REQUIRE("a" == c[1]);
+
+  map moved(std::move(copy));
+  REQUIRE("changed" == moved[1]);
+  REQUIRE(copy.empty());
+  copy[5] = "5";
+  REQUIRE(1u == copy.size());
+
+  moved = c;
+  REQUIRE(moved == c);
+  c.clear();
+  REQUIRE(c.empty());
+  REQUIRE(0u == c.slot_count());
+}
+
+TEST_CASE("slab_flat_map_random", "[flat_cainers, slab_flat_map]") {
+  std::mt19937 g;
+  std::uniform_int_distribution<> dis(0, 100);
+
+  srt::slab_flat_map<int, std::unique_ptr<int>> c;
+  std::map<int, int> expected;
+  for (int i = 0; i < 1000; ++i) {
+    int key = dis(g);
+    if (dis(g) % 2) {
+      c.insert_or_assign(key, std::unique_ptr<int>(new int(i)));
+      expected[key] = i;
+    } else {
+      REQUIRE(expected.erase(key) == c.erase(key));
+    }
+  }
+
+  REQUIRE(expected.size() == c.size());
+  REQUIRE(c.slot_count() - c.free_slot_count() == c.size());
+  auto it = c.begin();
+  for (const auto& x : expected) {
+    REQUIRE(x.first == it->first);
+    REQUIRE(x.second == *it->second);
+    ++it;
+  }
+}
+
+TEST_CASE("slab_flat_map_insert_f_l", "[flat_cainers, slab_flat_map]") {
+  using map = srt::slab_flat_map<int, std::unique_ptr<int>>;
+  map c;
+  c[5].reset(new int(50));
+  c[1].reset(new int(10));
+  c.erase(1);
+
+  std::vector<std::pair<int, std::unique_ptr<int>>> batch;
+  for (int x : {7, 5, 3, 7, 0, 3}) {
+    batch.emplace_back(x, std::unique_ptr<int>(new int(x * 10 + 1)));
+  }
+  c.insert(std::make_move_iterator(batch.begin()),
+           std::make_move_iterator(batch.end()));
+
+  // The first of equal keys wins, existing keys are kept.
+  std::vector<std::pair<int, int>> expected = {
+      {0, 1}, {3, 31}, {5, 50}, {7, 71}};
+  std::vector<std::pair<int, int>> actual;
+  for (auto x : c) actual.emplace_back(x.first, *x.second);
+  REQUIRE(expected == actual);
+  REQUIRE(c.slot_count() - c.free_slot_count() == c.size());
+}
+
+TEST_CASE("slab_flat_map_insert_f_l_allocations",
+          "[flat_cainers, slab_flat_map]") {
+  std::vector<std::pair<int, int>> batch;
+  for (int i = 0; i != 10000; ++i) batch.emplace_back(i, i);
+
+  // Buffers grow geometrically: far fewer allocations than keys.
+  srt::slab_flat_map<int, int> c;
+  const std::size_t before = heap_allocations;
+  c.insert(batch.begin(), batch.end());
+  REQUIRE(heap_allocations - before < batch.size() / 8);
+  REQUIRE(c.size() == batch.size());
+}
+
+TEST_CASE("slab_flat_map_insert_f_l_throwing_copy",
+          "[flat_cainers, slab_flat_map]") {
+  using value = throwing_copy<true>;
+  srt::slab_flat_map<int, value> c;
+  c.try_emplace(2, 20);
+
+  std::vector<std::pair<int, value>> batch;
+  for (int x : {4, 1, 3, 1}) batch.emplace_back(x, value(x));
+  const int live = throwing_copy_live;
+
+  throwing_copies_left = 2;
+  REQUIRE_THROWS(c.insert(batch.begin(), batch.end()));
+  throwing_copies_left = 1000;
+  REQUIRE(live == throwing_copy_live);
+  REQUIRE(1u == c.size());
+
+  c.insert(batch.begin(), batch.end());
+  REQUIRE(4u == c.size());
+  REQUIRE(live + 3 == throwing_copy_live);
+}
+
+TEST_CASE("soa_flat_map", "[flat_cainers, soa_flat_map]") {
+  using map = srt::soa_flat_map<int, std::tuple<std::string, double>>;
+
+  map c{{3, "c", 3.0}, {1, "a", 1.0}, {2, "b", 2.0}, {1, "x", 9.0}};
+  REQUIRE(c.keys() == (std::vector<int>{1, 2, 3}));
+  REQUIRE(c.column<0>() == (std::vector<std::string>{"a", "b", "c"}));
+  REQUIRE(c.column<1>() == (std::vector<double>{1.0, 2.0, 3.0}));
+
+  REQUIRE(c.insert(0, "z", 0.5) == std::make_pair(std::size_t{0}, true));
+  REQUIRE(c.insert(0, "y", 0.7) == std::make_pair(std::size_t{0}, false));
+  REQUIRE(c.column<0>()[0] == "z");
+
+  REQUIRE(c.insert_or_assign(2, "B", 2.5) ==
+          std::make_pair(std::size_t{2}, false));
+  REQUIRE(c.column<0>()[2] == "B");
+  REQUIRE(c.column<1>()[2] == 2.5);
+
+  REQUIRE(c.find(5) == c.size());
+  REQUIRE(c.find(3) == 3u);
+  REQUIRE(c.count(1) == 1u);
+  REQUIRE(c.lower_bound(2) == 2u);
+  REQUIRE(c.upper_bound(2) == 3u);
+
+  c.column<1>()[3] *= 2;
+  REQUIRE(c.column<1>()[3] == 6.0);
+
+  std::vector<map::row_type> rows{{5, "e", 5.0}, {1, "q", 0.0}, {4, "d", 4.0}};
+  c.insert(rows.begin(), rows.end());
+  REQUIRE(c.keys() == (std::vector<int>{0, 1, 2, 3, 4, 5}));
+  REQUIRE(c.column<0>() ==
+          (std::vector<std::string>{"z", "a", "B", "c", "d", "e"}));
+
+  REQUIRE(c.erase(2) == 1u);
+  REQUIRE(c.erase(2) == 0u);
+  c.erase_at(0);
+  REQUIRE(c.keys() == (std::vector<int>{1, 3, 4, 5}));
+  REQUIRE(c.column<1>() == (std::vector<double>{1.0, 6.0, 4.0, 5.0}));
+
+  map copy = c;
+  REQUIRE(copy == c);
+  copy.column<0>()[0] = "A";
+  REQUIRE(copy != c);
+
+  c.clear();
+  REQUIRE(c.empty());
+  REQUIRE(c.column<0>().empty());
+  REQUIRE(c.column<1>().empty());
+}
+
+TEST_CASE("soa_flat_map_random", "[flat_cainers, soa_flat_map]") {
+  std::mt19937 g;
+  std::uniform_int_distribution<> dis(0, 100);
+
+  srt::soa_flat_map<int, std::tuple<int, std::unique_ptr<int>>> c;
+  std::map<int, int> expected;
+  for (int i = 0; i < 100; ++i) {
+    std::vector<std::tuple<int, int, std::unique_ptr<int>>> rows;
+    std::map<int, int> batch;
+    for (int j = dis(g) % 10; j; --j) {
+      int key = dis(g);
+      rows.emplace_back(key, i * 10 + j, std::unique_ptr<int>(new int(j)));
+      batch.insert({key, i * 10 + j});
+    }
+    if (dis(g) % 3) {
+      c.insert(std::make_move_iterator(rows.begin()),
+               std::make_move_iterator(rows.end()));
+      for (const auto& x : batch) expected.insert(x);
+    } else {
+      int key = dis(g);
+      REQUIRE(expected.erase(key) == c.erase(key));
+    }
+  }
+
+  REQUIRE(expected.size() == c.size());
+  std::size_t pos = 0;
+  for (const auto& x : expected) {
+    REQUIRE(x.first == c.keys()[pos]);
+    REQUIRE(x.second == c.column<0>()[pos]);
+    REQUIRE(c.column<1>()[pos]);
+    ++pos;
+  }
+}
+
+TEST_CASE("soa_flat_map_single_column", "[flat_cainers, soa_flat_map]") {
+  srt::soa_flat_map<int, std::tuple<int>> ints;
+  REQUIRE(ints.insert(2, 20).second);
+  REQUIRE(ints.insert(1, 10).second);
+  REQUIRE(ints.column<0>() == (std::vector<int>{10, 20}));
+
+  srt::soa_flat_map<std::string, std::tuple<std::string>> strings;
+  REQUIRE(strings.insert(std::string("b"), std::string("bb")).second);
+  REQUIRE(strings.insert("a", "aa").second);
+  REQUIRE(strings.keys() == (std::vector<std::string>{"a", "b"}));
+}
+
+namespace {
+
+int throwing_moves_left = 1000;
+
+struct throwing_move {
+  explicit throwing_move(int x) : body(x) {}
+
+  throwing_move(throwing_move&& x) : body(x.body) {
+    if (!throwing_moves_left--) throw 0;
+  }
+
+  throwing_move& operator=(throwing_move&& x) {
+    if (!throwing_moves_left--) throw 0;
+    body = x.body;
+    return *this;
+  }
+
+  int body;
+};
+
+}  // namespace
+
+TEST_CASE("soa_flat_map_throwing_column", "[flat_cainers, soa_flat_map]") {
+  srt::soa_flat_map<int, std::tuple<std::string, throwing_move>> c;
+  c.insert(1, "a", throwing_move(1));
+  c.insert(3, "c", throwing_move(3));
+
+  throwing_moves_left = 0;
+  REQUIRE_THROWS(c.insert(2, "b", throwing_move(2)));
+  throwing_moves_left = 1000;
+  REQUIRE(c.keys() == (std_int_vec{1, 3}));
+  REQUIRE(c.column<0>() == (std::vector<std::string>{"a", "c"}));
+  REQUIRE(2u == c.column<1>().size());
+}
+
+TEST_CASE("soa_flat_map_insert_f_l_throwing_copy",
+          "[flat_cainers, soa_flat_map]") {
+  using value = throwing_copy<false>;
+  srt::soa_flat_map<int, std::tuple<std::string, value>> c;
+  c.insert(5, "e", value(5));
+
+  std::vector<std::tuple<int, std::string, value>> rows;
+  for (int x : {4, 1, 3}) rows.emplace_back(x, std::to_string(x), value(x));
+
+  for (int copies : {0, 1, 2, 3, 5, 6}) {
+    throwing_copies_left = copies;
+    REQUIRE_THROWS(c.insert(rows.begin(), rows.end()));
+    throwing_copies_left = 1000;
+    REQUIRE(c.keys() == (std_int_vec{5}));
+    REQUIRE(1u == c.column<0>().size());
+    REQUIRE(1u == c.column<1>().size());
+  }
+
+  c.insert(rows.begin(), rows.end());
+  REQUIRE(c.keys() == (std_int_vec{1, 3, 4, 5}));
+  REQUIRE(c.column<0>() == (std::vector<std::string>{"1", "3", "4", "e"}));
+}
+
+#if __cplusplus >= 201402L
+
+TEST_CASE("frozen_set", "[flat_cainers, frozen_set]") {
+  constexpr auto c = srt::make_frozen_set({5, 1, 3, 1, 9, 5, 7});
+  static_assert(5 == c.size(), "");
+  static_assert(c.count(3) && c.count(9) && !c.count(4) && !c.count(10), "");
+  static_assert(*c.lower_bound(2) == 3, "");
+  static_assert(c.find(0) == c.end(), "");
+
+  REQUIRE(std_int_vec({1, 3, 5, 7, 9}) == std_int_vec(c.begin(), c.end()));
+
+  std_int_vec expected{1, 3, 5, 7, 9};
+  for (int x = 0; x < 11; ++x) {
+    REQUIRE(std::lower_bound(expected.begin(), expected.end(), x) -
+                expected.begin() ==
+            c.lower_bound(x) - c.begin());
+  }
+
+  constexpr auto reversed =
+      srt::make_frozen_set({1, 2, 2, 3}, std::greater<int>{});
+  REQUIRE(std_int_vec({3, 2, 1}) ==
+          std_int_vec(reversed.begin(), reversed.end()));
+  REQUIRE(reversed.find(2) == reversed.begin() + 1);
+
+  constexpr auto single = srt::make_frozen_set({42});
+  static_assert(single.count(42) && !single.count(41) && !single.count(43),
+                "");
+}
+
+namespace {
+
+constexpr std::size_t kBigFrozenSize = 5000;
+
+struct big_frozen_keys {
+  int data[kBigFrozenSize];
+};
+
+// Every key twice, in a scrambled order.
+constexpr big_frozen_keys make_big_frozen_keys() {
+  big_frozen_keys res{};
+  for (std::size_t i = 0; i < kBigFrozenSize; ++i)
+    res.data[i] = static_cast<int>((i * 7919) % (kBigFrozenSize / 2));
+  return res;
+}
+
+constexpr big_frozen_keys kBigFrozenKeys = make_big_frozen_keys();
+
+}  // namespace
+
+TEST_CASE("frozen_set_big", "[flat_cainers, frozen_set]") {
+  constexpr auto c = srt::make_frozen_set(kBigFrozenKeys.data);
+  static_assert(kBigFrozenSize / 2 == c.size(), "");
+  static_assert(c.count(0) && c.count(2499) && !c.count(2500), "");
+
+  std_int_vec expected(kBigFrozenSize / 2);
+  std::iota(expected.begin(), expected.end(), 0);
+  REQUIRE(expected == std_int_vec(c.begin(), c.end()));
+}
+
+#endif  // __cplusplus >= 201402L
+
+TEST_CASE("flat_set_raw_vector_insert_f_l", "[flat_cainers, flat_set]") {
+  using string_set =
+      srt::flat_set<std::string, srt::less, srt::raw_vector<std::string>>;
+
+  std::mt19937 g;
+  std::uniform_int_distribution<> dis(1, 100);
+  // Long enough to not fit in small string buffer, so that sanitizers can see
+  // leaks and double constructions.
+  auto rand_str = [&] { return std::string(20, 'a') + std::to_string(dis(g)); };
+
+  for (size_t c_size = 0; c_size < 30; ++c_size) {
+    for (size_t range_size = 0; range_size < 30; ++range_size) {
+      std::vector<std::string> already_in(c_size);
+      std::generate(already_in.begin(), already_in.end(), rand_str);
+
+      std::vector<std::string> new_elements(range_size);
+      std::generate(new_elements.begin(), new_elements.end(), rand_str);
+
+      string_set actual(already_in.begin(), already_in.end());
+      actual.reserve(actual.size() + range_size);
+      actual.insert(new_elements.begin(), new_elements.end());
+
+      std::set<std::string> expected(already_in.begin(), already_in.end());
+      expected.insert(new_elements.begin(), new_elements.end());
+
+      REQUIRE(std::vector<std::string>(expected.begin(), expected.end()) ==
+              std::vector<std::string>(actual.begin(), actual.end()));
+
+      std::set<std::string> sorted_unique(new_elements.begin(),
+                                          new_elements.end());
+      string_set merged(already_in.begin(), already_in.end());
+      merged.reserve(merged.size() + sorted_unique.size());
+      merged.insert_sorted_unique(sorted_unique.begin(), sorted_unique.end());
+      REQUIRE(actual == merged);
+    }
+  }
+}
+
+TEST_CASE("flat_set_raw_vector_weird_types", "[flat_cainers, flat_set]") {
+  srt::flat_set<no_default_or_copy, srt::less,
+                srt::raw_vector<no_default_or_copy>>
+      c;
+  c.reserve(10);
+  c.emplace(4);
+  c.emplace(2);
+
+  std::vector<no_default_or_copy> values;
+  for (int x : {3, 1, 2, 5}) values.emplace_back(x);
+  c.insert(std::make_move_iterator(values.begin()),
+           std::make_move_iterator(values.end()));
+
+  std::vector<no_default_or_copy> expected;
+  for (int x : {1, 2, 3, 4, 5}) expected.emplace_back(x);
+
+  REQUIRE(expected.size() == c.size());
+  REQUIRE(std::equal(expected.begin(), expected.end(), c.begin()));
+}
+
+TEST_CASE("flat_set_raw_vector_relocating", "[flat_cainers, flat_set]") {
+  using handle_set = srt::flat_set<relocatable_handle, srt::less,
+                                   srt::raw_vector<relocatable_handle>>;
+  std::mt19937 g;
+  std::uniform_int_distribution<> dis(1, 100);
+
+  handle_set c;
+  std::set<int> expected;
+  for (int i = 0; i < 200; ++i) {
+    int x = dis(g);
+    if (i % 3 == 0) {
+      c.erase(x);
+      expected.erase(x);
+    } else {
+      c.emplace(x);
+      expected.insert(x);
+    }
+    REQUIRE(std_int_vec(expected.begin(), expected.end()) ==
+            handles_to_ints(c.begin(), c.end()));
+  }
+
+  std::vector<relocatable_handle> sorted_unique;
+  for (int x : {0, 2, 3, 50, 99, 101}) sorted_unique.emplace_back(x);
+  expected.insert({0, 2, 3, 50, 99, 101});
+
+  c.reserve(c.size() + sorted_unique.size());
+  c.insert_sorted_unique(std::make_move_iterator(sorted_unique.begin()),
+                         std::make_move_iterator(sorted_unique.end()));
+  REQUIRE(std_int_vec(expected.begin(), expected.end()) ==
+          handles_to_ints(c.begin(), c.end()));
+}
+
+TEST_CASE("flat_set_erase_pos", "[flat_cainers, flat_set]") {
+  {
+    int_set c{1, 2, 3, 4, 5, 6, 7, 8};
+    std_int_vec expected;
+
+    int_set::iterator it = c.erase(std::next(c.cbegin(), 3));
+    REQUIRE(std::next(c.cbegin(), 3) == it);
+    expected = {1, 2, 3, 5, 6, 7, 8};
+    REQUIRE(expected == c.body());
+
+    it = c.erase(std::next(c.begin(), 0));
+    REQUIRE(c.begin() == it);
+    expected = {2, 3, 5, 6, 7, 8};
+    REQUIRE(expected == c.body());
+
+    it = c.erase(std::next(c.cbegin(), 5));
+    REQUIRE(c.end() == it);
+    expected = {2, 3, 5, 6, 7};
+    REQUIRE(expected == c.body());
+
+    it = c.erase(std::next(c.cbegin(), 1));
+    REQUIRE(std::next(c.begin()) == it);
+    expected = {2, 5, 6, 7};
+    REQUIRE(expected == c.body());
+
+    it = c.erase(std::next(c.cbegin(), 2));
+    REQUIRE(std::next(c.begin(), 2) == it);
+    expected = {2, 5, 7};
+    REQUIRE(expected == c.body());
+
+    it = c.erase(std::next(c.cbegin(), 2));
+    REQUIRE(std::next(c.begin(), 2) == it);
+    expected = {2, 5};
+    REQUIRE(expected == c.body());
+
+    it = c.erase(std::next(c.cbegin(), 0));
+    REQUIRE(std::next(c.begin(), 0) == it);
+    expected = {5};
+    REQUIRE(expected == c.body());
+
+    it = c.erase(c.begin());
+    REQUIRE(c.begin() == it);
+    REQUIRE(c.end() == it);
+  }
+  //  This is LWG #2059.
+  //  There is a potential ambiguity between erase with an iterator and erase
+  //  with a key, if key has a templated constructor.
+  {
+    srt::flat_set<template_constructor> c;
+    template_constructor v(0);
+
+    auto it = c.find(v);
+    if (it != c.end()) c.erase(it);
+  }
+}
+
+TEST_CASE("flat_set_erase_range", "[flat_cainers, flat_set]") {
+  int_set c{1, 2, 3, 4, 5, 6, 7, 8};
+
+  int_set::iterator it =
+      c.erase(std::next(c.cbegin(), 5), std::next(c.cbegin(), 5));
+  REQUIRE(std::next(c.begin(), 5) == it);
+  std_int_vec expected = {1, 2, 3, 4, 5, 6, 7, 8};
+  REQUIRE(expected == c.body());
+
+  it = c.erase(std::next(c.cbegin(), 3), std::next(c.cbegin(), 4));
+  REQUIRE(std::next(c.begin(), 3) == it);
+  expected = {1, 2, 3, 5, 6, 7, 8};
+  REQUIRE(expected == c.body());
+
+  it = c.erase(std::next(c.cbegin(), 2), std::next(c.cbegin(), 5));
+  REQUIRE(std::next(c.begin(), 2) == it);
+  expected = {1, 2, 7, 8};
+  REQUIRE(expected == c.body());
+
+  it = c.erase(std::next(c.cbegin(), 0), std::next(c.cbegin(), 2));
+  REQUIRE(std::next(c.begin(), 0) == it);
+  expected = {7, 8};
+  REQUIRE(expected == c.body());
+
+  it = c.erase(c.cbegin(), c.cend());
+  REQUIRE(c.begin() == it);
+  REQUIRE(c.end() == it);
+}
+
+TEST_CASE("flat_set_erase_v", "[flat_cainers, flat_set]") {
+  int_set c{1, 2, 3, 4, 5, 6, 7, 8};
+
+  REQUIRE(0U == c.erase(9));
+  std_int_vec expected = {1, 2, 3, 4, 5, 6, 7, 8};
+  REQUIRE(expected == c.body());
+
+  REQUIRE(1U == c.erase(4));
+  expected = {1, 2, 3, 5, 6, 7, 8};
+  REQUIRE(expected == c.body());
+
+  REQUIRE(1U == c.erase(1));
+  expected = {2, 3, 5, 6, 7, 8};
+  REQUIRE(expected == c.body());
+
+  REQUIRE(1U == c.erase(8));
+  expected = {2, 3, 5, 6, 7};
+  REQUIRE(expected == c.body());
+
+  REQUIRE(1U == c.erase(3));
+  expected = {2, 5, 6, 7};
+  REQUIRE(expected == c.body());
+
+  REQUIRE(1U == c.erase(6));
+  expected = {2, 5, 7};
+  REQUIRE(expected == c.body());
+
+  REQUIRE(1U == c.erase(7));
+  expected = {2, 5};
+  REQUIRE(expected == c.body());
+
+  REQUIRE(1U == c.erase(2));
+  expected = {5};
+  REQUIRE(expected == c.body());
+
+  REQUIRE(1U == c.erase(5));
+  expected = {};
+  REQUIRE(expected == c.body());
+}
+
+TEST_CASE("flat_set_key_value_compare", "[flat_cainers, flat_set]") {
+  reverse_set c{1, 2, 3, 4, 5};
+
+  REQUIRE(std::is_sorted(c.begin(), c.end(), c.key_comp()));
+  REQUIRE(std::is_sorted(c.begin(), c.end(), c.value_comp()));
+
+  int new_elements[] = {6, 7, 8, 9, 10};
+  std::copy(std::begin(new_elements), std::end(new_elements),
+            std::inserter(c, c.end()));
+
+  REQUIRE(std::is_sorted(c.begin(), c.end(), c.key_comp()));
+  REQUIRE(std::is_sorted(c.begin(), c.end(), c.value_comp()));
+}
+
+TEST_CASE("flat_set_count", "[flat_cainers, flat_set]") {
+  const int_set c{5, 6, 7, 8, 9, 10, 11, 12};
+
+  REQUIRE(1U == c.count(5));
+  REQUIRE(1U == c.count(6));
+  REQUIRE(1U == c.count(7));
+  REQUIRE(1U == c.count(8));
+  REQUIRE(1U == c.count(9));
+  REQUIRE(1U == c.count(10));
+  REQUIRE(1U == c.count(11));
+  REQUIRE(1U == c.count(12));
+  REQUIRE(0U == c.count(4));
+}
+
+TEST_CASE("flat_set_find", "[flat_cainers, flat_set]") {
+  {
+    int_set c{5, 6, 7, 8, 9, 10, 11, 12};
+
+    int_set::iterator it = c.find(5);
+    REQUIRE(c.begin() == it);
+    REQUIRE(std::next(c.begin()) == c.find(6));
+    REQUIRE(std::next(c.begin(), 2) == c.find(7));
+    REQUIRE(std::next(c.begin(), 3) == c.find(8));
+    REQUIRE(std::next(c.begin(), 4) == c.find(9));
+    REQUIRE(std::next(c.begin(), 5) == c.find(10));
+    REQUIRE(std::next(c.begin(), 6) == c.find(11));
+    REQUIRE(std::next(c.begin(), 7) == c.find(12));
+    REQUIRE(std::next(c.begin(), 8) == c.find(4));
+  }
+  {
+    const int_set c({5, 6, 7, 8, 9, 10, 11, 12});
+
+    int_set::const_iterator it = c.find(5);
+    REQUIRE(c.begin() == it);
+    REQUIRE(std::next(c.begin()) == c.find(6));
+    REQUIRE(std::next(c.begin(), 2) == c.find(7));
+    REQUIRE(std::next(c.begin(), 3) == c.find(8));
+    REQUIRE(std::next(c.begin(), 4) == c.find(9));
+    REQUIRE(std::next(c.begin(), 5) == c.find(10));
+    REQUIRE(std::next(c.begin(), 6) == c.find(11));
+    REQUIRE(std::next(c.begin(), 7) == c.find(12));
+    REQUIRE(std::next(c.begin(), 8) == c.find(4));
+  }
+}
+
+TEST_CASE("flat_set_equal_range", "[flat_cainers, flat_set]") {
+  {
+    int_set c({5, 7, 9, 11, 13, 15, 17, 19});
 
     std::pair<int_set::iterator, int_set::iterator> r = c.equal_range(5);
     REQUIRE(std::next(c.begin(), 0) == r.first);
@@ -990,6 +2800,122 @@ TEST_CASE("flat_set_ordering", "[flat_cainers, flat_set]") {
   REQUIRE(biggest >= biggest);
 }
 
+TEST_CASE("flat_set_erase_sorted", "[flat_cainers, flat_set]") {
+  int_set c{1, 2, 3, 4, 5, 6, 7, 8};
+
+  std_int_vec keys = {0, 9};
+  REQUIRE(0U == c.erase_sorted(keys.begin(), keys.end()));
+  std_int_vec expected = {1, 2, 3, 4, 5, 6, 7, 8};
+  REQUIRE(expected == c.body());
+
+  keys = {0, 2, 2, 3, 5, 8, 10};
+  REQUIRE(4U == c.erase_sorted(keys.begin(), keys.end()));
+  expected = {1, 4, 6, 7};
+  REQUIRE(expected == c.body());
+
+  keys = {1, 4, 6, 7};
+  REQUIRE(4U == c.erase_sorted(keys.begin(), keys.end()));
+  REQUIRE(c.empty());
+
+  std::mt19937 g;
+  std::uniform_int_distribution<> dis(0, 200);
+  for (int i = 0; i < 100; ++i) {
+    std_int_vec body, erased;
+    for (int j = 0; j < 100; ++j) body.push_back(dis(g));
+    for (int j = 0; j < i; ++j) erased.push_back(dis(g));
+    std::set<int> expected_set(body.begin(), body.end());
+
+    int_set s(body.begin(), body.end());
+    size_t erased_count = 0;
+    for (int x : erased) erased_count += expected_set.erase(x);
+
+    std::sort(erased.begin(), erased.end());
+    REQUIRE(erased_count == s.erase_sorted(erased.begin(), erased.end()));
+    REQUIRE(std_int_vec(expected_set.begin(), expected_set.end()) == s.body());
+  }
+}
+
+TEST_CASE("flat_set_erase_keys", "[flat_cainers, flat_set]") {
+  int_set c{1, 2, 3, 4, 5, 6, 7, 8};
+
+  std_int_vec keys = {8, 3, 11, 1, 3};
+  REQUIRE(3U == c.erase_keys(keys.begin(), keys.end()));
+  std_int_vec expected = {2, 4, 5, 6, 7};
+  REQUIRE(expected == c.body());
+
+  std::list<int> list_keys = {7, 4};
+  REQUIRE(2U == c.erase_keys(list_keys.begin(), list_keys.end()));
+  expected = {2, 5, 6};
+  REQUIRE(expected == c.body());
+
+  srt::flat_set<std::string> strings{"a", "b", "c", "d"};
+  std::vector<std::string> string_keys{"d", "b", "e"};
+  REQUIRE(2U == strings.erase_keys(string_keys.begin(), string_keys.end()));
+  REQUIRE(std::vector<std::string>({"a", "c"}) == strings.body());
+
+  // Addresses go up while the strings go down.
+  const char chars[] = "c\0b\0a";
+  std::vector<const char*> pointers = {chars, chars + 2, chars + 4};
+  strings = {"a", "b", "c", "d"};
+  REQUIRE(3U == strings.erase_keys(pointers.begin(), pointers.end()));
+  REQUIRE(std::vector<std::string>({"d"}) == strings.body());
+}
+
+TEST_CASE("flat_set_apply_delta", "[flat_cainers, flat_set]") {
+  using delta = std::vector<std::pair<int, bool>>;
+  int_set c{2, 4, 6, 8};
+
+  delta ops = {{1, true}, {2, false}, {3, false}, {4, true}, {9, true}};
+  c.apply_delta(ops.begin(), ops.end());
+  std_int_vec expected = {1, 4, 6, 8, 9};
+  REQUIRE(expected == c.body());
+
+  ops = {{0, false}, {4, false}, {9, false}};
+  c.apply_delta(ops.begin(), ops.end());
+  expected = {1, 6, 8};
+  REQUIRE(expected == c.body());
+
+  ops = {};
+  c.apply_delta(ops.begin(), ops.end());
+  REQUIRE(expected == c.body());
+
+  std::mt19937 g;
+  std::uniform_int_distribution<> dis(0, 100);
+  for (int i = 0; i < 100; ++i) {
+    std::set<int> expected_set;
+    for (int j = 0; j < 50; ++j) expected_set.insert(dis(g));
+    int_set s(expected_set.begin(), expected_set.end());
+
+    std::map<int, bool> ops_map;
+    for (int j = 0; j < i; ++j) ops_map[dis(g)] = dis(g) % 2 == 0;
+    for (const auto& op : ops_map) {
+      if (op.second)
+        expected_set.insert(op.first);
+      else
+        expected_set.erase(op.first);
+    }
+
+    s.apply_delta(ops_map.begin(), ops_map.end());
+    REQUIRE(std_int_vec(expected_set.begin(), expected_set.end()) == s.body());
+  }
+}
+
+TEST_CASE("flat_set_apply_delta_weird_types",
+          "[flat_cainers, flat_set, weird_types]") {
+  srt::flat_set<relocatable_handle, srt::less,
+                srt::small_vector<relocatable_handle, 4>>
+      c;
+  for (int x : {2, 4, 6}) c.emplace(x);
+
+  std::vector<std::pair<relocatable_handle, bool>> ops;
+  ops.emplace_back(relocatable_handle(1), true);
+  ops.emplace_back(relocatable_handle(4), false);
+  ops.emplace_back(relocatable_handle(5), true);
+  c.apply_delta(std::make_move_iterator(ops.begin()),
+                std::make_move_iterator(ops.end()));
+  REQUIRE(std_int_vec({1, 2, 5, 6}) == handles_to_ints(c.begin(), c.end()));
+}
+
 TEST_CASE("flat_set_erase_if", "[flat_cainers, flat_set]") {
   int_set x;
   erase_if(x, [](int) { return false; });
@@ -1016,4 +2942,372 @@ TEST_CASE("flat_set greater", "[flat_cainers, flat_set]") {
 
   expected = {8, 7, 6, 5, 4, 3, 2, 1};
   REQUIRE(expected == x.body());
-}
\ No newline at end of file
+}
+
+namespace {
+
+struct order {
+  int id;
+  std::string name;
+};
+
+struct order_id {
+  const int& operator()(const order& x) const { return x.id; }
+};
+
+std_int_vec order_ids(const std::vector<order>& orders) {
+  std_int_vec res;
+  for (const order& x : orders) res.push_back(x.id);
+  return res;
+}
+
+}  // namespace
+
+TEST_CASE("flat_set_key_of", "[flat_cainers, flat_set]") {
+  using set = srt::flat_set<order, srt::less, std::vector<order>, order_id>;
+  static_assert(std::is_same<set::key_type, int>::value, "");
+  static_assert(std::is_same<set::value_type, order>::value, "");
+
+  set c{{3, "c"}, {1, "a"}, {2, "b"}, {1, "x"}};
+  REQUIRE(std_int_vec({1, 2, 3}) == order_ids(c.body()));
+  REQUIRE(c.begin()->name == "a");
+
+  REQUIRE(c.find(2)->name == "b");
+  REQUIRE(c.find(4) == c.end());
+  REQUIRE(c.count(3) == 1u);
+  REQUIRE(c.count(order{3, ""}) == 1u);
+  REQUIRE(c.lower_bound(2) == c.begin() + 1);
+  REQUIRE(c.upper_bound(2) == c.begin() + 2);
+
+  REQUIRE(!c.insert(order{2, "y"}).second);
+  REQUIRE(c.insert(order{0, "z"}).second);
+
+  std::vector<order> orders{{5, "e"}, {4, "d"}, {0, "w"}};
+  c.insert(orders.begin(), orders.end());
+  REQUIRE(std_int_vec({0, 1, 2, 3, 4, 5}) == order_ids(c.body()));
+  REQUIRE(c.begin()->name == "z");
+
+  REQUIRE(c.erase(4) == 1u);
+  REQUIRE(c.erase(4) == 0u);
+  std_int_vec ids{5, 0, 7};
+  REQUIRE(c.erase_keys(ids.begin(), ids.end()) == 2u);
+  REQUIRE(std_int_vec({1, 2, 3}) == order_ids(c.body()));
+
+  erase_if(c, [](const order& x) { return x.id == 2; });
+  REQUIRE(std_int_vec({1, 3}) == order_ids(c.body()));
+}
+
+TEST_CASE("flat_set_key_of_greater", "[flat_cainers, flat_set]") {
+  using set =
+      srt::flat_set<order, std::greater<int>, std::vector<order>, order_id>;
+
+  set c{{1, "a"}, {3, "c"}, {2, "b"}};
+  REQUIRE(std_int_vec({3, 2, 1}) == order_ids(c.body()));
+  REQUIRE(c.find(1)->name == "a");
+  REQUIRE(c.key_comp()(2, 1));
+}
+namespace {
+
+int names_built = 0;
+
+struct name_view {
+  int id;
+};
+
+struct name {
+  explicit name(name_view v) : id(v.id) { ++names_built; }
+
+  friend bool operator<(const name& x, const name& y) { return x.id < y.id; }
+  friend bool operator<(const name& x, name_view y) { return x.id < y.id; }
+  friend bool operator<(name_view x, const name& y) { return x.id < y.id; }
+
+  int id;
+};
+
+std_int_vec name_ids(const srt::flat_set<name>& c) {
+  std_int_vec res;
+  for (const name& x : c) res.push_back(x.id);
+  return res;
+}
+
+}  // namespace
+
+namespace srt {
+
+template <>
+struct is_heterogeneous_key<name, name_view> : std::true_type {};
+
+}  // namespace srt
+
+TEST_CASE("flat_set_insert_constructs_on_miss", "[flat_cainers, flat_set]") {
+  srt::flat_set<name> c;
+  names_built = 0;
+
+  REQUIRE(c.insert(name_view{2}).second);
+  REQUIRE(c.try_emplace(name_view{1}).second);
+  REQUIRE(2 == names_built);
+
+  auto res = c.insert(name_view{2});
+  REQUIRE(!res.second);
+  REQUIRE(res.first == c.begin() + 1);
+  REQUIRE(!c.try_emplace(name_view{1}).second);
+  REQUIRE(2 == names_built);
+
+  std::vector<name_view> views{{3}, {1}, {2}, {5}, {3}};
+  c.insert_keys(views.begin(), views.end());
+  REQUIRE(std_int_vec({1, 2, 3, 5}) == name_ids(c));
+  REQUIRE(5 == names_built);
+}
+
+TEST_CASE("flat_set_insert_converts_other_keys", "[flat_cainers, flat_set]") {
+  int_set c{1, 2, 3};
+  REQUIRE(!c.insert(2.5).second);
+  REQUIRE(c.insert(4u).second);
+  REQUIRE(!c.insert(4u).second);
+  REQUIRE(std_int_vec({1, 2, 3, 4}) == c.body());
+
+  std::vector<double> keys{0.5, 5.0, 3.0};
+  c.insert_keys(keys.begin(), keys.end());
+  REQUIRE(std_int_vec({0, 1, 2, 3, 4, 5}) == c.body());
+
+  REQUIRE(!c.try_emplace(1u).second);
+  REQUIRE(6u == c.size());
+}
+
+TEST_CASE("static_flat_set_insert_keys", "[flat_cainers, flat_set]") {
+  srt::static_flat_set<std::string, 3> c{"b"};
+  std::vector<const char*> keys{"a", "b", "c", "d", "b"};
+  auto stopped = c.insert_keys(keys.begin(), keys.end());
+  REQUIRE(keys.begin() + 3 == stopped);
+  REQUIRE(std::vector<std::string>({"a", "b", "c"}) ==
+          std::vector<std::string>(c.begin(), c.end()));
+
+  REQUIRE(!c.try_emplace("d").second);
+  REQUIRE(c.end() == c.try_emplace("d").first);
+  REQUIRE(c.begin() == c.try_emplace("a").first);
+}
+
+TEST_CASE("flat_set_try_emplace", "[flat_cainers, flat_set]") {
+  using set = srt::flat_set<order, srt::less, std::vector<order>, order_id>;
+  set c{{1, "a"}};
+  REQUIRE(c.try_emplace(2, "b").second);
+  REQUIRE(!c.try_emplace(1, "x").second);
+  REQUIRE(c.find(1)->name == "a");
+  REQUIRE(c.find(2)->name == "b");
+
+  srt::flat_set<std::string, std::less<std::string>> strings;
+  REQUIRE(strings.try_emplace("b").second);
+  REQUIRE(!strings.try_emplace("b").second);
+
+  srt::flat_set<std::string> transparent{"b"};
+  std::vector<const char*> keys{"c", "a", "b", "c"};
+  transparent.insert_keys(keys.begin(), keys.end());
+  REQUIRE(std::vector<std::string>({"a", "b", "c"}) == transparent.body());
+}
+
+TEST_CASE("string_flat_set", "[flat_cainers, string_flat_set]") {
+  using strings = std::vector<std::string>;
+  auto to_strings = [](const srt::string_flat_set& c) {
+    return strings(c.begin(), c.end());
+  };
+
+  srt::string_flat_set c{"banana", "apple", "apple", "", "applesauce"};
+  REQUIRE(strings({"", "apple", "applesauce", "banana"}) == to_strings(c));
+  REQUIRE(c.begin()->size() == 0u);
+
+  REQUIRE(c.insert("cherry").second);
+  REQUIRE(!c.insert("apple").second);
+  REQUIRE(*c.insert(std::string("a\0b", 3)).first == std::string("a\0b", 3));
+  REQUIRE(c.insert(std::string("a\0", 2)).second);
+  REQUIRE(strings({"", std::string("a\0", 2), std::string("a\0b", 3), "apple",
+                   "applesauce", "banana", "cherry"}) == to_strings(c));
+
+  REQUIRE(c.count("applesauce") == 1u);
+  REQUIRE(c.count("applesaucf") == 0u);
+  REQUIRE(c.find("banana") != c.end());
+  REQUIRE(c.find("bananas") == c.end());
+  REQUIRE(*c.lower_bound("b") == "banana");
+
+  REQUIRE(c.erase("apple") == 1u);
+  REQUIRE(c.erase("apple") == 0u);
+  REQUIRE(c.size() == 6u);
+
+  srt::string_flat_set copy = c;
+  REQUIRE(copy == c);
+  copy.compact();
+  REQUIRE(copy == c);
+  REQUIRE(copy.arena_size() < c.arena_size());
+
+  c.clear();
+  REQUIRE(c.empty());
+  REQUIRE(c.arena_size() == 0u);
+}
+
+TEST_CASE("string_flat_set_insert_own_characters",
+          "[flat_cainers, string_flat_set]") {
+  const std::string alphabet = "abcdefghijklmnopqrstuvwxyz";
+  srt::string_flat_set c{alphabet};
+
+  // Every insert appends to the arena the characters it reads from.
+  for (std::size_t n = alphabet.size() - 1; n; --n) {
+    REQUIRE(c.insert(c.find(alphabet)->data(), n).second);
+  }
+  REQUIRE(alphabet.size() == c.size());
+  for (std::size_t n = 1; n <= alphabet.size(); ++n) {
+    REQUIRE(1u == c.count(alphabet.substr(0, n)));
+  }
+}
+
+TEST_CASE("string_flat_set_insert_f_l", "[flat_cainers, string_flat_set]") {
+  // Longer than any small string buffer.
+  std::vector<std::string> strings;
+  for (int i = 0; i != 1000; ++i)
+    strings.push_back(std::to_string(i) + std::string(32, 'x'));
+  std::vector<const char*> pointers;
+  for (const std::string& s : strings) pointers.push_back(s.c_str());
+
+  // No std::string is built per element.
+  srt::string_flat_set c;
+  std::size_t before = heap_allocations;
+  c.insert(pointers.begin(), pointers.end());
+  REQUIRE(heap_allocations - before < pointers.size() / 8);
+  REQUIRE(c.size() == strings.size());
+
+  // Views of another set are read in place too, and existing strings win.
+  srt::string_flat_set views{strings[0], "new"};
+  before = heap_allocations;
+  c.insert(views.begin(), views.end());
+  REQUIRE(heap_allocations - before < 8);
+  REQUIRE(c.size() == strings.size() + 1);
+  REQUIRE(c.count("new") == 1u);
+
+  // Batches are merged in place: one allocation for the batch itself, and
+  // a few to grow the records.
+  before = heap_allocations;
+  for (std::size_t i = 0; i != 100; ++i) {
+    const char* one[] = {pointers[i]};
+    c.insert(one, one + 1);
+  }
+  REQUIRE(heap_allocations - before < 120);
+  REQUIRE(c.size() == strings.size() + 1);
+}
+
+namespace {
+
+// Random inserts, batch inserts and erases of strings over a small alphabet,
+// checked against std::set. |check| runs after every step.
+template <typename Set, typename Check>
+void random_string_set_test(Set& c, int alphabet, Check check) {
+  std::mt19937 g;
+  std::uniform_int_distribution<> dis(0, 20);
+
+  auto random_string = [&] {
+    std::string res(static_cast<std::size_t>(dis(g)), 'a');
+    for (char& ch : res) ch = static_cast<char>('a' + dis(g) % alphabet);
+    return res;
+  };
+
+  std::set<std::string> expected;
+  for (int i = 0; i < 200; ++i) {
+    std::string s = random_string();
+    switch (dis(g) % 3) {
+      case 0: {
+        std::vector<std::string> batch(static_cast<std::size_t>(dis(g)));
+        for (auto& x : batch) x = random_string();
+        c.insert(batch.begin(), batch.end());
+        expected.insert(batch.begin(), batch.end());
+        break;
+      }
+      case 1:
+        REQUIRE(expected.insert(s).second == c.insert(s).second);
+        break;
+      case 2:
+        REQUIRE(expected.erase(s) == c.erase(s));
+        break;
+    }
+    check(expected);
+  }
+
+  REQUIRE(std::vector<std::string>(expected.begin(), expected.end()) ==
+          std::vector<std::string>(c.begin(), c.end()));
+}
+
+}  // namespace
+
+TEST_CASE("string_flat_set_random", "[flat_cainers, string_flat_set]") {
+  srt::string_flat_set c;
+  random_string_set_test(c, 3, [&](const std::set<std::string>& expected) {
+    std::size_t live_chars = 0;
+    for (const std::string& s : expected) live_chars += s.size();
+    REQUIRE(c.arena_size() <= 2 * live_chars);
+  });
+}
+
+TEST_CASE("prefixed_string_set", "[flat_cainers, prefixed_string_set]") {
+  using strings = std::vector<std::string>;
+
+  srt::prefixed_string_set c{"banana", "applesauce", "apple", "", "apple"};
+  REQUIRE(strings({"", "apple", "applesauce", "banana"}) == c.body());
+  REQUIRE(c.prefixes().size() == c.size());
+  REQUIRE(std::is_sorted(c.prefixes().begin(), c.prefixes().end()));
+
+  REQUIRE(c.insert("applesaucf").second);
+  REQUIRE(c.insert("applesau").second);
+  REQUIRE(!c.insert("applesauce").second);
+  REQUIRE(strings({"", "apple", "applesau", "applesauce", "applesaucf",
+                   "banana"}) == c.body());
+
+  REQUIRE(c.count("applesauce") == 1u);
+  REQUIRE(c.count("applesaucd") == 0u);
+  REQUIRE(*c.lower_bound("applesaucd") == "applesauce");
+  REQUIRE(c.find("b") == c.end());
+
+  c.insert({"cherry", "applesauce", "applesaucea"});
+  REQUIRE(strings({"", "apple", "applesau", "applesauce", "applesaucea",
+                   "applesaucf", "banana", "cherry"}) == c.body());
+
+  REQUIRE(c.erase("applesauce") == 1u);
+  REQUIRE(c.erase("applesauce") == 0u);
+  REQUIRE(c.prefixes().size() == c.size());
+
+  c.clear();
+  REQUIRE(c.empty());
+  REQUIRE(c.prefixes().empty());
+}
+
+TEST_CASE("prefixed_string_set_insert_f_l",
+          "[flat_cainers, prefixed_string_set]") {
+  using strings = std::vector<std::string>;
+
+  srt::prefixed_string_set c{"b", "applesauce", "d"};
+  strings batch{"e", "applesaucf", "a", "applesauce", "e", "c", "applesauc"};
+  c.insert(batch.begin(), batch.end());
+  REQUIRE(strings({"a", "applesauc", "applesauce", "applesaucf", "b", "c", "d",
+                   "e"}) == c.body());
+  for (std::size_t i = 0; i != c.size(); ++i) {
+    srt::prefixed_string_set one{c.body()[i]};
+    REQUIRE(one.prefixes()[0] == c.prefixes()[i]);
+  }
+
+  // Merged in place: nothing but the batch itself is allocated.
+  c.clear();
+  c.reserve(2000);
+  for (int i = 0; i != 1000; ++i) c.insert(std::to_string(i));
+  batch = {"500", "5000", "999"};
+  const std::size_t before = heap_allocations;
+  c.insert(batch.begin(), batch.end());
+  REQUIRE(heap_allocations - before < 5);
+  REQUIRE(c.size() == 1001u);
+  REQUIRE(c.count("5000") == 1u);
+}
+
+TEST_CASE("prefixed_string_set_random",
+          "[flat_cainers, prefixed_string_set]") {
+  srt::prefixed_string_set c;
+  random_string_set_test(c, 2, [](const std::set<std::string>&) {});
+
+  for (std::size_t i = 0; i != c.size(); ++i) {
+    srt::prefixed_string_set one{c.body()[i]};
+    REQUIRE(one.prefixes()[0] == c.prefixes()[i]);
+  }
+}
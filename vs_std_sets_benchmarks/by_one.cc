@@ -1,4 +1,5 @@
 #include <algorithm>
+#include <memory>
 #include <random>
 #include <set>
 #include <unordered_set>
@@ -26,6 +27,31 @@ std::vector<value_type> generate_input() {
   return res;
 }
 
+// Owns memory, so moves are not trivial, but can be relocated with memmove.
+struct handle {
+  handle(value_type x) : body(new value_type(x)) {}
+  handle(const handle& x) : body(new value_type(*x.body)) {}
+  handle(handle&&) noexcept = default;
+  handle& operator=(handle&&) noexcept = default;
+
+  friend bool operator<(const handle& x, const handle& y) {
+    return *x.body < *y.body;
+  }
+
+  std::unique_ptr<value_type> body;
+};
+
+}  // namespace
+
+namespace srt {
+
+template <>
+struct is_trivially_relocatable<handle> : std::true_type {};
+
+}  // namespace srt
+
+namespace {
+
 template <typename Contaier>
 void construction_by_one(benchmark::State& state) {
   std::vector<value_type> v = generate_input();
@@ -42,5 +68,11 @@ void construction_by_one(benchmark::State& state) {
 BENCHMARK_TEMPLATE(construction_by_one, std::unordered_set<value_type>);
 BENCHMARK_TEMPLATE(construction_by_one, std::set<value_type>);
 BENCHMARK_TEMPLATE(construction_by_one, srt::flat_set<value_type>);
+BENCHMARK_TEMPLATE(construction_by_one, srt::chunked_flat_set<value_type>);
+
+BENCHMARK_TEMPLATE(construction_by_one, std::set<handle>);
+BENCHMARK_TEMPLATE(construction_by_one, srt::flat_set<handle>);
+BENCHMARK_TEMPLATE(construction_by_one,
+                   srt::flat_set<handle, srt::less, srt::raw_vector<handle>>);
 
 BENCHMARK_MAIN();
@@ -11,6 +11,7 @@ namespace {
 
 constexpr size_t kSize = 1000;
 constexpr size_t kStep = 15;
+constexpr size_t kSmallSize = 16;
 using value_type = int;
 
 std::vector<value_type> generate_input() {
@@ -39,10 +40,31 @@ void find_element(benchmark::State& state) {
   }
 }
 
+// Tag and permission sized sets: every looked up value is in the set.
+template <typename Contaier>
+void find_element_small(benchmark::State& state) {
+  std::vector<value_type> v = generate_input();
+  v.resize(kSmallSize);
+  Contaier c(v.begin(), v.end());
+  size_t looking_for_idx = 0;
+
+  while(state.KeepRunning()) {
+    looking_for_idx += kStep;
+    looking_for_idx %= v.size();
+    benchmark::DoNotOptimize(c.find(v[looking_for_idx]));
+  }
+}
+
 }  // namespace
 
 BENCHMARK_TEMPLATE(find_element, std::unordered_set<value_type>);
 BENCHMARK_TEMPLATE(find_element, srt::flat_set<value_type>);
 BENCHMARK_TEMPLATE(find_element, std::set<value_type>);
 
+BENCHMARK_TEMPLATE(find_element_small, std::unordered_set<value_type>);
+BENCHMARK_TEMPLATE(find_element_small, srt::flat_set<value_type>);
+BENCHMARK_TEMPLATE(find_element_small,
+                   srt::small_flat_set<value_type, kSmallSize>);
+BENCHMARK_TEMPLATE(find_element_small, std::set<value_type>);
+
 BENCHMARK_MAIN();